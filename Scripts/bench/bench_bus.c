@@ -0,0 +1,640 @@
+/*
+ * Userspace microbenchmark for the FBTFT bus kernels
+ *
+ * Compiles the unmodified fbtft-bus.c and fbtft-io.c against the shim in
+ * Scripts/bench/shim, with a write() op that only counts (or captures)
+ * what would go out on the bus. Every kernel is first checked against a
+ * plain reference implementation, then timed. That includes composing
+ * the overlay plane (fbtft-overlay.c) while RGB565 is written.
+ *
+ * Build and run ('make -C Scripts/bench check' runs all the checks):
+ *
+ *   make -C Scripts/bench bench_bus
+ *   Scripts/bench/bench_bus [-q] [-t ms]
+ *
+ *   -q     only run the output checks
+ *   -t ms  minimum time per measurement (default: 100)
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+#include <unistd.h>
+
+#include "fbtft.h"
+
+int shim_verbose;
+int shim_gpio_value[SHIM_NR_GPIOS];
+unsigned long shim_gpio_calls;
+
+#define GPIO_DC		1
+
+void fbtft_dbg_hex(const struct device *dev, int groupsize,
+			void *buf, size_t len, const char *fmt, ...)
+{
+}
+
+/* bus sink: counts, or captures into a buffer for the checks */
+static struct {
+	u8 *buf;
+	size_t len;
+	size_t cap;
+	unsigned long msgs;
+	bool capture;
+} sink;
+
+static void sink_reset(bool capture)
+{
+	sink.len = 0;
+	sink.msgs = 0;
+	sink.capture = capture;
+}
+
+static void sink_put(const void *buf, size_t len)
+{
+	sink.msgs++;
+	if (sink.capture) {
+		if (sink.len + len > sink.cap) {
+			sink.cap = 2 * (sink.len + len);
+			sink.buf = realloc(sink.buf, sink.cap);
+		}
+		memcpy(sink.buf + sink.len, buf, len);
+	}
+	sink.len += len;
+}
+
+int shim_spi_write(struct spi_device *spi, const void *buf, size_t len)
+{
+	sink_put(buf, len);
+	return 0;
+}
+
+/* the register parallel bus isn't measured here, see bench_gpio.c */
+void shim_writel(u32 val, volatile void __iomem *addr)
+{
+	*(volatile u32 *)addr = val;
+}
+
+static int bench_write(struct fbtft_par *par, void *buf, size_t len)
+{
+	sink_put(buf, len);
+	return 0;
+}
+
+/* stream of reference bytes, built the slow and obvious way */
+static struct {
+	u8 *buf;
+	size_t len;
+} ref;
+
+static void ref_put8(u8 val)
+{
+	ref.buf[ref.len++] = val;
+}
+
+static void ref_put16(u16 val)
+{
+	memcpy(ref.buf + ref.len, &val, 2);
+	ref.len += 2;
+}
+
+static void ref_vmem16_bus8(const u16 *vmem, size_t npix,
+					size_t txlen, u8 startbyte)
+{
+	size_t chunk = txlen / 2 - (startbyte ? 2 : 0);
+	size_t i;
+
+	for (i = 0; i < npix; i++) {
+		if (!txlen) {
+			ref_put16(vmem[i]);
+			continue;
+		}
+		if (startbyte && (i % chunk) == 0)
+			ref_put8(startbyte | 0x2);
+		ref_put8(vmem[i] >> 8);
+		ref_put8(vmem[i] & 0xFF);
+	}
+}
+
+static void ref_vmem16_bus9(const u16 *vmem, size_t npix)
+{
+	size_t i;
+
+	for (i = 0; i < npix; i++) {
+		ref_put16(0x100 | (vmem[i] >> 8));
+		ref_put16(0x100 | (vmem[i] & 0xFF));
+	}
+}
+
+/* eight 9-bit words in nine bytes, msb first */
+static void ref_emulate_9(const u16 *words, size_t n)
+{
+	unsigned acc = 0, bits = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		acc = (acc << 9) | (words[i] & 0x1FF);
+		bits += 9;
+		while (bits >= 8) {
+			bits -= 8;
+			ref_put8(acc >> bits);
+		}
+	}
+}
+
+static void ref_reg(int size, u8 startbyte, const unsigned *args, int n)
+{
+	int i;
+
+	if (startbyte)
+		ref_put8(startbyte);
+	if (size == 2) {
+		ref_put8(args[0] >> 8);
+		ref_put8(args[0]);
+	} else {
+		ref_put8(args[0]);
+	}
+	if (n < 2)
+		return;
+	if (startbyte)
+		ref_put8(startbyte | 0x2);
+	for (i = 1; i < n; i++) {
+		if (size == 2) {
+			ref_put8(args[i] >> 8);
+			ref_put8(args[i]);
+		} else {
+			ref_put8(args[i]);
+		}
+	}
+}
+
+/* overlay pixel @o over background @b, both RGB565 */
+static u16 ref_blend(u16 o, u16 b, unsigned alpha)
+{
+	unsigned a = alpha + alpha / 128;
+	unsigned oc[3] = { o >> 11, o >> 5 & 0x3f, o & 0x1f };
+	unsigned bc[3] = { b >> 11, b >> 5 & 0x3f, b & 0x1f };
+	unsigned bits[3] = { 5, 6, 5 };
+	unsigned c[3];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		/* to 8 bits by repeating the top bits, blend, back */
+		oc[i] = oc[i] << (8 - bits[i]) | oc[i] >> (2 * bits[i] - 8);
+		bc[i] = bc[i] << (8 - bits[i]) | bc[i] >> (2 * bits[i] - 8);
+		c[i] = (oc[i] * a + bc[i] * (256 - a)) >> 8 >> (8 - bits[i]);
+	}
+
+	return c[0] << 11 | c[1] << 5 | c[2];
+}
+
+/* test fixture */
+static struct fbtft_par par;
+static struct fb_info info;
+static struct device device;
+static struct spi_device spi;
+static struct fbtft_overlay overlay;
+static struct fb_info overlay_info;
+
+static void setup(unsigned width, unsigned height, size_t txlen,
+							u8 startbyte)
+{
+	static u16 *vmem;
+	static void *txbuf;
+	static u8 regbuf[128];
+	size_t i, npix = width * height;
+
+	free(vmem);
+	free(txbuf);
+	free(par.extra);
+	memset(&par, 0, sizeof(par));
+
+	vmem = malloc(npix * 2);
+	srand(npix);
+	for (i = 0; i < npix; i++)
+		vmem[i] = rand();
+	txbuf = txlen ? malloc(txlen) : NULL;
+
+	info.var.xres = width;
+	info.var.yres = height;
+	info.var.bits_per_pixel = 16;
+	info.fix.line_length = width * 2;
+	info.fix.smem_len = npix * 2;
+	info.screen_base = (char *)vmem;
+	info.device = &device;
+	info.par = &par;
+
+	par.panel.width = width;
+	par.panel.height = height;
+	par.panel.line_length = width * 2;
+
+	par.info = &info;
+	par.spi = &spi;
+	par.buf = regbuf;
+	par.txbuf.buf = txbuf;
+	par.txbuf.len = txlen;
+	par.startbyte = startbyte;
+	par.gpio.dc = GPIO_DC;
+	par.fbtftops.write = bench_write;
+	/* room for the 9-bit emulation, as in fbtft_probe_common() */
+	par.extra = malloc(txlen + txlen / 8 + 8);
+}
+
+/* a @w x @h overlay at @x,@y of random pixels, a few of them @colorkey */
+static void setup_overlay(unsigned x, unsigned y, unsigned w, unsigned h,
+				int colorkey, u8 alpha)
+{
+	static u16 *vmem;
+	size_t i;
+
+	free(vmem);
+	free(overlay.buf);
+	memset(&overlay, 0, sizeof(overlay));
+
+	vmem = malloc(w * h * 2);
+	for (i = 0; i < w * h; i++)
+		vmem[i] = (colorkey >= 0 && !(rand() % 4)) ? colorkey : rand();
+
+	overlay_info.var.xres = w;
+	overlay_info.var.yres = h;
+	overlay_info.fix.line_length = w * 2;
+	overlay_info.screen_base = (char *)vmem;
+
+	overlay.info = &overlay_info;
+	overlay.x = x;
+	overlay.y = y;
+	overlay.width = w;
+	overlay.height = h;
+	overlay.visible = true;
+	overlay.colorkey = colorkey;
+	overlay.alpha = alpha;
+	overlay.buflen = par.txbuf.len * 2;
+	overlay.buf = malloc(overlay.buflen);
+	par.overlay = &overlay;
+}
+
+/* what the display shows with the overlay over it */
+static u16 *ref_compose(void)
+{
+	const u16 *ov = (const u16 *)overlay_info.screen_base;
+	unsigned xres = info.var.xres, yres = info.var.yres;
+	u16 *frame = malloc(xres * yres * 2);
+	unsigned x, y;
+	u16 o;
+
+	memcpy(frame, info.screen_base, xres * yres * 2);
+	for (y = overlay.y; y < overlay.y + overlay.height && y < yres; y++) {
+		for (x = overlay.x; x < overlay.x + overlay.width &&
+							x < xres; x++) {
+			o = ov[(y - overlay.y) * overlay.width + x - overlay.x];
+			if (o != overlay.colorkey)
+				frame[y * xres + x] = ref_blend(o,
+					frame[y * xres + x], overlay.alpha);
+		}
+	}
+
+	return frame;
+}
+
+static size_t frame_bytes(void)
+{
+	return info.var.yres * info.fix.line_length;
+}
+
+static int check_result(const char *name)
+{
+	if (sink.len == ref.len && !memcmp(sink.buf, ref.buf, ref.len))
+		return 0;
+
+	fprintf(stderr, "FAIL %-26s %ux%u txbuflen=%zu startbyte=%u: "
+		"%zu bytes, expected %zu\n", name, info.var.xres,
+		info.var.yres, par.txbuf.len, par.startbyte, sink.len,
+		ref.len);
+	return 1;
+}
+
+static const unsigned frames[][2] = {
+	{ 84, 48 }, { 128, 160 }, { 240, 320 }, { 480, 320 },
+};
+
+static const size_t txbuflens[] = { 0, 512, 4096, 16384, 65536 };
+
+/* overlay inside, over the right and bottom edges, and in the corner */
+static const unsigned overlays[][4] = {
+	{ 10, 7, 32, 32 }, { 70, 20, 40, 16 }, { 3, 40, 16, 30 },
+	{ 0, 0, 84, 48 }, { 83, 47, 8, 8 },
+};
+
+static int check_overlay(void)
+{
+	static const int colorkeys[] = { -1, 0xf81f };
+	static const u8 alphas[] = { 255, 128, 1 };
+	size_t o, t, k, a, line_length;
+	unsigned start, end;
+	u16 *frame;
+	int fails = 0;
+
+	for (o = 0; o < ARRAY_SIZE(overlays); o++)
+	for (t = 1; t < ARRAY_SIZE(txbuflens); t++)
+	for (k = 0; k < ARRAY_SIZE(colorkeys); k++)
+	for (a = 0; a < ARRAY_SIZE(alphas); a++) {
+		setup(84, 48, txbuflens[t], 0);
+		setup_overlay(overlays[o][0], overlays[o][1], overlays[o][2],
+				overlays[o][3], colorkeys[k], alphas[a]);
+		frame = ref_compose();
+		line_length = info.fix.line_length;
+
+		sink_reset(true);
+		ref.len = 0;
+		fbtft_write_vmem16_bus8(&par, 0, frame_bytes());
+		ref_vmem16_bus8(frame, frame_bytes() / 2, par.txbuf.len, 0);
+		fails += check_result("write_vmem16_bus8+overlay");
+
+		/* a band starting in the middle of the overlay */
+		start = overlays[o][1] + overlays[o][3] / 2;
+		end = min_t(unsigned, start + 5, info.var.yres - 1);
+		if (start <= end) {
+			sink_reset(true);
+			ref.len = 0;
+			fbtft_write_vmem16_bus8(&par, start * line_length,
+					(end - start + 1) * line_length);
+			ref_vmem16_bus8(frame + start * info.var.xres,
+				(end - start + 1) * info.var.xres,
+				par.txbuf.len, 0);
+			fails += check_result("write_vmem16_bus8+overlay band");
+		}
+
+		sink_reset(true);
+		ref.len = 0;
+		fbtft_write_vmem16_bus16(&par, 0, frame_bytes());
+		ref.len = frame_bytes();
+		memcpy(ref.buf, frame, ref.len);
+		fails += check_result("write_vmem16_bus16+overlay");
+
+		free(frame);
+	}
+
+	return fails;
+}
+
+static int run_checks(void)
+{
+	static const unsigned args[] = { 0x2A, 0x00, 0x10, 0x01, 0x3F };
+	const u16 *vmem;
+	size_t f, t, npix, len;
+	int sb, n, fails = 0;
+
+	ref.buf = malloc(4 * 480 * 320 + 65536);
+
+	for (f = 0; f < ARRAY_SIZE(frames); f++) {
+		for (t = 0; t < ARRAY_SIZE(txbuflens); t++) {
+			for (sb = 0; sb < 2; sb++) {
+				if (sb && !txbuflens[t])
+					continue;
+				setup(frames[f][0], frames[f][1],
+					txbuflens[t], sb ? 0x70 : 0);
+				vmem = (u16 *)info.screen_base;
+				npix = frame_bytes() / 2;
+
+				sink_reset(true);
+				ref.len = 0;
+				fbtft_write_vmem16_bus8(&par, 0, frame_bytes());
+				ref_vmem16_bus8(vmem, npix, par.txbuf.len,
+								par.startbyte);
+				fails += check_result("write_vmem16_bus8");
+			}
+			if (!txbuflens[t])
+				continue;
+
+			setup(frames[f][0], frames[f][1], txbuflens[t], 0);
+			vmem = (u16 *)info.screen_base;
+			npix = frame_bytes() / 2;
+
+			sink_reset(true);
+			ref.len = 0;
+			fbtft_write_vmem16_bus9(&par, 0, frame_bytes());
+			ref_vmem16_bus9(vmem, npix);
+			fails += check_result("write_vmem16_bus9");
+
+			/* feed the bus9 output through the 9-bit emulation */
+			len = min_t(size_t, par.txbuf.len, frame_bytes()) & ~15;
+			memcpy(par.txbuf.buf, sink.buf, len);
+			sink_reset(true);
+			ref.len = 0;
+			fbtft_write_spi_emulate_9(&par, par.txbuf.buf, len);
+			ref_emulate_9(par.txbuf.buf, len / 2);
+			fails += check_result("write_spi_emulate_9");
+		}
+	}
+
+	for (sb = 0; sb < 2; sb++) {
+		for (n = 1; n <= ARRAY_SIZE(args); n++) {
+			setup(8, 8, 4096, sb ? 0x70 : 0);
+
+			sink_reset(true);
+			ref.len = 0;
+			switch (n) {
+			case 1:
+				fbtft_write_reg8_bus8(&par, 1, args[0]);
+				break;
+			case 2:
+				fbtft_write_reg8_bus8(&par, 2, args[0], args[1]);
+				break;
+			case 3:
+				fbtft_write_reg8_bus8(&par, 3, args[0], args[1],
+							args[2]);
+				break;
+			case 4:
+				fbtft_write_reg8_bus8(&par, 4, args[0], args[1],
+							args[2], args[3]);
+				break;
+			case 5:
+				fbtft_write_reg8_bus8(&par, 5, args[0], args[1],
+							args[2], args[3], args[4]);
+				break;
+			}
+			ref_reg(1, par.startbyte, args, n);
+			fails += check_result("write_reg8_bus8");
+		}
+
+		sink_reset(true);
+		ref.len = 0;
+		fbtft_write_reg16_bus8(&par, 5, args[0], args[1],
+					args[2], args[3], args[4]);
+		ref_reg(2, par.startbyte, args, 5);
+		fails += check_result("write_reg16_bus8");
+	}
+
+	fails += check_overlay();
+
+	free(ref.buf);
+	printf("checks: %s\n", fails ? "FAILED" : "ok");
+
+	return fails;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned min_ms = 100;
+
+/* runs fn until min_ms has passed, returns ns per call */
+static double measure(void (*fn)(void))
+{
+	unsigned long calls = 0;
+	double start, elapsed;
+
+	fn(); /* warm up */
+	start = now_ns();
+	do {
+		fn();
+		calls++;
+		elapsed = now_ns() - start;
+	} while (elapsed < min_ms * 1e6);
+
+	return elapsed / calls;
+}
+
+static void do_vmem16_bus8(void)
+{
+	fbtft_write_vmem16_bus8(&par, 0, frame_bytes());
+}
+
+static void do_vmem16_bus9(void)
+{
+	fbtft_write_vmem16_bus9(&par, 0, frame_bytes());
+}
+
+static void do_emulate_9(void)
+{
+	fbtft_write_spi_emulate_9(&par, par.txbuf.buf, par.txbuf.len & ~15);
+}
+
+static void do_reg8_bus8(void)
+{
+	fbtft_write_reg8_bus8(&par, 5, 0x2A, 0x00, 0x10, 0x01, 0x3F);
+}
+
+/* the lines under a 32x32 cursor, as when it moves */
+static void do_cursor_lines(void)
+{
+	size_t line_length = info.fix.line_length;
+
+	fbtft_write_vmem16_bus8(&par, overlay.y * line_length,
+					32 * line_length);
+}
+
+static void report(const char *name, double ns, size_t pixels, size_t bytes)
+{
+	printf("%-20s %4ux%-4u %6zu %3s %9.3f %9.1f %9lu\n", name,
+		info.var.xres, info.var.yres, par.txbuf.len,
+		par.startbyte ? "on" : "off", ns / pixels, bytes * 1e3 / ns,
+		sink.msgs);
+}
+
+static void run_bench(void)
+{
+	size_t f, t, bytes;
+	double ns;
+	int sb;
+
+	printf("%-20s %9s %6s %3s %9s %9s %9s\n", "kernel", "frame",
+		"txbuf", "sb", "ns/pixel", "MB/s", "msgs");
+
+	for (f = 0; f < ARRAY_SIZE(frames); f++) {
+		for (t = 1; t < ARRAY_SIZE(txbuflens); t++) {
+			for (sb = 0; sb < 2; sb++) {
+				setup(frames[f][0], frames[f][1],
+					txbuflens[t], sb ? 0x70 : 0);
+				ns = measure(do_vmem16_bus8);
+				sink_reset(false);
+				do_vmem16_bus8();
+				report("write_vmem16_bus8", ns,
+					frame_bytes() / 2, frame_bytes());
+			}
+
+			setup(frames[f][0], frames[f][1], txbuflens[t], 0);
+			ns = measure(do_vmem16_bus9);
+			sink_reset(false);
+			do_vmem16_bus9();
+			report("write_vmem16_bus9", ns, frame_bytes() / 2,
+							frame_bytes());
+
+			bytes = par.txbuf.len & ~15;
+			ns = measure(do_emulate_9);
+			sink_reset(false);
+			do_emulate_9();
+			report("write_spi_emulate_9", ns, bytes / 4, bytes);
+		}
+	}
+
+	/* full frames and cursor moves, without and with the overlay */
+	for (f = 0; f < ARRAY_SIZE(frames); f++) {
+		setup(frames[f][0], frames[f][1], 4096, 0);
+		ns = measure(do_vmem16_bus8);
+		sink_reset(false);
+		do_vmem16_bus8();
+		report("frame", ns, frame_bytes() / 2, frame_bytes());
+
+		setup_overlay(frames[f][0] / 3, frames[f][1] / 3, 32, 32,
+				0xf81f, 255);
+		ns = measure(do_vmem16_bus8);
+		sink_reset(false);
+		do_vmem16_bus8();
+		report("frame+cursor", ns, frame_bytes() / 2, frame_bytes());
+
+		ns = measure(do_cursor_lines);
+		sink_reset(false);
+		do_cursor_lines();
+		report("cursor lines", ns, 32 * info.var.xres,
+					32 * info.fix.line_length);
+
+		overlay.alpha = 128;
+		ns = measure(do_cursor_lines);
+		sink_reset(false);
+		do_cursor_lines();
+		report("cursor lines a=128", ns, 32 * info.var.xres,
+					32 * info.fix.line_length);
+	}
+
+	setup(8, 8, 4096, 0);
+	ns = measure(do_reg8_bus8);
+	sink_reset(false);
+	do_reg8_bus8();
+	printf("%-20s %9.1f ns/call\n", "write_reg8_bus8(5)", ns);
+}
+
+int main(int argc, char *argv[])
+{
+	bool quick = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "qt:v")) != -1) {
+		switch (opt) {
+		case 'q':
+			quick = true;
+			break;
+		case 't':
+			min_ms = atoi(optarg);
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-q] [-t ms] [-v]\n",
+								argv[0]);
+			return 2;
+		}
+	}
+
+	if (run_checks())
+		return 1;
+	if (!quick)
+		run_bench();
+
+	return 0;
+}
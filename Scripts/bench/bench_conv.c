@@ -0,0 +1,373 @@
+/*
+ * Userspace microbenchmark for the RGB565 conversion in fbtft-conv.c
+ *
+ * Compares the table driven batch functions to the per pixel conversion
+ * the drivers had before (three multiplies and a cpu_to_le16() per pixel,
+ * packed a pixel or a bit at a time). The checks run both over every
+ * RGB565 value and over the test frames, and the output has to match.
+ *
+ * For the column-major controllers, the old conversion goes down 8 rows
+ * for each byte. The "rows" line compares the 8x8 tile transpose to
+ * converting a row at a time and or-ing the bits into the column bytes.
+ * Give it a large virtual panel (-w 1024 -h 768) to see the strided
+ * reads miss the cache.
+ *
+ * Build and run ('make -C Scripts/bench check' runs all the checks):
+ *
+ *   make -C Scripts/bench bench_conv
+ *   Scripts/bench/bench_conv [-q] [-t ms] [-w width] [-h height]
+ *
+ *   -q         only run the output checks
+ *   -t ms      minimum time per measurement (default: 100)
+ *   -w, -h     frame size (default: 256x64)
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+#include <unistd.h>
+
+#include "fbtft.h"
+
+int shim_verbose;
+int shim_gpio_value[SHIM_NR_GPIOS];
+unsigned long shim_gpio_calls;
+
+void fbtft_dbg_hex(const struct device *dev, int groupsize,
+			void *buf, size_t len, const char *fmt, ...)
+{
+}
+
+int shim_spi_write(struct spi_device *spi, const void *buf, size_t len)
+{
+	return 0;
+}
+
+/* the conversion fb_ssd1322, fb_gu39xx and fb_pcd8544 had before */
+#define CYR     613    /* 2.392 */
+#define CYG     601    /* 2.348 */
+#define CYB     233    /* 0.912 */
+
+#define THRESH  ((int)(65536 * 0.4))
+
+static unsigned int rgb565_to_y(unsigned int rgb)
+{
+	rgb = cpu_to_le16(rgb);
+	return CYR * (rgb >> 11) + CYG * (rgb >> 5 & 0x3F) + CYB * (rgb & 0x1F);
+}
+
+static unsigned int rgb565_to_m(unsigned int rgb)
+{
+	return rgb565_to_y(rgb) > THRESH ? 1 : 0;
+}
+
+static void ref_gray4(const u16 *src, u8 *dst, size_t len)
+{
+	size_t x;
+
+	for (x = 0; x < len / 2; x++) {
+		*dst = cpu_to_le16(rgb565_to_y(*src++)) >> 8 & 0xF0;
+		*dst++ |= cpu_to_le16(rgb565_to_y(*src++)) >> 12;
+	}
+}
+
+static void ref_mono(const u16 *src, u8 *dst, size_t len)
+{
+	size_t x;
+	u8 data;
+	int i;
+
+	for (x = 0; x < len / 8; x++) {
+		for (data = 0, i = 0; i < 8; i++)
+			data = data << 1 | rgb565_to_m(*src++);
+		*dst++ = data;
+	}
+}
+
+/* column-major bytes, 8 rows each with the top row in bit 7 */
+static void ref_mono_col(const u16 *src, unsigned width, unsigned height,
+				u8 *dst)
+{
+	unsigned rows = height / 8, x, r;
+	const u16 *p;
+	u8 data;
+	int i;
+
+	for (x = 0; x < width; x++) {
+		for (r = 0; r < rows; r++) {
+			p = src + r * 8 * width + x;
+			for (data = 0, i = 0; i < 8; i++, p += width)
+				data = data << 1 | rgb565_to_m(*p);
+			dst[x * rows + r] = data;
+		}
+	}
+}
+
+/* fbtft_conv_mono_col() before the transpose: a row at a time, each bit
+ * or-ed into its column's byte */
+static void rows_mono_col(const struct fbtft_conv *conv, const u16 *src,
+			unsigned width, unsigned height, u8 *dst)
+{
+	unsigned rows = height / 8, r, i, x, luma;
+	const u16 *p;
+	u8 *d;
+
+	for (r = 0; r < rows; r++) {
+		p = src + r * 8 * width;
+		d = dst + r;
+		for (x = 0; x < width; x++)
+			d[x * rows] = 0;
+		for (i = 0; i < 8; i++, p += width)
+			for (x = 0; x < width; x++) {
+				luma = conv->hi[p[x] >> 8] + conv->lo[p[x] & 0xFF];
+				d[x * rows] |= (luma > conv->threshold) << (7 - i);
+			}
+	}
+}
+
+static void new_mono_col(const struct fbtft_conv *conv, const u16 *src,
+			unsigned width, unsigned height, u8 *dst)
+{
+	unsigned rows = height / 8, r;
+
+	for (r = 0; r < rows; r++)
+		fbtft_conv_mono_col(conv, src + r * 8 * width, width,
+				dst + r, rows, width, true);
+}
+
+static unsigned width = 256;
+static unsigned height = 64;
+static unsigned min_ms = 100;
+
+static struct fbtft_par par_gray, par_mono;
+static u16 *frame;
+static u8 *out_ref, *out_new;
+
+enum pattern { RAMP, NOISE, TEXT, NR_PATTERNS };
+static const char *pattern_names[] = { "ramp", "noise", "text" };
+
+static void make_frame(enum pattern p)
+{
+	u32 seed = 1;
+	unsigned x, y;
+	u16 *pix;
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			pix = &frame[y * width + x];
+			switch (p) {
+			case RAMP:
+				*pix = (x * 31 / width) << 11 |
+				       (y * 63 / height) << 5 |
+				       (x * 31 / width);
+				break;
+			case NOISE:
+				seed = seed * 1103515245 + 12345;
+				*pix = seed >> 16;
+				break;
+			default:
+				*pix = ((x / 3 + y / 5) % 4 && (x % 6) && (y % 8)) ?
+					0x0000 : 0xFFFF;
+				break;
+			}
+		}
+	}
+}
+
+static int check(const char *what, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (out_ref[i] != out_new[i]) {
+			fprintf(stderr, "%s: byte %zu is 0x%02x, expected 0x%02x\n",
+				what, i, out_new[i], out_ref[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int run_checks(void)
+{
+	size_t len = width * height;
+	u16 *all;
+	int ret = 0;
+	unsigned i;
+	enum pattern p;
+
+	/* every value, in runs that are not a multiple of 8 too */
+	all = malloc(65536 * sizeof(*all));
+	for (i = 0; i < 65536; i++)
+		all[i] = i;
+	ref_gray4(all, out_ref, 65536);
+	fbtft_conv_gray4(par_gray.conv, all, out_new, 65536);
+	ret |= check("gray4 all values", 32768);
+	ref_mono(all, out_ref, 65536);
+	fbtft_conv_mono(par_mono.conv, all, out_new, 65536);
+	ret |= check("mono all values", 8192);
+	for (i = 1; i < 8; i++) {
+		fbtft_conv_mono(par_mono.conv, all + 8 * 1000, out_new, i);
+		if ((out_new[0] ^ out_ref[1000]) & (0xFF << (8 - i))) {
+			fprintf(stderr, "mono: tail of %u pixels\n", i);
+			ret = 1;
+		}
+	}
+	free(all);
+
+	for (p = 0; p < NR_PATTERNS; p++) {
+		make_frame(p);
+		ref_gray4(frame, out_ref, len);
+		fbtft_conv_gray4(par_gray.conv, frame, out_new, len);
+		ret |= check("gray4", len / 2);
+		ref_mono(frame, out_ref, len);
+		fbtft_conv_mono(par_mono.conv, frame, out_new, len);
+		ret |= check("mono", len / 8);
+		ref_mono_col(frame, width, height, out_ref);
+		new_mono_col(par_mono.conv, frame, width, height, out_new);
+		ret |= check("mono_col", len / 8);
+		rows_mono_col(par_mono.conv, frame, width, height, out_ref);
+		ret |= check("mono_col rows", len / 8);
+	}
+
+	printf("checks: %s\n", ret ? "FAILED" : "ok");
+
+	return ret;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+enum func { GRAY4, MONO, MONO_COL, ROWS, NR_FUNCS };
+static const char *func_names[] = { "gray4", "mono", "mono_col", "rows" };
+
+static void convert(enum func f, bool ref)
+{
+	size_t len = width * height;
+
+	switch (f) {
+	case GRAY4:
+		if (ref)
+			ref_gray4(frame, out_ref, len);
+		else
+			fbtft_conv_gray4(par_gray.conv, frame, out_new, len);
+		break;
+	case MONO:
+		if (ref)
+			ref_mono(frame, out_ref, len);
+		else
+			fbtft_conv_mono(par_mono.conv, frame, out_new, len);
+		break;
+	case ROWS:
+		if (ref)
+			rows_mono_col(par_mono.conv, frame, width, height,
+					out_ref);
+		else
+			new_mono_col(par_mono.conv, frame, width, height,
+					out_new);
+		break;
+	default:
+		if (ref)
+			ref_mono_col(frame, width, height, out_ref);
+		else
+			new_mono_col(par_mono.conv, frame, width, height,
+					out_new);
+		break;
+	}
+}
+
+/* ns per pixel */
+static double measure(enum func f, bool ref)
+{
+	unsigned long runs = 0;
+	double start, elapsed;
+
+	start = now_ns();
+	do {
+		convert(f, ref);
+		runs++;
+		elapsed = now_ns() - start;
+	} while (elapsed < min_ms * 1e6);
+
+	return elapsed / runs / (width * height);
+}
+
+static void run_bench(void)
+{
+	double ref, new;
+	enum pattern p;
+	enum func f;
+
+	printf("%ux%u\n", width, height);
+	printf("%-9s %-7s %10s %10s %8s\n", "function", "input", "old ns/px",
+		"new ns/px", "speedup");
+	for (f = 0; f < NR_FUNCS; f++) {
+		for (p = 0; p < NR_PATTERNS; p++) {
+			make_frame(p);
+			ref = measure(f, true);
+			new = measure(f, false);
+			printf("%-9s %-7s %10.3f %10.3f %7.2fx\n",
+				func_names[f], pattern_names[p], ref, new,
+				ref / new);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	bool quick = false;
+	size_t n;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "qt:w:h:v")) != -1) {
+		switch (opt) {
+		case 'q':
+			quick = true;
+			break;
+		case 't':
+			min_ms = atoi(optarg);
+			break;
+		case 'w':
+			width = atoi(optarg);
+			break;
+		case 'h':
+			height = atoi(optarg);
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-q] [-t ms] [-w width] [-h height]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (!width || width % 8 || !height || height % 8) {
+		fprintf(stderr, "width and height have to be multiples of 8\n");
+		return 2;
+	}
+
+	/* the settings the drivers use by default */
+	if (fbtft_conv_init(&par_gray, 16, 0, NULL) ||
+	    fbtft_conv_init(&par_mono, 2, THRESH, NULL)) {
+		fprintf(stderr, "setup failed\n");
+		return 1;
+	}
+	n = max_t(size_t, width * height, 65536);
+	frame = malloc(width * height * sizeof(*frame));
+	out_ref = malloc(n);
+	out_new = malloc(n);
+
+	if (run_checks())
+		return 1;
+	if (!quick)
+		run_bench();
+
+	return 0;
+}
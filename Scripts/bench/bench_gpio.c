@@ -0,0 +1,420 @@
+/*
+ * Userspace microbenchmark for the FBTFT parallel bus
+ *
+ * Compiles the unmodified fbtft-io.c against the shim in Scripts/bench/shim
+ * and drives the set/clear register path (fbtft_gpio_regs_init()) into a
+ * mock register window, and the gpiolib path into the gpio values the shim
+ * keeps. The checks emulate the registers, the gpios and the bus:
+ * data is sampled on each rising /WR edge, and the low byte of latched
+ * buses when the latch closes. It has to match what was written. The
+ * timing runs write to the window without emulation and compare the
+ * tables to the old way of building the masks bit by bit for each byte,
+ * and to the gpiolib path (gpiod_*() calls counted by the shim).
+ *
+ * Build and run ('make -C Scripts/bench check' runs all the checks):
+ *
+ *   make -C Scripts/bench bench_gpio
+ *   Scripts/bench/bench_gpio [-q] [-t ms]
+ *
+ * The gpiolib path uses the int array call of the 4.x kernels, the
+ * Makefile shows how to build the bitmap array call of 5.0 instead.
+ *
+ *   -q     only run the output checks
+ *   -t ms  minimum time per measurement (default: 100)
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+#include <unistd.h>
+
+#include "fbtft.h"
+
+int shim_verbose;
+int shim_gpio_value[SHIM_NR_GPIOS];
+unsigned long shim_gpio_calls;
+
+/* Raspberry Pi like wiring, the data lines are scattered over the bank */
+static const int db_gpios[16] = {
+	7, 8, 25, 24, 23, 18, 15, 14, 12, 16, 20, 21, 5, 6, 13, 19,
+};
+#define GPIO_WR		17
+#define GPIO_LATCH	22
+#define GPIO_DC		27
+
+void fbtft_dbg_hex(const struct device *dev, int groupsize,
+			void *buf, size_t len, const char *fmt, ...)
+{
+}
+
+int shim_spi_write(struct spi_device *spi, const void *buf, size_t len)
+{
+	return 0;
+}
+
+/* mock register window: set and clear register */
+static volatile u32 window[2];
+#define REG_SET		((void __iomem *)&window[0])
+#define REG_CLR		((void __iomem *)&window[1])
+
+/* bus emulation for the checks */
+static struct {
+	bool on;
+	bool latched_bus;
+	u32 lines;
+	u16 latched;
+	u16 *buf;
+	size_t len;
+	size_t cap;
+} bus;
+
+static unsigned long writes;
+
+static u16 bus_data(u32 lines, unsigned width)
+{
+	u16 data = 0;
+	unsigned i;
+
+	for (i = 0; i < width; i++)
+		if (lines & (1U << db_gpios[i]))
+			data |= 1 << i;
+
+	return data;
+}
+
+static void bus_sample(u32 old, u32 new)
+{
+	u32 wr = 1U << GPIO_WR;
+	u32 latch = 1U << GPIO_LATCH;
+
+	if ((old & latch) && !(new & latch))
+		bus.latched = bus_data(new, 8);
+	if (!(old & wr) && (new & wr)) {
+		if (bus.len == bus.cap) {
+			bus.cap = bus.cap ? 2 * bus.cap : 4096;
+			bus.buf = realloc(bus.buf, bus.cap * sizeof(*bus.buf));
+		}
+		bus.buf[bus.len++] = bus.latched_bus ?
+			bus.latched | bus_data(new, 8) << 8 :
+			bus_data(new, 16);
+	}
+}
+
+/* the gpiolib path, followed through the values the shim keeps */
+void shim_gpio_changed(void)
+{
+	u32 old = bus.lines;
+	unsigned i;
+
+	if (!bus.on)
+		return;
+	bus.lines = 0;
+	for (i = 0; i < 32; i++)
+		if (shim_gpio_value[i])
+			bus.lines |= 1U << i;
+	bus_sample(old, bus.lines);
+}
+
+void shim_writel(u32 val, volatile void __iomem *addr)
+{
+	u32 old = bus.lines;
+
+	writes++;
+	*(volatile u32 *)addr = val;
+	if (!bus.on)
+		return;
+	if (addr == REG_SET)
+		bus.lines |= val;
+	else
+		bus.lines &= ~val;
+	bus_sample(old, bus.lines);
+}
+
+/* the per byte mask building fbtft-io.c had before the tables */
+#define GPIOSET(no, ishigh)           \
+do {                                  \
+	if (ishigh)                   \
+		set |= (1 << (no));   \
+	else                          \
+		reset |= (1 << (no)); \
+} while (0)
+
+static int ref_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len)
+{
+	unsigned int set = 0;
+	unsigned int reset = 0;
+	u8 data;
+	int i;
+
+	while (len--) {
+		data = *(u8 *) buf;
+		buf++;
+
+		for (i = 0; i < 8; i++)
+			GPIOSET(par->gpio.db[i], data & (1 << i));
+		writel(set, REG_SET);
+		writel(reset, REG_CLR);
+
+		writel((1<<par->gpio.wr), REG_CLR);
+		writel(0, REG_CLR); /* used as a delay */
+		writel((1<<par->gpio.wr), REG_SET);
+
+		set = 0;
+		reset = 0;
+	}
+
+	return 0;
+}
+
+static int ref_write_gpio16_wr(struct fbtft_par *par, void *buf, size_t len)
+{
+	unsigned int set = 0;
+	unsigned int reset = 0;
+	u16 data;
+	int i;
+
+	while (len) {
+		len -= 2;
+		data = *(u16 *) buf;
+		buf += 2;
+
+		gpio_set_value(par->gpio.wr, 0);
+		for (i = 0; i < 16; i++)
+			GPIOSET(par->gpio.db[i], data & (1 << i));
+		writel(set, REG_SET);
+		writel(reset, REG_CLR);
+		gpio_set_value(par->gpio.wr, 1);
+
+		set = 0;
+		reset = 0;
+	}
+
+	return 0;
+}
+
+#undef GPIOSET
+
+static struct fbtft_par par;
+static struct fb_info info;
+static struct device device;
+
+static int setup(unsigned width, bool latched, bool regs)
+{
+	unsigned i;
+
+	fbtft_gpio_bus_exit(&par);
+	memset(&par, 0, sizeof(par));
+	info.device = &device;
+	par.info = &info;
+	par.gpio.dc = GPIO_DC;
+	par.gpio.wr = GPIO_WR;
+	par.gpio.latch = latched ? GPIO_LATCH : -1;
+	par.gpio.reset = -1;
+	for (i = 0; i < 16; i++)
+		par.gpio.db[i] = i < width ? db_gpios[i] : -1;
+
+	if (fbtft_gpio_bus_init(&par))
+		return -1;
+	if (regs && fbtft_gpio_regs_init(&par, REG_SET, REG_CLR, 0))
+		return -1;
+
+	window[0] = window[1] = 0;
+	memset(shim_gpio_value, 0, sizeof(shim_gpio_value));
+	shim_gpio_value[GPIO_WR] = 1;
+	bus.lines = 1U << GPIO_WR;
+	bus.latched_bus = latched;
+	bus.latched = 0;
+	bus.len = 0;
+
+	return 0;
+}
+
+/* RGB565 test frame: a gradient over a flat area, as in a typical UI */
+#define FRAME_W		320
+#define FRAME_H		240
+static u16 frame[FRAME_W * FRAME_H];
+
+static void make_frame(void)
+{
+	unsigned x, y;
+
+	for (y = 0; y < FRAME_H; y++)
+		for (x = 0; x < FRAME_W; x++)
+			frame[y * FRAME_W + x] = y < FRAME_H / 2 ?
+				(x * 31 / FRAME_W) << 11 | (y * 63 / FRAME_H) << 5 |
+				((x ^ y) & 31) : 0x2104;
+}
+
+struct bus_case {
+	const char *name;
+	unsigned width;
+	bool latched;
+	int (*fn)(struct fbtft_par *par, void *buf, size_t len);
+};
+
+static const struct bus_case cases[] = {
+	{ "gpio8_wr", 8, false, fbtft_write_gpio8_wr },
+	{ "gpio16_wr", 16, false, fbtft_write_gpio16_wr },
+	{ "gpio16_wr_latched", 8, true, fbtft_write_gpio16_wr_latched },
+};
+
+static int check_case(const struct bus_case *c, bool regs)
+{
+	const char *path = regs ? "tables" : "gpiod";
+	const u8 *bytes = (const u8 *)frame;
+	size_t n = sizeof(frame), i;
+	bool word = c->fn != fbtft_write_gpio8_wr;
+
+	if (setup(c->width, c->latched, regs)) {
+		fprintf(stderr, "%s/%s: setup failed\n", c->name, path);
+		return 1;
+	}
+	bus.on = true;
+	c->fn(&par, frame, n);
+	bus.on = false;
+
+	if (bus.len != (word ? n / 2 : n)) {
+		fprintf(stderr, "%s/%s: %zu bus cycles, expected %zu\n",
+			c->name, path, bus.len, word ? n / 2 : n);
+		return 1;
+	}
+	for (i = 0; i < bus.len; i++) {
+		if (bus.buf[i] != (word ? frame[i] : bytes[i])) {
+			fprintf(stderr, "%s/%s: cycle %zu is 0x%04x, expected 0x%04x\n",
+				c->name, path, i, bus.buf[i],
+				word ? frame[i] : bytes[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int run_checks(void)
+{
+	unsigned i;
+	int ret = 0;
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		ret |= check_case(&cases[i], true);
+		ret |= check_case(&cases[i], false);
+	}
+
+	/* the reference has to agree with the emulation too */
+	setup(8, false, false);
+	bus.on = true;
+	ref_write_gpio8_wr(&par, frame, sizeof(frame));
+	bus.on = false;
+	for (i = 0; i < sizeof(frame); i++)
+		if (i >= bus.len || bus.buf[i] != ((u8 *)frame)[i])
+			break;
+	if (i != sizeof(frame) || bus.len != sizeof(frame)) {
+		fprintf(stderr, "reference gpio8_wr doesn't match\n");
+		ret = 1;
+	}
+
+	printf("checks: %s\n", ret ? "FAILED" : "ok");
+
+	return ret;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned min_ms = 100;
+
+/* ns per frame, and register writes and gpio calls per bus cycle */
+static double measure(int (*fn)(struct fbtft_par *par, void *buf, size_t len),
+			size_t cycles, double *wr_per, double *calls_per)
+{
+	unsigned long runs = 0;
+	double start, elapsed;
+
+	writes = 0;
+	shim_gpio_calls = 0;
+	start = now_ns();
+	do {
+		fn(&par, frame, sizeof(frame));
+		runs++;
+		elapsed = now_ns() - start;
+	} while (elapsed < min_ms * 1e6);
+
+	*wr_per = (double)writes / runs / cycles;
+	*calls_per = (double)shim_gpio_calls / runs / cycles;
+
+	return elapsed / runs;
+}
+
+static void report(const char *name, const char *path, double ns,
+			size_t cycles, double wr_per, double calls_per)
+{
+	printf("%-18s %-9s %9.3f %8.2f %7.2f %7.2f\n", name, path, ns / 1e6,
+		ns / cycles, wr_per, calls_per);
+}
+
+static void run_bench(void)
+{
+	double ns, wr_per, calls_per;
+	size_t cycles;
+	unsigned i;
+
+	printf("%-18s %-9s %9s %8s %7s %7s\n", "function", "path",
+		"ms/frame", "ns/cycle", "writes", "gpio");
+
+	setup(8, false, false);
+	ns = measure(ref_write_gpio8_wr, sizeof(frame), &wr_per, &calls_per);
+	report("gpio8_wr", "bitwise", ns, sizeof(frame), wr_per, calls_per);
+	setup(16, false, false);
+	ns = measure(ref_write_gpio16_wr, sizeof(frame) / 2, &wr_per,
+			&calls_per);
+	report("gpio16_wr", "bitwise", ns, sizeof(frame) / 2, wr_per,
+		calls_per);
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		cycles = cases[i].fn == fbtft_write_gpio8_wr ?
+				sizeof(frame) : sizeof(frame) / 2;
+
+		setup(cases[i].width, cases[i].latched, true);
+		ns = measure(cases[i].fn, cycles, &wr_per, &calls_per);
+		report(cases[i].name, "tables", ns, cycles, wr_per, calls_per);
+
+		setup(cases[i].width, cases[i].latched, false);
+		ns = measure(cases[i].fn, cycles, &wr_per, &calls_per);
+		report(cases[i].name, "gpiod", ns, cycles, wr_per, calls_per);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	bool quick = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "qt:v")) != -1) {
+		switch (opt) {
+		case 'q':
+			quick = true;
+			break;
+		case 't':
+			min_ms = atoi(optarg);
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-q] [-t ms]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	make_frame();
+	if (run_checks())
+		return 1;
+	if (!quick)
+		run_bench();
+
+	return 0;
+}
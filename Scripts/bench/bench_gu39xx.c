@@ -0,0 +1,386 @@
+/*
+ * Userspace benchmark for the fb_gu39xx ready line handshake
+ *
+ * Runs the write() of fb_gu39xx (through mono_gu39xx.c) against a
+ * simulated controller: a thread that takes one byte out of its input
+ * buffer every -r ns, and is busy for -d us drawing after each frame.
+ * Its ready line is asserted while there is room for 'fifo' bytes,
+ * and the rising edge raises the ready interrupt.
+ *
+ * The old handshake, polling the ready line and yielding before every
+ * byte, runs alongside for comparison. For each, the CPU time the
+ * writing thread used per frame is reported next to the throughput.
+ * The checks make sure all bytes arrive in order and the input buffer
+ * never overflows.
+ *
+ * Build and run ('make -C Scripts/bench check' runs all the checks):
+ *
+ *   make -C Scripts/bench bench_gu39xx
+ *   Scripts/bench/bench_gu39xx [-q] [-t ms] [-r ns] [-b bytes] [-d us]
+ *
+ *   -q        only run the output checks
+ *   -t ms     minimum time per measurement (default: 500)
+ *   -r ns     time the controller takes per byte (default: 2000)
+ *   -b bytes  size of the controller's input buffer (default: 16)
+ *   -d us     time the controller is busy after each frame (default: 2000)
+ *
+ * The controller thread spins to keep its timing, so this needs two idle
+ * CPUs to give meaningful numbers.
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+#include <unistd.h>
+
+#include "fbtft.h"
+
+int shim_verbose;
+int shim_gpio_value[SHIM_NR_GPIOS];
+unsigned long shim_gpio_calls;
+struct shim_irq shim_irq[SHIM_NR_GPIOS];
+
+#define GPIO_READY	40
+
+void fbtft_dbg_hex(const struct device *dev, int groupsize,
+			void *buf, size_t len, const char *fmt, ...)
+{
+}
+
+int shim_spi_write(struct spi_device *spi, const void *buf, size_t len)
+{
+	return 0;
+}
+
+extern int bench_gu39xx_write_vmem(struct fbtft_par *par, size_t offset,
+								size_t len);
+extern int bench_gu39xx_write(struct fbtft_par *par, void *buf, size_t len);
+extern void bench_gu39xx_params(unsigned fifo_bytes, unsigned spin_us);
+extern const struct fbtft_display *bench_gu39xx_display;
+
+static unsigned byte_ns = 2000;
+static unsigned depth = 16;
+static unsigned draw_us = 2000;
+static unsigned min_ms = 500;
+
+/* the simulated controller */
+static struct {
+	pthread_mutex_t lock;
+	pthread_t thread;
+	bool stop;
+	unsigned fifo;		/* room needed for ready */
+	unsigned level;		/* bytes in the input buffer */
+	size_t frame_len;	/* draws after this many bytes */
+	size_t taken;
+	s64 next;		/* next byte is taken */
+	s64 busy_until;		/* drawing */
+	unsigned long overruns;
+	u32 hash;
+	size_t bytes;
+} ctrl;
+
+static u32 fnv1a(u32 hash, const u8 *buf, size_t len)
+{
+	while (len--)
+		hash = (hash ^ *buf++) * 16777619;
+
+	return hash;
+}
+
+/* with ctrl.lock held, returns true on a rising edge */
+static bool ctrl_update_ready(s64 now)
+{
+	int old = shim_gpio_value[GPIO_READY];
+	int ready = now >= ctrl.busy_until && depth - ctrl.level >= ctrl.fifo;
+
+	shim_gpio_value[GPIO_READY] = ready;
+
+	return ready && !old;
+}
+
+static void *ctrl_thread(void *arg)
+{
+	bool edge;
+	s64 now;
+
+	while (!ctrl.stop) {
+		now = ktime_get();
+		pthread_mutex_lock(&ctrl.lock);
+		if (now < ctrl.busy_until || !ctrl.level) {
+			ctrl.next = now + byte_ns;
+		} else if (now >= ctrl.next) {
+			ctrl.level--;
+			ctrl.next += byte_ns;
+			if (++ctrl.taken % ctrl.frame_len == 0)
+				ctrl.busy_until = now + draw_us * 1000LL;
+		}
+		edge = ctrl_update_ready(now);
+		pthread_mutex_unlock(&ctrl.lock);
+
+		if (edge)
+			shim_irq_raise(GPIO_READY);
+	}
+
+	return NULL;
+}
+
+/* the driver writes through here, ready or not */
+int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len)
+{
+	pthread_mutex_lock(&ctrl.lock);
+	if (depth - ctrl.level < len)
+		ctrl.overruns++;
+	else
+		ctrl.level += len;
+	ctrl.hash = fnv1a(ctrl.hash, buf, len);
+	ctrl.bytes += len;
+	ctrl_update_ready(ktime_get());
+	pthread_mutex_unlock(&ctrl.lock);
+
+	return 0;
+}
+
+/* the write() fb_gu39xx had before, less the gpio bit banging */
+static int ref_write(struct fbtft_par *par, void *buf, size_t len)
+{
+	while (len--) {
+		/* wait for ready line to be asserted */
+		while (gpio_get_value(par->gpio.aux[0]) == 0)
+			yield();
+
+		fbtft_write_gpio8_wr(par, buf, 1);
+		buf++;
+	}
+
+	return 0;
+}
+
+static void bench_write_register(struct fbtft_par *par, int len, ...)
+{
+	u8 buf[16];
+	va_list args;
+	int i;
+
+	va_start(args, len);
+	for (i = 0; i < len; i++)
+		buf[i] = va_arg(args, unsigned int);
+	va_end(args);
+
+	par->fbtftops.write(par, buf, len);
+}
+
+static struct fbtft_par par;
+static struct fb_info info;
+static struct device device;
+static struct device_driver driver = { .name = "fb_gu39xx" };
+
+static int setup(void)
+{
+	const struct fbtft_display *display = bench_gu39xx_display;
+	size_t vmem_len = display->width * display->height * 2;
+	unsigned i;
+	u16 *vmem;
+
+	device.driver = &driver;
+	info.device = &device;
+	info.var.xres = display->width;
+	info.var.yres = display->height;
+	info.var.bits_per_pixel = 16;
+	info.fix.line_length = display->width * 2;
+	info.screen_base = calloc(1, vmem_len);
+	info.par = &par;
+	par.info = &info;
+	par.panel.width = display->width;
+	par.panel.height = display->height;
+	par.panel.line_length = info.fix.line_length;
+	par.txbuf.len = display->txbuflen;
+	par.txbuf.buf = calloc(1, par.txbuf.len);
+	par.gpio.aux[0] = GPIO_READY;
+	par.gpio.wr = 1;
+	par.gpio.dc = -1;
+	for (i = 0; i < 8; i++)
+		par.gpio.db[i] = 2 + i;
+	par.fbtftops.write_register = bench_write_register;
+
+	/* a pattern that differs per frame would only change the hash */
+	vmem = (u16 *)info.screen_base;
+	for (i = 0; i < vmem_len / 2; i++)
+		vmem[i] = (i * 2654435761u) >> 16;
+
+	/* bit image command and data */
+	ctrl.frame_len = 8 + display->width * display->height / 8;
+
+	return display->fbtftops.verify_gpios(&par);
+}
+
+struct run {
+	u32 hash;
+	size_t bytes;
+	unsigned long overruns;
+	unsigned long frames;
+	double wall_ns;
+	double cpu_ns;
+};
+
+static double clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* write frames for at least ms milliseconds, or just one */
+static void run(bool ref, unsigned fifo, unsigned spin_us, unsigned ms,
+			struct run *r)
+{
+	double wall, cpu;
+
+	bench_gu39xx_params(fifo, spin_us);
+	par.fbtftops.write = ref ? ref_write : bench_gu39xx_write;
+
+	pthread_mutex_lock(&ctrl.lock);
+	ctrl.fifo = ref ? 1 : max(fifo, 1U);
+	ctrl.level = 0;
+	ctrl.taken = 0;
+	ctrl.busy_until = 0;
+	ctrl.overruns = 0;
+	ctrl.hash = 2166136261u;
+	ctrl.bytes = 0;
+	ctrl_update_ready(ktime_get());
+	pthread_mutex_unlock(&ctrl.lock);
+
+	memset(r, 0, sizeof(*r));
+	wall = clock_ns(CLOCK_MONOTONIC);
+	cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+	do {
+		bench_gu39xx_write_vmem(&par, 0,
+					info.var.yres * info.fix.line_length);
+		r->frames++;
+		r->wall_ns = clock_ns(CLOCK_MONOTONIC) - wall;
+	} while (r->wall_ns < ms * 1e6);
+	r->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+	/* let the controller empty its buffer before the next run */
+	while (ctrl.level || ktime_get() < ctrl.busy_until)
+		usleep_range(100, 200);
+
+	pthread_mutex_lock(&ctrl.lock);
+	r->hash = ctrl.hash;
+	r->bytes = ctrl.bytes;
+	r->overruns = ctrl.overruns;
+	pthread_mutex_unlock(&ctrl.lock);
+}
+
+static const struct {
+	const char *name;
+	bool ref;
+	unsigned fifo;
+	unsigned spin_us;
+} cases[] = {
+	{ "poll+yield", true, 1, 0 },
+	{ "irq fifo=1", false, 1, 20 },
+	{ "irq fifo=1 nospin", false, 1, 0 },
+	{ "irq fifo=4", false, 4, 20 },
+	{ "irq fifo=8", false, 8, 20 },
+	{ "irq fifo=16", false, 16, 20 },
+};
+
+static int run_checks(void)
+{
+	struct run ref, r;
+	unsigned i;
+	int ret = 0;
+
+	run(true, 1, 0, 0, &ref);
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		if (cases[i].fifo > depth)
+			continue;
+		run(cases[i].ref, cases[i].fifo, cases[i].spin_us, 0, &r);
+		if (r.overruns || r.bytes != ref.bytes || r.hash != ref.hash) {
+			fprintf(stderr,
+				"%s: %zu bytes (expected %zu), hash %08x (expected %08x), %lu overruns\n",
+				cases[i].name, r.bytes, ref.bytes, r.hash,
+				ref.hash, r.overruns);
+			ret = 1;
+		}
+	}
+
+	printf("checks: %s\n", ret ? "FAILED" : "ok");
+
+	return ret;
+}
+
+static void run_bench(void)
+{
+	struct run r;
+	unsigned i;
+
+	printf("controller: %u ns/byte, %u byte buffer, %u us drawing\n",
+		byte_ns, depth, draw_us);
+	printf("%-18s %9s %9s %9s %6s\n", "handshake", "ms/frame", "KiB/s",
+		"cpu ms", "cpu %");
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		if (cases[i].fifo > depth)
+			continue;
+		run(cases[i].ref, cases[i].fifo, cases[i].spin_us, min_ms, &r);
+		printf("%-18s %9.3f %9.1f %9.3f %6.1f\n", cases[i].name,
+			r.wall_ns / r.frames / 1e6,
+			r.bytes / 1024.0 / (r.wall_ns / 1e9),
+			r.cpu_ns / r.frames / 1e6,
+			100.0 * r.cpu_ns / r.wall_ns);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	bool quick = false;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "qt:r:b:d:v")) != -1) {
+		switch (opt) {
+		case 'q':
+			quick = true;
+			break;
+		case 't':
+			min_ms = atoi(optarg);
+			break;
+		case 'r':
+			byte_ns = atoi(optarg);
+			break;
+		case 'b':
+			depth = atoi(optarg);
+			break;
+		case 'd':
+			draw_us = atoi(optarg);
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-q] [-t ms] [-r ns] [-b bytes] [-d us]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (!depth) {
+		fprintf(stderr, "the input buffer needs at least one byte\n");
+		return 2;
+	}
+
+	pthread_mutex_init(&ctrl.lock, NULL);
+	if (setup()) {
+		fprintf(stderr, "setup failed\n");
+		return 1;
+	}
+	pthread_create(&ctrl.thread, NULL, ctrl_thread, NULL);
+
+	ret = run_checks();
+	if (!ret && !quick)
+		run_bench();
+
+	ctrl.stop = true;
+	pthread_join(ctrl.thread, NULL);
+
+	return ret;
+}
@@ -0,0 +1,922 @@
+/*
+ * Userspace microbenchmark for the monochrome/grayscale converters
+ *
+ * Builds the write_vmem() of fb_ssd1322 (RGB565 to 4-bit gray),
+ * fb_gu39xx (column-major 1-bit threshold) and fb_pcd8544 (vertical byte
+ * packing) unchanged through the mono_*.c wrappers, checks their output
+ * against plain reference converters and stored golden hashes, then
+ * reports time, cycles and cache misses per frame. Partial updates are
+ * checked too: the bytes sent for a range of lines, and the address
+ * they go to, have to match the reference.
+ *
+ * The drivers' native 1 and 4 bpp video memory is run too: each frame is
+ * expanded to RGB565 (black and white, or one gray per level) for the
+ * reference converters, and timed next to the RGB565 frames.
+ *
+ * Build and run ('make -C Scripts/bench check' runs all the checks):
+ *
+ *   make -C Scripts/bench bench_mono
+ *   Scripts/bench/bench_mono [-q] [-c] [-t ms] [-i file[:WxH]]...
+ *   Scripts/bench/bench_mono -g  (golden hashes after a deliberate change)
+ *
+ *   -q           only run the output checks
+ *   -c           also measure with a cold cache (evicted before each frame)
+ *   -t ms        minimum time per measurement (default: 100)
+ *   -i file      add a screenshot as input, either binary PPM (P6) or raw
+ *                RGB565 as read from /dev/fb0, which needs :WxH appended.
+ *                It is scaled to each panel's resolution.
+ *
+ * Cycles and cache misses come from perf_event_open(2), and show up as '-'
+ * when the counters are not available (perf_event_paranoid, VMs).
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "fbtft.h"
+
+int shim_verbose;
+int shim_gpio_value[SHIM_NR_GPIOS];
+unsigned long shim_gpio_calls;
+struct shim_irq shim_irq[SHIM_NR_GPIOS];
+
+#define GPIO_DC		1
+
+void fbtft_dbg_hex(const struct device *dev, int groupsize,
+			void *buf, size_t len, const char *fmt, ...)
+{
+}
+
+int shim_spi_write(struct spi_device *spi, const void *buf, size_t len)
+{
+	return 0;
+}
+
+/* fb_gu39xx's write() goes through this, it isn't used here */
+int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len)
+{
+	return 0;
+}
+
+extern int bench_ssd1322_write_vmem(struct fbtft_par *par, size_t offset,
+								size_t len);
+extern int bench_gu39xx_write_vmem(struct fbtft_par *par, size_t offset,
+								size_t len);
+extern int bench_pcd8544_write_vmem(struct fbtft_par *par, size_t offset,
+								size_t len);
+extern const struct fbtft_display *bench_ssd1322_display;
+extern const struct fbtft_display *bench_gu39xx_display;
+extern const struct fbtft_display *bench_pcd8544_display;
+
+/* pixel data sink */
+static struct {
+	u8 buf[65536];
+	size_t len;
+	bool capture;
+} sink;
+
+/* the register writes since the last reset of .num */
+static struct {
+	struct {
+		int len;
+		unsigned val[16];
+	} regs[16];
+	unsigned num;
+} reglog;
+
+static int bench_write(struct fbtft_par *par, void *buf, size_t len)
+{
+	if (sink.capture && sink.len + len <= sizeof(sink.buf))
+		memcpy(sink.buf + sink.len, buf, len);
+	sink.len += len;
+	return 0;
+}
+
+static void bench_write_register(struct fbtft_par *par, int len, ...)
+{
+	va_list args;
+	int i;
+
+	if (reglog.num == ARRAY_SIZE(reglog.regs))
+		return;
+	va_start(args, len);
+	for (i = 0; i < len && i < 16; i++)
+		reglog.regs[reglog.num].val[i] = va_arg(args, unsigned int);
+	va_end(args);
+	reglog.regs[reglog.num++].len = len;
+}
+
+/* reference converters, one pixel at a time straight from the datasheets */
+static unsigned ref_luma(u16 rgb)
+{
+	unsigned r = rgb >> 11, g = (rgb >> 5) & 0x3F, b = rgb & 0x1F;
+
+	/* 16-bit Y, weights 2.392, 2.348, 0.912 in 8.8 fixed point */
+	return 613 * r + 601 * g + 233 * b;
+}
+
+/* SSD1322: 4-bit gray, two pixels per byte, left pixel in the high nibble */
+static size_t ref_ssd1322(const u16 *vmem, unsigned w, unsigned h, u8 *out)
+{
+	unsigned x, y;
+	u8 *p = out;
+
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x += 2)
+			*p++ = (ref_luma(vmem[y * w + x]) >> 12) << 4 |
+				ref_luma(vmem[y * w + x + 1]) >> 12;
+
+	return p - out;
+}
+
+/* GU-39xx bit image: column by column, 8 rows per byte, top row in bit 7 */
+static size_t ref_gu39xx(const u16 *vmem, unsigned w, unsigned h, u8 *out)
+{
+	unsigned x, y, i;
+	u8 *p = out;
+
+	for (x = 0; x < w; x++)
+		for (y = 0; y < h; y += 8, p++)
+			for (*p = 0, i = 0; i < 8; i++)
+				if (ref_luma(vmem[(y + i) * w + x]) >
+							(unsigned)(65536 * 0.4))
+					*p |= 0x80 >> i;
+
+	return p - out;
+}
+
+/* PCD8544 horizontal addressing: column by column per bank, top row in bit 0 */
+static size_t ref_pcd8544(const u16 *vmem, unsigned w, unsigned h, u8 *out)
+{
+	unsigned x, y, i;
+	u8 *p = out;
+
+	for (y = 0; y < h; y += 8)
+		for (x = 0; x < w; x++, p++)
+			for (*p = 0, i = 0; i < 8; i++)
+				if (vmem[(y + i) * w + x])
+					*p |= 1 << i;
+
+	return p - out;
+}
+
+/*
+ * Partial updates of lines ys..ye: the span of the reference output that
+ * is expected to be sent (given the output before and after the lines
+ * changed), and where the driver's register writes say it goes.
+ */
+static void span_ssd1322(const u8 *old, const u8 *new, unsigned w,
+		unsigned h, unsigned ys, unsigned ye, size_t *start, size_t *len)
+{
+	*start = ys * w / 2;
+	*len = (ye - ys + 1) * w / 2;
+}
+
+static bool addr_ssd1322(unsigned w, size_t *start)
+{
+	unsigned i;
+
+	for (i = 0; i < reglog.num; i++)
+		if (reglog.regs[i].len == 3 && reglog.regs[i].val[0] == 0x75) {
+			*start = reglog.regs[i].val[1] * w / 2;
+			return true;
+		}
+
+	return false;
+}
+
+/* only the changed bytes are sent, the unchanged ones around them aren't */
+static void span_gu39xx(const u8 *old, const u8 *new, unsigned w,
+		unsigned h, unsigned ys, unsigned ye, size_t *start, size_t *len)
+{
+	size_t n = w * h / 8, first = n, last = 0, i;
+
+	for (i = 0; i < n; i++) {
+		if (old[i] != new[i]) {
+			first = min(first, i);
+			last = i;
+		}
+	}
+	*start = first < n ? first : 0;
+	*len = first < n ? last - first + 1 : 0;
+}
+
+static bool addr_gu39xx(unsigned w, size_t *start)
+{
+	unsigned i;
+	unsigned *val;
+
+	for (i = 0; i < reglog.num; i++) {
+		val = reglog.regs[i].val;
+		if (reglog.regs[i].len == 8 && val[3] == 0x46) {
+			*start = val[4] | val[5] << 8;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void span_pcd8544(const u8 *old, const u8 *new, unsigned w,
+		unsigned h, unsigned ys, unsigned ye, size_t *start, size_t *len)
+{
+	*start = ys / 8 * w;
+	*len = (ye / 8 - ys / 8 + 1) * w;
+}
+
+static bool addr_pcd8544(unsigned w, size_t *start)
+{
+	int x = -1, bank = -1;
+	unsigned i, val;
+
+	for (i = 0; i < reglog.num; i++) {
+		val = reglog.regs[i].val[0];
+		if (reglog.regs[i].len != 1)
+			continue;
+		if (val & 0x80)
+			x = val & 0x7F;
+		else if (val & 0x40)
+			bank = val & 0x07;
+	}
+	if (x < 0 || bank < 0)
+		return false;
+	*start = bank * w + x;
+
+	return true;
+}
+
+/* patterns, 'golden' holds the FNV-1a hash of each converter's output */
+enum { PAT_BLACK, PAT_WHITE, PAT_RAMP, PAT_CHECKER, PAT_NOISE, PAT_TEXT,
+	NUM_PATTERNS };
+
+static const char * const pattern_names[NUM_PATTERNS] = {
+	"black", "white", "ramp", "checker", "noise", "text",
+};
+
+static const struct converter {
+	const char *name;
+	const struct fbtft_display **display;
+	int (*write_vmem)(struct fbtft_par *par, size_t offset, size_t len);
+	size_t (*ref)(const u16 *vmem, unsigned w, unsigned h, u8 *out);
+	void (*span)(const u8 *old, const u8 *new, unsigned w, unsigned h,
+			unsigned ys, unsigned ye, size_t *start, size_t *len);
+	bool (*addr)(unsigned w, size_t *start);
+	u32 golden[NUM_PATTERNS];
+} converters[] = {
+	{ "ssd1322", &bench_ssd1322_display, bench_ssd1322_write_vmem,
+	  ref_ssd1322, span_ssd1322, addr_ssd1322, {
+		0xbcc31dc5, 0xbcb23dc5, 0x40d9f18b, 0x12c6adc5, 0xf84be74a,
+		0x1959d4cb } },
+	{ "gu39xx", &bench_gu39xx_display, bench_gu39xx_write_vmem,
+	  ref_gu39xx, span_gu39xx, addr_gu39xx, {
+		0xd2063dc5, 0x208205c5, 0x36d74ce2, 0x9474b1c5, 0x17172593,
+		0x8f492f5f } },
+	{ "pcd8544", &bench_pcd8544_display, bench_pcd8544_write_vmem,
+	  ref_pcd8544, span_pcd8544, addr_pcd8544, {
+		0xe0798625, 0x68fb502d, 0x223811ce, 0x6dd8142d, 0x68fb502d,
+		0x68fb502d } },
+};
+
+static u32 fnv1a(const u8 *buf, size_t len)
+{
+	u32 hash = 0x811c9dc5;
+
+	while (len--)
+		hash = (hash ^ *buf++) * 0x01000193;
+
+	return hash;
+}
+
+static u16 rgb565(unsigned r, unsigned g, unsigned b)
+{
+	return (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+}
+
+static void fill_pattern(u16 *vmem, unsigned w, unsigned h, int pattern)
+{
+	unsigned x, y, seed = 1;
+
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			u16 *p = &vmem[y * w + x];
+
+			switch (pattern) {
+			case PAT_BLACK:
+				*p = 0x0000;
+				break;
+			case PAT_WHITE:
+				*p = 0xFFFF;
+				break;
+			case PAT_RAMP:
+				*p = rgb565(x * 255 / (w - 1), y * 255 / (h - 1),
+							(x + y) * 255 / (w + h - 2));
+				break;
+			case PAT_CHECKER:
+				*p = (x ^ y) & 1 ? 0xFFFF : 0x0000;
+				break;
+			case PAT_NOISE:
+				seed = seed * 1103515245 + 12345;
+				*p = seed >> 16;
+				break;
+			case PAT_TEXT:
+				/* 6x8 cells of sparse strokes on a dark blue background */
+				seed = seed * 1103515245 + 12345;
+				*p = (x % 6 < 5 && y % 8 < 7 && (seed >> 16) % 3 == 0) ?
+							0xE71C : 0x0008;
+				break;
+			}
+		}
+	}
+}
+
+/* screenshots given with -i, kept in their own resolution */
+struct image {
+	const char *path;
+	unsigned w, h;
+	u16 *pix;
+};
+
+static struct image images[8];
+static unsigned num_images;
+
+static int load_image(const char *arg)
+{
+	struct image *img = &images[num_images];
+	char *path = strdup(arg), *size = strrchr(path, ':');
+	unsigned maxval = 255, i;
+	u8 *rgb = NULL;
+	FILE *f;
+
+	if (num_images == ARRAY_SIZE(images)) {
+		fprintf(stderr, "%s: too many images\n", arg);
+		return -1;
+	}
+
+	if (size)
+		*size++ = '\0';
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	img->path = path;
+
+	if (fscanf(f, "P6 %u %u %u", &img->w, &img->h, &maxval) == 3) {
+		fgetc(f);
+		if (maxval > 255) {
+			fprintf(stderr, "%s: 16-bit PPM not supported\n", path);
+			goto err;
+		}
+		rgb = malloc(img->w * img->h * 3);
+		img->pix = malloc(img->w * img->h * 2);
+		if (fread(rgb, 3, img->w * img->h, f) != img->w * img->h)
+			goto short_read;
+		for (i = 0; i < img->w * img->h; i++)
+			img->pix[i] = rgb565(rgb[3 * i] * 255 / maxval,
+					rgb[3 * i + 1] * 255 / maxval,
+					rgb[3 * i + 2] * 255 / maxval);
+		free(rgb);
+	} else {
+		if (!size || sscanf(size, "%ux%u", &img->w, &img->h) != 2) {
+			fprintf(stderr, "%s: not a PPM, raw RGB565 needs :WxH\n",
+									path);
+			goto err;
+		}
+		rewind(f);
+		img->pix = malloc(img->w * img->h * 2);
+		if (fread(img->pix, 2, img->w * img->h, f) != img->w * img->h)
+			goto short_read;
+		for (i = 0; i < img->w * img->h; i++)
+			img->pix[i] = le16_to_cpu(img->pix[i]);
+	}
+
+	fclose(f);
+	num_images++;
+	return 0;
+
+short_read:
+	fprintf(stderr, "%s: file too short for %ux%u\n", path, img->w, img->h);
+err:
+	fclose(f);
+	return -1;
+}
+
+/* nearest neighbour scaling to the panel resolution */
+static void fill_image(u16 *vmem, unsigned w, unsigned h,
+						const struct image *img)
+{
+	unsigned x, y;
+
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			vmem[y * w + x] = img->pix[(y * img->h / h) * img->w +
+							x * img->w / w];
+}
+
+static struct fbtft_par par;
+static struct fb_info info;
+static struct device device;
+static const struct converter *conv;
+
+static void bench_reset(struct fbtft_par *par)
+{
+}
+
+static void setup(const struct converter *c, unsigned bpp)
+{
+	const struct fbtft_display *display = *c->display;
+	size_t line_length = DIV_ROUND_UP(display->width * bpp, 8);
+	static u8 *vmem;
+	static void *txbuf;
+
+	free(vmem);
+	free(txbuf);
+	vfree(par.extra);
+	kfree(par.conv);
+	memset(&par, 0, sizeof(par));
+	conv = c;
+
+	vmem = calloc(display->height, line_length);
+	txbuf = malloc(display->txbuflen);
+
+	info.var.xres = display->width;
+	info.var.yres = display->height;
+	info.var.bits_per_pixel = bpp;
+	info.fix.line_length = line_length;
+	info.fix.smem_len = display->height * line_length;
+	info.screen_base = (char *)vmem;
+	info.device = &device;
+	info.par = &par;
+
+	par.info = &info;
+	par.panel.width = display->width;
+	par.panel.height = display->height;
+	par.panel.line_length = line_length;
+	par.txbuf.buf = txbuf;
+	par.txbuf.len = display->txbuflen;
+	par.gpio.dc = GPIO_DC;
+	par.fbtftops.write = bench_write;
+	par.fbtftops.write_register = bench_write_register;
+
+	par.fbtftops.reset = bench_reset;
+
+	/* per device setup, the gpios are all there (0) */
+	if (display->fbtftops.verify_gpios)
+		display->fbtftops.verify_gpios(&par);
+	if (display->fbtftops.init_display)
+		display->fbtftops.init_display(&par);
+}
+
+static u16 *vmem(void)
+{
+	return (u16 *)info.screen_base;
+}
+
+static size_t frame_bytes(void)
+{
+	return info.var.yres * info.fix.line_length;
+}
+
+static void do_frame(void)
+{
+	sink.len = 0;
+	conv->write_vmem(&par, 0, frame_bytes());
+}
+
+/*
+ * Native video memory: 1 bpp is set above 40% luma, 4 bpp has the top 4
+ * bits of luma. The pixel order is the one of the fbdev drawing functions,
+ * first pixel in the low bits on little endian.
+ */
+#ifdef __LITTLE_ENDIAN
+#define NATIVE_SHIFT(x, bpp)	((x) * (bpp) % 8)
+#else
+#define NATIVE_SHIFT(x, bpp)	(8 - (bpp) - (x) * (bpp) % 8)
+#endif
+
+static void pack_native(const u16 *rgb, unsigned w, unsigned h,
+					unsigned bpp, size_t line, u8 *dst)
+{
+	unsigned x, y, val;
+	u8 *p;
+
+	memset(dst, 0, h * line);
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			val = ref_luma(rgb[y * w + x]);
+			val = bpp == 1 ? val > (unsigned)(65536 * 0.4) :
+								val >> 12;
+			p = dst + y * line + x * bpp / 8;
+			*p |= val << NATIVE_SHIFT(x, bpp);
+		}
+	}
+}
+
+/* the RGB565 of each gray level, 1 bpp uses black and white */
+static u16 gray565[16];
+
+static void init_gray565(void)
+{
+	unsigned rgb;
+
+	for (rgb = 0xFFFF; rgb != -1U; rgb--)
+		gray565[ref_luma(rgb) >> 12] = rgb;
+	gray565[0] = 0x0000;
+	gray565[15] = 0xFFFF;
+}
+
+static void expand_native(const u8 *src, unsigned w, unsigned h,
+					unsigned bpp, size_t line, u16 *rgb)
+{
+	unsigned x, y, val;
+
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			val = src[y * line + x * bpp / 8] >>
+				NATIVE_SHIFT(x, bpp) & ((1 << bpp) - 1);
+			rgb[y * w + x] = bpp == 1 ? (val ? 0xFFFF : 0x0000) :
+								gray565[val];
+		}
+	}
+}
+
+static u8 *vmem8(void)
+{
+	return (u8 *)info.screen_base;
+}
+
+static bool native(void)
+{
+	return info.var.bits_per_pixel < 16;
+}
+
+/* fills vmem, native or not, with a pattern */
+static void fill_frame(int pattern)
+{
+	static u16 rgb[65536];
+	unsigned w = info.var.xres, h = info.var.yres;
+
+	if (!native()) {
+		fill_pattern(vmem(), w, h, pattern);
+		return;
+	}
+	fill_pattern(rgb, w, h, pattern);
+	pack_native(rgb, w, h, info.var.bits_per_pixel, info.fix.line_length,
+								vmem8());
+}
+
+/* the reference output of vmem, native or not */
+static size_t ref_frame(u8 *out)
+{
+	static u16 rgb[65536];
+	unsigned w = info.var.xres, h = info.var.yres;
+
+	if (!native())
+		return conv->ref(vmem(), w, h, out);
+	expand_native(vmem8(), w, h, info.var.bits_per_pixel,
+						info.fix.line_length, rgb);
+	return conv->ref(rgb, w, h, out);
+}
+
+/* converts the current vmem and compares with the reference converter */
+static int check_frame(const char *input, u32 *hash)
+{
+	static u8 ref[65536];
+	size_t len;
+
+	len = ref_frame(ref);
+	sink.capture = true;
+	do_frame();
+	sink.capture = false;
+
+	*hash = fnv1a(sink.buf, sink.len);
+	if (sink.len == len && !memcmp(sink.buf, ref, len))
+		return 0;
+
+	fprintf(stderr, "FAIL %-8s %-10s %ubpp: %zu bytes, expected %zu\n",
+			conv->name, input, info.var.bits_per_pixel, sink.len,
+			len);
+	return 1;
+}
+
+/*
+ * Updates lines ys..ye after a full frame, as the core does: set the
+ * window, then write_vmem() from the first line
+ */
+static int check_window(unsigned ys, unsigned ye)
+{
+	const struct fbtft_display *display = *conv->display;
+	unsigned w = info.var.xres, h = info.var.yres;
+	size_t line = info.fix.line_length, start, len, addr;
+	static u8 old[65536], new[65536], lines[131072];
+
+	fill_frame(PAT_NOISE);
+	memcpy(lines, vmem8(), h * line);
+	fill_frame(PAT_TEXT);
+	ref_frame(old);
+	do_frame();
+
+	memcpy(vmem8() + ys * line, lines + ys * line, (ye - ys + 1) * line);
+	ref_frame(new);
+	conv->span(old, new, w, h, ys, ye, &start, &len);
+
+	reglog.num = 0;
+	sink.len = 0;
+	sink.capture = true;
+	if (display->fbtftops.set_addr_win)
+		display->fbtftops.set_addr_win(&par, 0, ys, w - 1, ye);
+	conv->write_vmem(&par, ys * line, (ye - ys + 1) * line);
+	sink.capture = false;
+
+	if (sink.len != len || memcmp(sink.buf, new + start, len)) {
+		fprintf(stderr, "FAIL %-8s lines %u-%u %ubpp: %zu bytes, expected %zu at %zu\n",
+			conv->name, ys, ye, info.var.bits_per_pixel, sink.len,
+			len, start);
+		return 1;
+	}
+	if (len && (!conv->addr(w, &addr) || addr != start)) {
+		fprintf(stderr, "FAIL %-8s lines %u-%u %ubpp: sent to the wrong address, expected %zu\n",
+			conv->name, ys, ye, info.var.bits_per_pixel, start);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int check_windows(void)
+{
+	return check_window(0, 0) + check_window(5, 12) +
+		check_window(17, 17) +
+		check_window(info.var.yres - 3, info.var.yres - 1);
+}
+
+static int run_checks(bool print_golden)
+{
+	const struct converter *c;
+	unsigned i;
+	int p, fails = 0;
+	u32 hash;
+
+	for (c = converters; c < converters + ARRAY_SIZE(converters); c++) {
+		setup(c, 16);
+		if (print_golden)
+			printf("\t%s golden:", c->name);
+		for (p = 0; p < NUM_PATTERNS; p++) {
+			fill_pattern(vmem(), info.var.xres, info.var.yres, p);
+			fails += check_frame(pattern_names[p], &hash);
+			if (print_golden) {
+				printf(" 0x%08x,", hash);
+			} else if (hash != c->golden[p]) {
+				fprintf(stderr, "FAIL %-8s %-10s hash 0x%08x, "
+					"golden 0x%08x\n", c->name,
+					pattern_names[p], hash, c->golden[p]);
+				fails++;
+			}
+		}
+		if (print_golden)
+			printf("\n");
+		for (i = 0; i < num_images; i++) {
+			fill_image(vmem(), info.var.xres, info.var.yres,
+								&images[i]);
+			fails += check_frame(images[i].path, &hash);
+		}
+		fails += check_windows();
+
+		setup(c, (*c->display)->bpp);
+		for (p = 0; p < NUM_PATTERNS; p++) {
+			fill_frame(p);
+			fails += check_frame(pattern_names[p], &hash);
+		}
+		fails += check_windows();
+	}
+	printf("checks: %s\n", fails ? "FAILED" : "ok");
+
+	return fails;
+}
+
+/* hardware counters, fd < 0 when not available */
+enum { CNT_CYCLES, CNT_INSNS, CNT_CACHE_MISSES, CNT_L1D_MISSES, NUM_COUNTERS };
+
+static const struct {
+	u32 type;
+	u64 config;
+} counter_events[NUM_COUNTERS] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+			      PERF_COUNT_HW_CACHE_OP_READ << 8 |
+			      PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+};
+
+static int counter_fd[NUM_COUNTERS] = { -1, -1, -1, -1 };
+
+static void counters_open(void)
+{
+	struct perf_event_attr attr;
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = counter_events[i].type;
+		attr.config = counter_events[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		counter_fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1,
+									-1, 0);
+	}
+}
+
+static void counters_enable(bool enable)
+{
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++)
+		if (counter_fd[i] >= 0)
+			ioctl(counter_fd[i], enable ? PERF_EVENT_IOC_ENABLE :
+						PERF_EVENT_IOC_DISABLE, 0);
+}
+
+static void counters_reset(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++)
+		if (counter_fd[i] >= 0)
+			ioctl(counter_fd[i], PERF_EVENT_IOC_RESET, 0);
+}
+
+static bool counter_read(int i, u64 *val)
+{
+	return counter_fd[i] >= 0 &&
+		read(counter_fd[i], val, sizeof(*val)) == sizeof(*val);
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* larger than any last level cache we are likely to run on */
+#define EVICT_SIZE	(64 << 20)
+
+static u8 *evict_buf;
+
+static void evict_cache(void)
+{
+	size_t i;
+
+	for (i = 0; i < EVICT_SIZE; i += 64)
+		evict_buf[i]++;
+}
+
+static unsigned min_ms = 100;
+
+/*
+ * Runs frames until min_ms has been spent converting, counting only the
+ * conversions. Evicting takes far longer than a frame, so cold runs also
+ * stop after 10 * min_ms of wall time.
+ */
+static void measure(bool cold, double *ns, double counts[NUM_COUNTERS])
+{
+	unsigned long frames = 0;
+	double start, elapsed = 0, deadline = now_ns() + 10 * min_ms * 1e6;
+	u64 val;
+	int i;
+
+	do_frame(); /* warm up */
+	counters_reset();
+	do {
+		if (cold)
+			evict_cache();
+		counters_enable(true);
+		start = now_ns();
+		do_frame();
+		elapsed += now_ns() - start;
+		counters_enable(false);
+		frames++;
+	} while (elapsed < min_ms * 1e6 && (frames < 3 || now_ns() < deadline));
+
+	*ns = elapsed / frames;
+	for (i = 0; i < NUM_COUNTERS; i++)
+		counts[i] = counter_read(i, &val) ? (double)val / frames : -1;
+}
+
+static void print_count(const char *fmt, double val, double div)
+{
+	if (val < 0)
+		printf(" %9s", "-");
+	else
+		printf(fmt, val / div);
+}
+
+static void report(const char *input, bool cold)
+{
+	double counts[NUM_COUNTERS], ns;
+	size_t pixels = info.var.xres * info.var.yres;
+
+	measure(cold, &ns, counts);
+	printf("%-8s %-12.12s %4s %9.1f %9.2f", conv->name, input,
+				cold ? "cold" : "hot", ns / 1e3, ns / pixels);
+	print_count(" %9.0f", counts[CNT_CYCLES], 1);
+	print_count(" %9.2f", counts[CNT_CYCLES], pixels);
+	print_count(" %9.2f", counts[CNT_INSNS], counts[CNT_CYCLES]);
+	print_count(" %9.1f", counts[CNT_CACHE_MISSES], 1);
+	print_count(" %9.1f", counts[CNT_L1D_MISSES], 1);
+	printf("\n");
+}
+
+static void run_bench(bool cold)
+{
+	const struct converter *c;
+	char name[32];
+	unsigned i;
+	int p;
+
+	counters_open();
+	if (cold)
+		evict_buf = calloc(1, EVICT_SIZE);
+
+	printf("%-8s %-12s %4s %9s %9s %9s %9s %9s %9s %9s\n", "driver",
+		"input", "llc", "us/frame", "ns/pixel", "cyc/frame", "cyc/pixel",
+		"IPC", "LLC-miss", "L1D-miss");
+
+	for (c = converters; c < converters + ARRAY_SIZE(converters); c++) {
+		setup(c, 16);
+		for (p = 0; p < NUM_PATTERNS; p++) {
+			fill_pattern(vmem(), info.var.xres, info.var.yres, p);
+			report(pattern_names[p], false);
+			if (cold)
+				report(pattern_names[p], true);
+		}
+		for (i = 0; i < num_images; i++) {
+			fill_image(vmem(), info.var.xres, info.var.yres,
+								&images[i]);
+			report(images[i].path, false);
+			if (cold)
+				report(images[i].path, true);
+		}
+
+		setup(c, (*c->display)->bpp);
+		for (p = 0; p < NUM_PATTERNS; p++) {
+			fill_frame(p);
+			snprintf(name, sizeof(name), "%s %ubpp",
+				pattern_names[p], info.var.bits_per_pixel);
+			report(name, false);
+			if (cold)
+				report(name, true);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	bool quick = false, cold = false, golden = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "cgi:qt:v")) != -1) {
+		switch (opt) {
+		case 'c':
+			cold = true;
+			break;
+		case 'g':
+			/* print the golden table after a deliberate change */
+			golden = true;
+			break;
+		case 'i':
+			if (load_image(optarg))
+				return 2;
+			break;
+		case 'q':
+			quick = true;
+			break;
+		case 't':
+			min_ms = atoi(optarg);
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c] [-g] [-q] [-t ms] [-v] "
+				"[-i file[:WxH]]...\n", argv[0]);
+			return 2;
+		}
+	}
+
+	init_gray565();
+	if (run_checks(golden))
+		return 1;
+	if (!quick && !golden)
+		run_bench(cold);
+
+	return 0;
+}
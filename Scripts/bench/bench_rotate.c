@@ -0,0 +1,406 @@
+/*
+ * Userspace microbenchmark for the software rotation in fbtft-rotate.c
+ *
+ * Checks fbtft_rotate() against a reference that fetches each panel pixel
+ * from the frame pixel it shows, for 1, 4, 8, 16 and 32 bpp, each
+ * rotation and panel sizes that don't fill the 8x8 tiles. Partial
+ * updates are checked too: after a band of lines changes and only that
+ * band is rotated, the whole panel frame has to match the reference, and
+ * 180 degree updates have to report the panel lines of the band.
+ *
+ * The timing compares the tiled rotation of a full frame to turning it a
+ * pixel at a time in the order the lines are read. Give it a large frame
+ * (-w 1024 -h 768) to see the panel lines miss the cache.
+ *
+ * Build and run ('make -C Scripts/bench check' runs all the checks):
+ *
+ *   make -C Scripts/bench bench_rotate
+ *   Scripts/bench/bench_rotate [-q] [-t ms] [-w width] [-h height]
+ *
+ *   -q         only run the output checks
+ *   -t ms      minimum time per measurement (default: 100)
+ *   -w, -h     panel size for the timing (default: 320x240)
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+#include <unistd.h>
+
+#include "fbtft.h"
+
+int shim_verbose;
+int shim_gpio_value[SHIM_NR_GPIOS];
+unsigned long shim_gpio_calls;
+
+void fbtft_dbg_hex(const struct device *dev, int groupsize,
+			void *buf, size_t len, const char *fmt, ...)
+{
+}
+
+int shim_spi_write(struct spi_device *spi, const void *buf, size_t len)
+{
+	return 0;
+}
+
+static struct fbtft_par par;
+static struct fb_info info;
+static struct device device;
+static u8 *ref;
+
+/* pixel @x of a line, in the order the fbdev drawing functions use */
+static unsigned get_px(const u8 *line, unsigned x, unsigned bpp)
+{
+	unsigned bit = x * bpp, i, val = 0;
+
+	if (bpp >= 8) {
+		for (i = 0; i < bpp / 8; i++)
+			val |= (unsigned)line[x * bpp / 8 + i] << (8 * i);
+		return val;
+	}
+#ifdef __LITTLE_ENDIAN
+	return line[bit / 8] >> (bit % 8) & ((1 << bpp) - 1);
+#else
+	return line[bit / 8] >> (8 - bpp - bit % 8) & ((1 << bpp) - 1);
+#endif
+}
+
+static void put_px(u8 *line, unsigned x, unsigned bpp, unsigned val)
+{
+	unsigned bit = x * bpp, shift, i;
+
+	if (bpp >= 8) {
+		for (i = 0; i < bpp / 8; i++)
+			line[x * bpp / 8 + i] = val >> (8 * i);
+		return;
+	}
+#ifdef __LITTLE_ENDIAN
+	shift = bit % 8;
+#else
+	shift = 8 - bpp - bit % 8;
+#endif
+	line[bit / 8] &= ~(((1 << bpp) - 1) << shift);
+	line[bit / 8] |= val << shift;
+}
+
+/* the whole panel frame, each pixel fetched from the one it shows */
+static void ref_rotate(u8 *dst)
+{
+	unsigned pw = par.panel.width, ph = par.panel.height;
+	unsigned bpp = info.var.bits_per_pixel;
+	const u8 *src = (u8 *)info.screen_base;
+	unsigned px, py, x, y;
+
+	memset(dst, 0, ph * par.panel.line_length);
+	for (py = 0; py < ph; py++) {
+		for (px = 0; px < pw; px++) {
+			switch (info.var.rotate) {
+			case 90:
+				x = py;
+				y = pw - 1 - px;
+				break;
+			case 180:
+				x = pw - 1 - px;
+				y = ph - 1 - py;
+				break;
+			default:
+				x = ph - 1 - py;
+				y = px;
+				break;
+			}
+			put_px(dst + py * par.panel.line_length, px, bpp,
+				get_px(src + y * info.fix.line_length, x, bpp));
+		}
+	}
+}
+
+/* a pixel at a time, in the order the frame is read */
+static inline void naive_bytes(u8 *dst, ptrdiff_t dx, ptrdiff_t dy,
+							unsigned cpp)
+{
+	const u8 *src = (u8 *)info.screen_base;
+	unsigned x, y;
+	u8 *d;
+
+	for (y = 0; y < info.var.yres; y++, dst += dy) {
+		const u8 *s = src + y * info.fix.line_length;
+
+		for (x = 0, d = dst; x < info.var.xres; x++, s += cpp, d += dx)
+			memcpy(d, s, cpp);
+	}
+}
+
+static void naive_rotate(u8 *dst)
+{
+	unsigned pw = par.panel.width, ph = par.panel.height;
+	unsigned bpp = info.var.bits_per_pixel, cpp = bpp / 8;
+	ptrdiff_t dpitch = par.panel.line_length, dx, dy;
+	const u8 *src = (u8 *)info.screen_base;
+	unsigned x, y, px, py;
+
+	if (!cpp) {
+		for (y = 0; y < info.var.yres; y++) {
+			for (x = 0; x < info.var.xres; x++) {
+				switch (info.var.rotate) {
+				case 90:
+					px = pw - 1 - y;
+					py = x;
+					break;
+				case 180:
+					px = pw - 1 - x;
+					py = ph - 1 - y;
+					break;
+				default:
+					px = y;
+					py = ph - 1 - x;
+					break;
+				}
+				put_px(dst + py * dpitch, px, bpp,
+					get_px(src + y * info.fix.line_length,
+								x, bpp));
+			}
+		}
+		return;
+	}
+
+	/* panel offset of frame pixel 0,0 and the steps for x and y */
+	switch (info.var.rotate) {
+	case 90:
+		dst += (pw - 1) * cpp;
+		dx = dpitch;
+		dy = -(ptrdiff_t)cpp;
+		break;
+	case 180:
+		dst += (ph - 1) * dpitch + (pw - 1) * cpp;
+		dx = -(ptrdiff_t)cpp;
+		dy = -dpitch;
+		break;
+	default:
+		dst += (ph - 1) * dpitch;
+		dx = -dpitch;
+		dy = cpp;
+		break;
+	}
+
+	switch (cpp) {
+	case 1:
+		naive_bytes(dst, dx, dy, 1);
+		break;
+	case 2:
+		naive_bytes(dst, dx, dy, 2);
+		break;
+	default:
+		naive_bytes(dst, dx, dy, 4);
+		break;
+	}
+}
+
+static u32 seed = 1;
+
+static void fill_lines(unsigned ys, unsigned ye)
+{
+	u8 *p = (u8 *)info.screen_base + ys * info.fix.line_length;
+	size_t i;
+
+	for (i = 0; i < (ye - ys + 1) * info.fix.line_length; i++) {
+		seed = seed * 1103515245 + 12345;
+		p[i] = seed >> 16;
+	}
+}
+
+/* a display of @pw x @ph pixels as the controller is addressed */
+static int setup(unsigned pw, unsigned ph, unsigned bpp, unsigned rotate)
+{
+	unsigned w = rotate == 90 || rotate == 270 ? ph : pw;
+	unsigned h = rotate == 90 || rotate == 270 ? pw : ph;
+	size_t line_length = DIV_ROUND_UP(w * bpp, 8);
+
+	free(info.screen_base);
+	free(par.panel.buf);
+	free(ref);
+	memset(&par, 0, sizeof(par));
+
+	info.device = &device;
+	info.par = &par;
+	info.var.xres = w;
+	info.var.yres = h;
+	info.var.yres_virtual = h;
+	info.var.bits_per_pixel = bpp;
+	info.var.rotate = rotate;
+	info.fix.line_length = line_length;
+	info.fix.smem_len = line_length * h;
+	info.screen_base = calloc(1, info.fix.smem_len);
+
+	par.info = &info;
+	par.panel.width = w;
+	par.panel.height = h;
+	par.panel.line_length = line_length;
+	if (fbtft_rotate_init(&par))
+		return -ENOMEM;
+	ref = calloc(par.panel.height, par.panel.line_length);
+
+	return 0;
+}
+
+static int check(const char *what, unsigned ys, unsigned ye)
+{
+	size_t len = par.panel.height * par.panel.line_length, i;
+
+	ref_rotate(ref);
+	for (i = 0; i < len; i++) {
+		if (ref[i] != par.panel.buf[i]) {
+			fprintf(stderr,
+				"%s: %ux%u %u bpp %u degrees, lines %u-%u: byte %zu is 0x%02x, expected 0x%02x\n",
+				what, info.var.xres, info.var.yres,
+				info.var.bits_per_pixel, info.var.rotate, ys,
+				ye, i, par.panel.buf[i], ref[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static const unsigned depths[] = { 1, 4, 8, 16, 32 };
+static const unsigned rotations[] = { 90, 180, 270 };
+
+static int run_checks(void)
+{
+	static const struct { unsigned w, h; } sizes[] = {
+		{ 84, 48 }, { 256, 64 }, { 128, 160 }, { 101, 37 }, { 8, 8 },
+		{ 3, 13 },
+	};
+	unsigned s, d, r, ys, ye, ps, pe, i;
+	int ret = 0;
+
+	for (s = 0; s < ARRAY_SIZE(sizes); s++)
+	for (d = 0; d < ARRAY_SIZE(depths); d++)
+	for (r = 0; r < ARRAY_SIZE(rotations); r++) {
+		if (setup(sizes[s].w, sizes[s].h, depths[d], rotations[r]))
+			return 1;
+
+		fill_lines(0, info.var.yres - 1);
+		fbtft_rotate(&par, 0, info.var.yres - 1, &ps, &pe);
+		ret |= check("full", 0, info.var.yres - 1);
+		if (ps || pe != par.panel.height - 1) {
+			fprintf(stderr, "full: panel lines %u-%u\n", ps, pe);
+			ret = 1;
+		}
+
+		/* bands of every alignment, then single lines */
+		for (i = 0; i < 24 && !ret; i++) {
+			ys = (i * 7) % info.var.yres;
+			ye = min(ys + i % 11, info.var.yres - 1);
+			if (i >= 16)
+				ye = ys;
+			fill_lines(ys, ye);
+			fbtft_rotate(&par, ys, ye, &ps, &pe);
+			ret |= check("band", ys, ye);
+			if (info.var.rotate == 180 &&
+			    (ps != info.var.yres - 1 - ye ||
+			     pe != info.var.yres - 1 - ys)) {
+				fprintf(stderr, "band %u-%u: panel lines %u-%u\n",
+					ys, ye, ps, pe);
+				ret = 1;
+			}
+		}
+	}
+
+	printf("checks: %s\n", ret ? "FAILED" : "ok");
+
+	return ret;
+}
+
+static unsigned width = 320;
+static unsigned height = 240;
+static unsigned min_ms = 100;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ns per pixel */
+static double measure(bool naive)
+{
+	unsigned long runs = 0;
+	double start, elapsed;
+	unsigned ps, pe;
+
+	start = now_ns();
+	do {
+		if (naive)
+			naive_rotate(ref);
+		else
+			fbtft_rotate(&par, 0, info.var.yres - 1, &ps, &pe);
+		runs++;
+		elapsed = now_ns() - start;
+	} while (elapsed < min_ms * 1e6);
+
+	return elapsed / runs / (width * height);
+}
+
+static void run_bench(void)
+{
+	double naive, tiled;
+	unsigned d, r;
+
+	printf("%ux%u panel\n", width, height);
+	printf("%4s %7s %12s %12s %8s\n", "bpp", "rotate", "naive ns/px",
+		"tiled ns/px", "speedup");
+	for (d = 0; d < ARRAY_SIZE(depths); d++) {
+		for (r = 0; r < ARRAY_SIZE(rotations); r++) {
+			if (setup(width, height, depths[d], rotations[r]))
+				return;
+			fill_lines(0, info.var.yres - 1);
+			naive = measure(true);
+			tiled = measure(false);
+			printf("%4u %7u %12.3f %12.3f %7.2fx\n", depths[d],
+				rotations[r], naive, tiled, naive / tiled);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	bool quick = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "qt:w:h:v")) != -1) {
+		switch (opt) {
+		case 'q':
+			quick = true;
+			break;
+		case 't':
+			min_ms = atoi(optarg);
+			break;
+		case 'w':
+			width = atoi(optarg);
+			break;
+		case 'h':
+			height = atoi(optarg);
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-q] [-t ms] [-w width] [-h height]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (!width || !height) {
+		fprintf(stderr, "width and height can't be 0\n");
+		return 2;
+	}
+
+	if (run_checks())
+		return 1;
+	if (!quick)
+		run_bench();
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+/*
+ * fb_gu39xx.c built as a library for bench_mono.c and bench_gu39xx.c
+ */
+
+#include "fbtft.h"
+
+#undef FBTFT_REGISTER_DRIVER
+#define FBTFT_REGISTER_DRIVER(_name, _display)
+
+#include "fb_gu39xx.c"
+
+int bench_gu39xx_write_vmem(struct fbtft_par *par, size_t offset, size_t len)
+{
+	return write_vmem(par, offset, len);
+}
+
+const struct fbtft_display *bench_gu39xx_display = &display;
+
+int bench_gu39xx_write(struct fbtft_par *par, void *buf, size_t len)
+{
+	return write(par, buf, len);
+}
+
+void bench_gu39xx_params(unsigned fifo_bytes, unsigned spin_us)
+{
+	fifo = fifo_bytes;
+	ready_spin = spin_us;
+}
@@ -0,0 +1,17 @@
+/*
+ * fb_ssd1322.c built as a library for bench_mono.c, see there
+ */
+
+#include "fbtft.h"
+
+#undef FBTFT_REGISTER_DRIVER
+#define FBTFT_REGISTER_DRIVER(_name, _display)
+
+#include "fb_ssd1322.c"
+
+int bench_ssd1322_write_vmem(struct fbtft_par *par, size_t offset, size_t len)
+{
+	return write_vmem(par, offset, len);
+}
+
+const struct fbtft_display *bench_ssd1322_display = &display;
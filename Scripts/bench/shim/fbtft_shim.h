@@ -0,0 +1,512 @@
+/*
+ * Minimal userspace stand-ins for the kernel APIs used by the FBTFT
+ * core sources, so the pixel/bus kernels can be compiled into the
+ * benchmarks in Scripts/bench unchanged.
+ *
+ * Only what the compiled sources actually touch is provided. Every
+ * linux/... header in this directory just includes this file.
+ */
+
+#ifndef __FBTFT_SHIM_H
+#define __FBTFT_SHIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <endian.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/types.h>	/* the uapi __u32 and friends, from the system */
+
+/* glibc defines both, the kernel only the one that applies */
+#undef __LITTLE_ENDIAN
+#undef __BIG_ENDIAN
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define __LITTLE_ENDIAN 1234
+#else
+#define __BIG_ENDIAN 4321
+#endif
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef u16 __be16;
+typedef u16 __le16;
+
+#define __iomem
+#define __user
+#define __force
+#define __init
+#define __exit
+
+/* the 4.x kernels the tree builds for, -DLINUX_VERSION_CODE=0x050000 for 5.0 */
+#define KERNEL_VERSION(a, b, c)	(((a) << 16) + ((b) << 8) + (c))
+#ifndef LINUX_VERSION_CODE
+#define LINUX_VERSION_CODE	KERNEL_VERSION(4, 9, 0)
+#endif
+
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define EXPORT_SYMBOL(sym)
+#define EXPORT_SYMBOL_GPL(sym)
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)	min((t)(a), (t)(b))
+#define max_t(t, a, b)	max((t)(a), (t)(b))
+
+#define PAGE_SIZE	4096UL
+
+/* module boilerplate */
+#define THIS_MODULE	NULL
+#define module_param(name, type, perm)
+#define module_param_array(name, type, nump, perm)
+#define MODULE_PARM_DESC(name, desc)
+#define MODULE_ALIAS(alias)
+#define MODULE_DESCRIPTION(desc)
+#define MODULE_AUTHOR(author)
+#define MODULE_LICENSE(license)
+#define module_init(fn)
+#define module_exit(fn)
+
+#define udelay(us)	do { } while (0)
+#define mdelay(ms)	do { } while (0)
+#define yield()		sched_yield()
+#define cpu_relax()	__asm__ __volatile__("" : : : "memory")
+
+static inline void usleep_range(unsigned long min, unsigned long max)
+{
+	struct timespec ts = { 0, min * 1000 };
+
+	nanosleep(&ts, NULL);
+}
+
+/* time: jiffies are milliseconds */
+#define HZ		1000
+#define NSEC_PER_USEC	1000L
+#define jiffies		shim_jiffies()
+#define time_after(a, b)	((long)((b) - (a)) < 0)
+#define msecs_to_jiffies(ms)	((unsigned long)(ms))
+
+typedef s64 ktime_t;
+
+static inline ktime_t ktime_get(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define ktime_to_ns(kt)	((s64)(kt))
+
+static inline unsigned long shim_jiffies(void)
+{
+	return ktime_get() / 1000000;
+}
+
+#define cpu_to_be16(x)	htobe16(x)
+#define cpu_to_be32(x)	htobe32(x)
+#define cpu_to_be64(x)	htobe64(x)
+#define cpu_to_le16(x)	htole16(x)
+#define be16_to_cpu(x)	be16toh(x)
+#define le16_to_cpu(x)	le16toh(x)
+
+static inline u8 bitrev8(u8 x)
+{
+	x = (x & 0xF0) >> 4 | (x & 0x0F) << 4;
+	x = (x & 0xCC) >> 2 | (x & 0x33) << 2;
+	return (x & 0xAA) >> 1 | (x & 0x55) << 1;
+}
+
+/* device model */
+struct device_driver {
+	const char *name;
+};
+
+struct device {
+	void *platform_data;
+	struct device_driver *driver;
+};
+
+extern int shim_verbose;
+
+#define dev_err(dev, fmt, ...)	fprintf(stderr, "error: " fmt, ##__VA_ARGS__)
+#define dev_warn(dev, fmt, ...)	fprintf(stderr, "warning: " fmt, ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...) \
+	do { if (shim_verbose) fprintf(stderr, fmt, ##__VA_ARGS__); } while (0)
+#define dev_dbg(dev, fmt, ...)	do { } while (0)
+#define pr_err(fmt, ...)	fprintf(stderr, fmt, ##__VA_ARGS__)
+
+/* locking, never contended in the benchmarks */
+typedef int spinlock_t;
+struct mutex {
+	int unused;
+};
+
+/* nothing sleeps in the benchmarks */
+typedef struct {
+	int unused;
+} wait_queue_head_t;
+
+/* except on completions, which other threads of a benchmark complete */
+struct completion {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned done;
+};
+
+static inline void init_completion(struct completion *x)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&x->lock, NULL);
+	pthread_cond_init(&x->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	x->done = 0;
+}
+
+static inline void reinit_completion(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	x->done = 0;
+	pthread_mutex_unlock(&x->lock);
+}
+
+static inline void complete(struct completion *x)
+{
+	pthread_mutex_lock(&x->lock);
+	x->done++;
+	pthread_cond_signal(&x->cond);
+	pthread_mutex_unlock(&x->lock);
+}
+
+/* returns 1 when completed, there's no point in counting jiffies left */
+static inline unsigned long wait_for_completion_timeout(struct completion *x,
+						unsigned long timeout)
+{
+	ktime_t t = ktime_get() + timeout * 1000000LL;
+	struct timespec ts = { t / 1000000000LL, t % 1000000000LL };
+	unsigned long ret = 0;
+
+	pthread_mutex_lock(&x->lock);
+	while (!x->done)
+		if (pthread_cond_timedwait(&x->cond, &x->lock, &ts))
+			break;
+	if (x->done) {
+		x->done--;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&x->lock);
+
+	return ret;
+}
+
+/* memory */
+#define GFP_KERNEL	0
+#define kzalloc(size, flags)	calloc(1, size)
+#define kfree(ptr)	free(ptr)
+#define vzalloc(size)	calloc(1, size)
+#define vfree(ptr)	free(ptr)
+
+/* gpio: counted, values kept per gpio number */
+#define SHIM_NR_GPIOS	64
+extern int shim_gpio_value[SHIM_NR_GPIOS];
+extern unsigned long shim_gpio_calls;
+/* called after each gpio call, if a bench defines it */
+extern void shim_gpio_changed(void) __attribute__((weak));
+
+static inline void gpio_set_value(unsigned gpio, int value)
+{
+	shim_gpio_calls++;
+	if (gpio < SHIM_NR_GPIOS)
+		shim_gpio_value[gpio] = !!value;
+	if (shim_gpio_changed)
+		shim_gpio_changed();
+}
+
+static inline int gpio_get_value(unsigned gpio)
+{
+	return gpio < SHIM_NR_GPIOS ? shim_gpio_value[gpio] : 0;
+}
+
+/* gpio descriptors are the gpio numbers in disguise, 0 is NULL */
+struct gpio_desc;
+struct gpio_array;
+
+static inline struct gpio_desc *gpio_to_desc(unsigned gpio)
+{
+	return (struct gpio_desc *)(uintptr_t)(gpio + 1);
+}
+
+static inline unsigned desc_to_gpio(const struct gpio_desc *desc)
+{
+	return (uintptr_t)desc - 1;
+}
+
+static inline void gpiod_set_raw_value_cansleep(struct gpio_desc *desc,
+						int value)
+{
+	gpio_set_value(desc_to_gpio(desc), value);
+}
+
+/* one call, like gpiolib's set_multiple() for lines on a single chip */
+static inline void shim_gpiod_set_array(unsigned int array_size,
+				struct gpio_desc **desc_array,
+				const unsigned long *value_bitmap,
+				const int *value_array)
+{
+	unsigned i, gpio;
+
+	shim_gpio_calls++;
+	for (i = 0; i < array_size; i++) {
+		gpio = desc_to_gpio(desc_array[i]);
+		if (gpio < SHIM_NR_GPIOS)
+			shim_gpio_value[gpio] = value_bitmap ?
+				(*value_bitmap >> i) & 1 : !!value_array[i];
+	}
+
+	if (shim_gpio_changed)
+		shim_gpio_changed();
+}
+
+/* with the signature of LINUX_VERSION_CODE */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0)
+static inline int gpiod_set_raw_array_value_cansleep(unsigned int array_size,
+				struct gpio_desc **desc_array,
+				struct gpio_array *array_info,
+				unsigned long *value_bitmap)
+{
+	shim_gpiod_set_array(array_size, desc_array, value_bitmap, NULL);
+
+	return 0;
+}
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0)
+static inline void gpiod_set_raw_array_value_cansleep(unsigned int array_size,
+				struct gpio_desc **desc_array,
+				int *value_array)
+{
+	shim_gpiod_set_array(array_size, desc_array, NULL, value_array);
+}
+#else
+static inline void gpiod_set_raw_array_cansleep(unsigned int array_size,
+				struct gpio_desc **desc_array,
+				int *value_array)
+{
+	shim_gpiod_set_array(array_size, desc_array, NULL, value_array);
+}
+#endif
+
+/*
+ * interrupts: one per gpio number, raised by a benchmark thread through
+ * shim_irq_raise(), which calls the handler unless the irq is disabled
+ */
+typedef int irqreturn_t;
+typedef irqreturn_t (*irq_handler_t)(int irq, void *dev_id);
+
+#define IRQ_NONE		0
+#define IRQ_HANDLED		1
+#define IRQF_TRIGGER_RISING	0x01
+#define IRQF_TRIGGER_FALLING	0x02
+#define IRQ_NOAUTOEN		0x01
+
+struct shim_irq {
+	pthread_mutex_t lock;
+	irq_handler_t handler;
+	void *dev_id;
+	unsigned flags;
+	int disabled;
+};
+
+extern struct shim_irq shim_irq[SHIM_NR_GPIOS];
+
+static inline int gpio_to_irq(unsigned gpio)
+{
+	return gpio < SHIM_NR_GPIOS ? (int)gpio : -EINVAL;
+}
+
+static inline void irq_set_status_flags(unsigned irq, unsigned flags)
+{
+	shim_irq[irq].flags |= flags;
+}
+
+static inline void irq_clear_status_flags(unsigned irq, unsigned flags)
+{
+	shim_irq[irq].flags &= ~flags;
+}
+
+static inline int devm_request_irq(struct device *dev, unsigned irq,
+				irq_handler_t handler, unsigned long flags,
+				const char *name, void *dev_id)
+{
+	struct shim_irq *i = &shim_irq[irq];
+
+	pthread_mutex_init(&i->lock, NULL);
+	i->handler = handler;
+	i->dev_id = dev_id;
+	i->disabled = !!(i->flags & IRQ_NOAUTOEN);
+
+	return 0;
+}
+
+static inline void enable_irq(unsigned irq)
+{
+	pthread_mutex_lock(&shim_irq[irq].lock);
+	shim_irq[irq].disabled--;
+	pthread_mutex_unlock(&shim_irq[irq].lock);
+}
+
+/* like the kernel's, waits for a running handler */
+static inline void disable_irq(unsigned irq)
+{
+	pthread_mutex_lock(&shim_irq[irq].lock);
+	shim_irq[irq].disabled++;
+	pthread_mutex_unlock(&shim_irq[irq].lock);
+}
+
+static inline void shim_irq_raise(unsigned irq)
+{
+	struct shim_irq *i = &shim_irq[irq];
+
+	pthread_mutex_lock(&i->lock);
+	if (i->handler && !i->disabled)
+		i->handler(irq, i->dev_id);
+	pthread_mutex_unlock(&i->lock);
+}
+
+/* mmio: the benchmark that uses it provides the register window */
+extern void shim_writel(u32 val, volatile void __iomem *addr);
+
+static inline void writel(u32 val, volatile void __iomem *addr)
+{
+	shim_writel(val, addr);
+}
+
+#define GPIOF_DIR_IN		(1 << 0)
+#define GPIOF_INIT_HIGH		(1 << 1)
+#define GPIOF_IN		GPIOF_DIR_IN
+#define GPIOF_OUT_INIT_LOW	0
+#define GPIOF_OUT_INIT_HIGH	GPIOF_INIT_HIGH
+
+/* spi: everything written ends up in shim_spi_write() */
+struct spi_master {
+	int bus_num;
+};
+
+struct spi_device {
+	struct device dev;
+	struct spi_master *master;
+	u32 max_speed_hz;
+	u8 chip_select;
+	u8 bits_per_word;
+	u16 mode;
+};
+
+struct spi_transfer {
+	const void *tx_buf;
+	void *rx_buf;
+	unsigned len;
+	u32 speed_hz;
+	u8 bits_per_word;
+};
+
+struct spi_message {
+	struct spi_transfer *t;
+	unsigned n;
+};
+
+extern int shim_spi_write(struct spi_device *spi, const void *buf, size_t len);
+
+static inline int spi_write(struct spi_device *spi, const void *buf, size_t len)
+{
+	return shim_spi_write(spi, buf, len);
+}
+
+static inline void spi_message_init(struct spi_message *m)
+{
+	m->t = NULL;
+	m->n = 0;
+}
+
+static inline void spi_message_add_tail(struct spi_transfer *t,
+						struct spi_message *m)
+{
+	if (!m->n)
+		m->t = t;
+	m->n++;
+}
+
+static inline int spi_sync(struct spi_device *spi, struct spi_message *m)
+{
+	unsigned i;
+	int ret = 0;
+
+	for (i = 0; i < m->n && !ret; i++)
+		if (m->t[i].tx_buf && !m->t[i].rx_buf)
+			ret = shim_spi_write(spi, m->t[i].tx_buf, m->t[i].len);
+		else if (m->t[i].rx_buf)
+			memset(m->t[i].rx_buf, 0, m->t[i].len);
+
+	return ret;
+}
+
+struct platform_device {
+	const char *name;
+	struct device dev;
+};
+
+/* framebuffer */
+struct vm_area_struct;
+
+struct fb_bitfield {
+	u32 offset;
+	u32 length;
+	u32 msb_right;
+};
+
+struct fb_var_screeninfo {
+	u32 xres, yres;
+	u32 xres_virtual, yres_virtual;
+	u32 xoffset, yoffset;
+	u32 bits_per_pixel;
+	u32 grayscale;
+	struct fb_bitfield red, green, blue, transp;
+	u32 nonstd;
+	u32 rotate;
+};
+
+struct fb_fix_screeninfo {
+	char id[16];
+	u32 smem_len;
+	u32 type;
+	u32 visual;
+	u32 line_length;
+};
+
+struct fb_info {
+	struct fb_var_screeninfo var;
+	struct fb_fix_screeninfo fix;
+	struct device *device;
+	struct device *dev;
+	char __iomem *screen_base;
+	void *par;
+};
+
+#endif /* __FBTFT_SHIM_H */
@@ -0,0 +1,3 @@
+/* glibc reaches this through <errno.h> as well */
+#include_next <linux/errno.h>
+#include "../fbtft_shim.h"
@@ -0,0 +1 @@
+#include "../../fbtft_shim.h"
@@ -0,0 +1,363 @@
+#!/usr/bin/env python3
+#
+# Framebuffer throughput benchmark
+#
+#   fbbench.py [-d /dev/fb1] [-t seconds] [-r rate] [pattern ...] > run.json
+#
+# Draws typical damage patterns through an mmap of the framebuffer at a
+# fixed rate and reports, per pattern, the frames written and the frames
+# the driver actually delivered. On fbtft the driver's own counters in
+# /sys/class/graphics/fbN/stats give delivered fps, bus time and the
+# damage-to-flush latency, otherwise only the write side is reported.
+#
+# Patterns:
+#   video    full frame changes every frame
+#   console  text console scrolling one line per frame
+#   clock    small region in the top right corner
+#   sprites  16x16 sprites moving around
+#   bars     status bars at the top and bottom
+#
+# With --fence every frame is flushed with FBTFT_IOCTL_FLUSH and waited
+# for, so the latency is measured exactly instead of sampled from stats.
+#
+# With --no-faults the driver is switched to FBTFT_DAMAGE_NO_FAULTS and
+# the framebuffer is mapped again, as a plain mapping that doesn't fault.
+# The new mapping is checked against read(), and every frame is reported
+# with FBTFT_IOCTL_DAMAGE as a full frame of damage.
+#
+# Results go to stdout as JSON, progress to stderr.
+
+import argparse
+import ctypes
+import fcntl
+import json
+import mmap
+import os
+import platform
+import random
+import struct
+import sys
+import time
+
+FBIOGET_VSCREENINFO = 0x4600
+FBIOGET_FSCREENINFO = 0x4602
+
+
+def _iowr(nr, size):
+    return (3 << 30) | (size << 16) | (ord("F") << 8) | nr
+
+
+def _iow(nr, size):
+    return (1 << 30) | (size << 16) | (ord("F") << 8) | nr
+
+
+# struct fbtft_damage { u32 flags, num_rects; u64 rects; }
+FBTFT_DAMAGE = struct.Struct("IIQ")
+FBTFT_IOCTL_DAMAGE = _iow(0xF0, FBTFT_DAMAGE.size)
+FBTFT_DAMAGE_NO_FAULTS = 1 << 0
+# struct fbtft_rect { u32 x, y, width, height; }
+FBTFT_RECT = struct.Struct("4I")
+
+# struct fbtft_flush { u32 flags, reserved; u64 seq, done; }
+FBTFT_FLUSH = struct.Struct("IIQQ")
+FBTFT_IOCTL_FLUSH = _iowr(0xF1, FBTFT_FLUSH.size)
+FBTFT_FLUSH_WAIT = 1 << 1
+
+PATTERNS = ("video", "console", "clock", "sprites", "bars")
+
+
+class Framebuffer:
+    def __init__(self, path):
+        self.path = path
+        self.fd = os.open(path, os.O_RDWR)
+
+        var = fcntl.ioctl(self.fd, FBIOGET_VSCREENINFO, bytes(160))
+        self.xres, self.yres, _, _, _, _, self.bpp = \
+            struct.unpack_from("7I", var)
+        # struct fb_fix_screeninfo, id[16], smem_start (ulong), smem_len...
+        fix = fcntl.ioctl(self.fd, FBIOGET_FSCREENINFO, bytes(80))
+        self.id = fix[:16].split(b"\0")[0].decode(errors="replace")
+        off = 16 + struct.calcsize("L")
+        self.smem_len, = struct.unpack_from("I", fix, off)
+        self.line_length, = struct.unpack_from("I", fix, off + 24)
+
+        self.size = self.line_length * self.yres
+        self.mm = mmap.mmap(self.fd, self.smem_len)
+        self.damage_rect = None
+        self.stats_path = "/sys/class/graphics/%s/stats" % \
+            os.path.basename(path)
+        if not os.path.exists(self.stats_path):
+            self.stats_path = None
+
+    def xbytes(self, x):
+        return x * self.bpp // 8
+
+    def fill(self, x, y, w, h, val):
+        """Fill a rectangle with a repeating byte value"""
+        line = bytes([val & 0xFF]) * (self.xbytes(x + w) - self.xbytes(x))
+        for row in range(y, y + h):
+            start = row * self.line_length + self.xbytes(x)
+            self.mm[start:start + len(line)] = line
+
+    def flush(self):
+        """Flush the damage so far and wait until it's on the panel"""
+        arg = bytearray(FBTFT_FLUSH.pack(FBTFT_FLUSH_WAIT, 0, 0, 0))
+        fcntl.ioctl(self.fd, FBTFT_IOCTL_FLUSH, arg)
+        return FBTFT_FLUSH.unpack(arg)[2:]
+
+    def no_faults(self):
+        """Stop fault tracking and map the framebuffer again"""
+        fcntl.ioctl(self.fd, FBTFT_IOCTL_DAMAGE,
+                    FBTFT_DAMAGE.pack(FBTFT_DAMAGE_NO_FAULTS, 0, 0))
+        self.mm.close()
+        # mappings made from now on don't go through deferred io
+        self.mm = mmap.mmap(self.fd, self.smem_len)
+        self.damage_rect = ctypes.create_string_buffer(
+            FBTFT_RECT.pack(0, 0, self.xres, self.yres))
+
+        # what's written through the mapping is what the driver sees
+        pattern = bytes(random.Random(1).getrandbits(8)
+                        for _ in range(self.size))
+        self.mm[0:self.size] = pattern
+        self.damage()
+        self.flush()
+        os.lseek(self.fd, 0, os.SEEK_SET)
+        if os.read(self.fd, self.size) != pattern:
+            sys.exit("%s: no-faults mapping doesn't match the framebuffer"
+                     % self.path)
+        os.lseek(self.fd, 0, os.SEEK_SET)
+
+    def damage(self):
+        """Report the whole frame as damaged, if faults aren't tracked"""
+        if not self.damage_rect:
+            return
+        fcntl.ioctl(self.fd, FBTFT_IOCTL_DAMAGE, FBTFT_DAMAGE.pack(
+            FBTFT_DAMAGE_NO_FAULTS, 1, ctypes.addressof(self.damage_rect)))
+
+    def stats(self):
+        if not self.stats_path:
+            return None
+        with open(self.stats_path) as f:
+            return {k: int(v) for k, v in (l.split() for l in f)}
+
+
+class Pattern:
+    """Draws one frame of damage per call to step()"""
+
+    def __init__(self, fb):
+        self.fb = fb
+        self.n = 0
+
+    def step(self):
+        self.draw()
+        self.fb.damage()
+        self.n += 1
+
+
+class Video(Pattern):
+    def __init__(self, fb):
+        super().__init__(fb)
+        self.frames = [os.urandom(fb.size) for _ in range(4)]
+
+    def draw(self):
+        self.fb.mm[0:self.fb.size] = self.frames[self.n % len(self.frames)]
+
+
+class Console(Pattern):
+    LINE = 8
+
+    def draw(self):
+        fb = self.fb
+        step = self.LINE * fb.line_length
+        fb.mm.move(0, step, fb.size - step)
+        # a new line of "text": short runs on a background
+        y = fb.yres - self.LINE
+        fb.fill(0, y, fb.xres, self.LINE, 0)
+        rnd = random.Random(self.n)
+        for col in range(0, fb.xres - 8, 8):
+            if rnd.random() < 0.7:
+                fb.fill(col + 1, y + 1, 5, self.LINE - 2, 0xFF)
+
+
+class Clock(Pattern):
+    def draw(self):
+        fb = self.fb
+        w, h = min(64, fb.xres), min(16, fb.yres)
+        fb.fill(fb.xres - w, 0, w, h, 0)
+        # one "digit" segment advances per frame
+        x = fb.xres - w + (self.n % 8) * (w // 8)
+        fb.fill(x, 2, max(1, w // 8 - 2), h - 4, 0xFF)
+
+
+class Sprites(Pattern):
+    SIZE = 16
+    COUNT = 4
+
+    def __init__(self, fb):
+        super().__init__(fb)
+        self.rnd = random.Random(2)
+        self.pos = [self.place() for _ in range(self.COUNT)]
+
+    def place(self):
+        size = min(self.SIZE, self.fb.xres, self.fb.yres)
+        return (self.rnd.randrange(self.fb.xres - size + 1),
+                self.rnd.randrange(self.fb.yres - size + 1), size)
+
+    def draw(self):
+        for i, (x, y, size) in enumerate(self.pos):
+            self.fb.fill(x, y, size, size, 0)
+            self.pos[i] = self.place()
+            x, y, size = self.pos[i]
+            self.fb.fill(x, y, size, size, 0xFF - i)
+
+
+class Bars(Pattern):
+    def draw(self):
+        fb = self.fb
+        h = max(1, min(16, fb.yres // 8))
+        val = 0x55 if self.n & 1 else 0xAA
+        fb.fill(0, 0, fb.xres, h, val)
+        fb.fill(0, fb.yres - h, fb.xres, h, val)
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def flushed(st, last_done, pending, latencies):
+    """Match a new flush reported in st against the pending damage"""
+    if st and st["last_done"] != last_done:
+        last_done = st["last_done"]
+        flush_start = last_done - st["last_ns"]
+        while pending and pending[0] <= flush_start:
+            latencies.append(last_done - pending.pop(0))
+    return last_done
+
+
+def run(fb, name, duration, rate, fence=False):
+    pattern = {"video": Video, "console": Console, "clock": Clock,
+               "sprites": Sprites, "bars": Bars}[name](fb)
+    fb.mm[0:fb.size] = bytes(fb.size)
+    fb.damage()
+    time.sleep(0.2)
+
+    before = fb.stats()
+    pending = []        # damage timestamps not yet flushed
+    latencies = []
+    last_done = before["last_done"] if before else 0
+    period = 1e9 / rate if rate else 0
+    start = time.monotonic_ns()
+    deadline = start + duration * 1e9
+    next_frame = start
+
+    while time.monotonic_ns() < deadline:
+        drawn = time.monotonic_ns()
+        pattern.step()
+        if fence:
+            fb.flush()
+            latencies.append(time.monotonic_ns() - drawn)
+        else:
+            pending.append(drawn)
+        next_frame += period
+        # poll the driver counters until the next frame is due
+        while True:
+            last_done = flushed(fb.stats(), last_done, pending, latencies)
+            now = time.monotonic_ns()
+            if now >= next_frame:
+                break
+            time.sleep(min(0.001, (next_frame - now) / 1e9))
+
+    elapsed = (time.monotonic_ns() - start) / 1e9
+    result = {
+        "pattern": name,
+        "duration_s": round(elapsed, 3),
+        "frames_written": pattern.n,
+        "write_fps": round(pattern.n / elapsed, 2),
+    }
+
+    if before:
+        # let the last damage drain before reading the totals
+        time.sleep(0.5)
+        after = fb.stats()
+        flushed(after, last_done, pending, latencies)
+        delta = {k: after[k] - before[k] for k in after}
+        result.update({
+            "frames_delivered": delta["frames"],
+            "delivered_fps": round(delta["frames"] / elapsed, 2),
+            "lines_per_frame": round(delta["lines"] / delta["frames"], 1)
+            if delta["frames"] else 0,
+            "bytes": delta["bytes"],
+            "bus_busy_pct": round(100.0 * delta["busy_ns"] /
+                                  (elapsed * 1e9), 1),
+            "update_ms_avg": round(delta["busy_ns"] / delta["frames"] / 1e6,
+                                   3) if delta["frames"] else None,
+        })
+
+    if before or fence:
+        ms = [v / 1e6 for v in latencies]
+        result["latency_ms"] = {
+            "samples": len(ms),
+            "p50": percentile(ms, 50),
+            "p90": percentile(ms, 90),
+            "p99": percentile(ms, 99),
+            "max": max(ms) if ms else None,
+        }
+
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Framebuffer throughput benchmark")
+    parser.add_argument("-d", "--device", default="/dev/fb1")
+    parser.add_argument("-t", "--time", type=float, default=5,
+                        help="seconds per pattern (default: 5)")
+    parser.add_argument("-r", "--rate", type=float, default=60,
+                        help="frames drawn per second, 0 for as fast as "
+                        "possible (default: 60)")
+    parser.add_argument("-f", "--fence", action="store_true",
+                        help="flush and wait for every frame (fbtft only)")
+    parser.add_argument("-n", "--no-faults", action="store_true",
+                        help="map without fault tracking and report damage "
+                        "with FBTFT_IOCTL_DAMAGE (fbtft only)")
+    parser.add_argument("patterns", nargs="*", metavar="pattern",
+                        help="any of %s (default: all)" % ", ".join(PATTERNS))
+    args = parser.parse_args()
+
+    for name in args.patterns:
+        if name not in PATTERNS:
+            parser.error("unknown pattern '%s'" % name)
+
+    fb = Framebuffer(args.device)
+    if fb.bpp < 8:
+        sys.exit("%s: %d bpp is not supported" % (args.device, fb.bpp))
+    if args.no_faults:
+        fb.no_faults()
+
+    results = []
+    for name in args.patterns or PATTERNS:
+        print("%s: %s..." % (args.device, name), file=sys.stderr)
+        results.append(run(fb, name, args.time, args.rate, args.fence))
+
+    json.dump({
+        "device": args.device,
+        "id": fb.id,
+        "xres": fb.xres,
+        "yres": fb.yres,
+        "bpp": fb.bpp,
+        "kernel": platform.release(),
+        "driver_stats": fb.stats_path is not None,
+        "rate": args.rate,
+        "fence": args.fence,
+        "no_faults": args.no_faults,
+        "time": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        "results": results,
+    }, sys.stdout, indent=2)
+    print()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+#
+# Decode an FBTFT bus trace (load fbtft with trace=<records>)
+#
+#   fbtft_trace.py /sys/kernel/debug/fbtft/spi0.0/trace
+#   fbtft_trace.py trace.bin    (a copy made with cp/cat)
+#
+# Splits the record stream into command and pixel phases, and reports bus
+# utilisation, throughput and idle gaps between messages.
+
+import argparse
+import mmap
+import struct
+import sys
+
+MAGIC = 0x46425452
+HDR = struct.Struct("<8IQ")
+REC = struct.Struct("<QIIBBH12s")
+
+DCS_NAMES = {
+    0x01: "SWRESET", 0x11: "SLPOUT", 0x29: "DISPON", 0x2A: "CASET",
+    0x2B: "RASET", 0x2C: "RAMWR", 0x35: "TEON", 0x36: "MADCTL",
+    0x3A: "COLMOD", 0x3C: "RAMWRC", 0x45: "GETSCAN",
+}
+RAMWR = (0x2C, 0x3C)
+
+
+def load(path):
+    with open(path, "rb") as f:
+        try:
+            data = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+        except (ValueError, OSError):
+            data = f.read()
+    magic, version, hdr_size, rec_size, num, payload, buswidth, _, head = \
+        HDR.unpack_from(data, 0)
+    if magic != MAGIC:
+        sys.exit("%s: bad magic 0x%08x" % (path, magic))
+
+    first = max(0, head - num)
+    recs = []
+    for n in range(first, head):
+        ts, dur, length, dc, flags, caplen, raw = \
+            REC.unpack_from(data, hdr_size + (n % num) * rec_size)
+        if ts == 0:
+            continue
+        recs.append((ts, dur, length, dc, flags, raw[:caplen]))
+    recs.sort()
+    return recs, buswidth, first > 0
+
+
+def classify(recs, buswidth):
+    """Yield (record, phase, command) where phase is 'cmd' or 'pixel'"""
+    in_ramwr = False
+    for rec in recs:
+        ts, dur, length, dc, flags, data = rec
+        cmd = None
+        if buswidth == 9 and len(data) >= 2:
+            dc = data[1] & 1
+            cmd = data[0] if dc == 0 else None
+        elif dc == 0 and data:
+            cmd = data[-1]
+        if dc == 0:
+            in_ramwr = cmd in RAMWR
+            yield rec, "cmd", cmd
+        else:
+            yield rec, "pixel" if in_ramwr else "cmd", None
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode an FBTFT bus trace")
+    parser.add_argument("trace")
+    parser.add_argument("-v", "--verbose", action="store_true",
+                        help="list every record")
+    args = parser.parse_args()
+
+    recs, buswidth, wrapped = load(args.trace)
+    if not recs:
+        sys.exit("no records")
+
+    stats = {"cmd": [0, 0, 0], "pixel": [0, 0, 0]}  # msgs, bytes, ns
+    cmds = {}
+    gaps = []
+    prev_end = None
+    for (ts, dur, length, dc, flags, data), phase, cmd in \
+            classify(recs, buswidth):
+        st = stats[phase]
+        st[0] += 1
+        st[1] += length
+        st[2] += dur
+        if cmd is not None:
+            name = DCS_NAMES.get(cmd, "0x%02X" % cmd)
+            cmds[name] = cmds.get(name, 0) + 1
+        if prev_end is not None and ts > prev_end:
+            gaps.append(ts - prev_end)
+        prev_end = ts + dur
+        if args.verbose:
+            print("%16d %8d %6d dc=%-3s %-5s %s%s" % (
+                ts, dur, length, "?" if dc == 0xFF else dc, phase,
+                data.hex(), " ERR" if flags & 2 else ""))
+
+    span = recs[-1][0] + recs[-1][1] - recs[0][0]
+    busy = stats["cmd"][2] + stats["pixel"][2]
+    print("records:      %d%s" % (len(recs),
+                                  " (ring wrapped)" if wrapped else ""))
+    print("span:         %.3f ms" % (span / 1e6))
+    print("utilisation:  %.1f %%" % (100.0 * busy / span if span else 0))
+    for phase in ("cmd", "pixel"):
+        msgs, nbytes, ns = stats[phase]
+        print("%-6s        %d msgs, %d bytes, %.3f ms, %.2f MB/s" % (
+            phase, msgs, nbytes, ns / 1e6,
+            nbytes * 1e3 / ns if ns else 0))
+    print("idle gaps:    n=%d p50=%d us p99=%d us max=%d us" % (
+        len(gaps), percentile(gaps, 50) // 1000,
+        percentile(gaps, 99) // 1000, max(gaps or [0]) // 1000))
+    if cmds:
+        print("commands:     " + ", ".join(
+            "%s=%d" % kv for kv in sorted(cmds.items())))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+#
+# Fake the gpios of a parallel (8080) bus display with gpio-sim
+#
+#   pbus_sim.py [-w 8|16] [-l]
+#
+# Creates a gpio-sim chip with reset, dc, wr and the data lines (and a
+# latch with -l), prints the gpios parameter to hand to fbtft_device and
+# keeps the chip alive until interrupted:
+#
+#   modprobe gpio-sim
+#   pbus_sim.py -w 16 &
+#   modprobe flexfb chip=ili9341 buswidth=16
+#   modprobe fbtft_device name=flexpfb <gpios=... as printed>
+#   fbbench.py -d /dev/fb1 > gpio-sim.json
+#
+# Nothing listens on the other side, so this measures the cost of driving
+# the bus through gpiolib, not a display.
+
+import argparse
+import os
+import re
+import signal
+import sys
+
+CONFIGFS = "/sys/kernel/config/gpio-sim"
+NAME = "fbtft_pbus"
+
+
+def write(path, value):
+    with open(path, "w") as f:
+        f.write(value)
+
+
+def read(path):
+    with open(path) as f:
+        return f.read().strip()
+
+
+def line_names(width, latched):
+    names = ["reset", "dc", "wr"]
+    if latched:
+        names.append("latch")
+    names += ["db%02d" % i for i in range(width)]
+    return names
+
+
+def create(names):
+    chip = os.path.join(CONFIGFS, NAME)
+    bank = os.path.join(chip, "bank0")
+    os.mkdir(chip)
+    os.mkdir(bank)
+    write(os.path.join(bank, "num_lines"), str(len(names)))
+    for i, name in enumerate(names):
+        line = os.path.join(bank, "line%d" % i)
+        os.mkdir(line)
+        write(os.path.join(line, "name"), name)
+    write(os.path.join(chip, "live"), "1")
+    return chip, bank
+
+
+def destroy(chip, bank, count):
+    write(os.path.join(chip, "live"), "0")
+    for i in range(count):
+        os.rmdir(os.path.join(bank, "line%d" % i))
+    os.rmdir(bank)
+    os.rmdir(chip)
+
+
+def gpio_base(chip_name):
+    """Legacy gpio number of line 0, fbtft still uses those"""
+    with open("/sys/kernel/debug/gpio") as f:
+        for line in f:
+            m = re.match(r"\s*%s: GPIOs (\d+)-" % chip_name, line)
+            if m:
+                return int(m.group(1))
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Create gpio-sim lines for a parallel bus display")
+    parser.add_argument("-w", "--width", type=int, choices=(8, 16),
+                        default=8, help="data lines (default: 8)")
+    parser.add_argument("-l", "--latched", action="store_true",
+                        help="8 data lines and a latch for 16-bit data")
+    args = parser.parse_args()
+
+    if not os.path.isdir(CONFIGFS):
+        sys.exit("%s not found, is gpio-sim loaded and configfs mounted?" %
+                 CONFIGFS)
+
+    names = line_names(8 if args.latched else args.width, args.latched)
+    chip, bank = create(names)
+    try:
+        chip_name = read(os.path.join(bank, "chip_name"))
+        base = gpio_base(chip_name)
+        if base is None:
+            sys.exit("%s not found in /sys/kernel/debug/gpio" % chip_name)
+        print("gpios=" + ",".join("%s:%d" % (name, base + i)
+                                  for i, name in enumerate(names)),
+              flush=True)
+        try:
+            while True:
+                signal.pause()
+        except KeyboardInterrupt:
+            pass
+    finally:
+        destroy(chip, bank, len(names))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+#
+# Fake a panel's tearing effect (TE) output with gpio-sim
+#
+#   te_sim.py [-r 60] [-w 500]
+#
+# Creates a one line gpio-sim chip through configfs, prints the gpio
+# number to hand to fbtft_device, then pulses the line at the refresh
+# rate until interrupted:
+#
+#   modprobe gpio-sim
+#   te_sim.py &
+#   modprobe fbtft_dcs_emul
+#   modprobe fbtft_device name=dcs_emul_ili9341 busnum=32 \
+#     gpios=te:<number printed>
+#   cat /sys/class/graphics/fb1/stats
+#
+# Needs configfs mounted and debugfs for the gpio number lookup. The
+# pulses are driven from userspace, so expect some jitter in the period
+# the driver measures.
+
+import argparse
+import os
+import re
+import sys
+import time
+
+CONFIGFS = "/sys/kernel/config/gpio-sim"
+NAME = "fbtft_te"
+
+
+def write(path, value):
+    with open(path, "w") as f:
+        f.write(value)
+
+
+def read(path):
+    with open(path) as f:
+        return f.read().strip()
+
+
+def create():
+    chip = os.path.join(CONFIGFS, NAME)
+    bank = os.path.join(chip, "bank0")
+    os.mkdir(chip)
+    os.mkdir(bank)
+    write(os.path.join(bank, "num_lines"), "1")
+    write(os.path.join(chip, "live"), "1")
+    return chip, bank
+
+
+def destroy(chip, bank):
+    write(os.path.join(chip, "live"), "0")
+    os.rmdir(bank)
+    os.rmdir(chip)
+
+
+def gpio_base(chip_name):
+    """Legacy gpio number of line 0, fbtft still uses those"""
+    with open("/sys/kernel/debug/gpio") as f:
+        for line in f:
+            m = re.match(r"\s*%s: GPIOs (\d+)-" % chip_name, line)
+            if m:
+                return int(m.group(1))
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Pulse a gpio-sim line like a TE output")
+    parser.add_argument("-r", "--rate", type=float, default=60,
+                        help="refresh rate in Hz (default: 60)")
+    parser.add_argument("-w", "--width", type=float, default=500,
+                        help="pulse width in us (default: 500)")
+    args = parser.parse_args()
+
+    if not os.path.isdir(CONFIGFS):
+        sys.exit("%s not found, is gpio-sim loaded and configfs mounted?" %
+                 CONFIGFS)
+
+    chip, bank = create()
+    try:
+        dev_name = read(os.path.join(chip, "dev_name"))
+        chip_name = read(os.path.join(bank, "chip_name"))
+        pull = "/sys/devices/platform/%s/%s/sim_gpio0/pull" % \
+            (dev_name, chip_name)
+        base = gpio_base(chip_name)
+        print("TE line: %s line 0, gpio %s" %
+              (chip_name, base if base is not None else "unknown"),
+              flush=True)
+
+        period = 1.0 / args.rate
+        width = args.width / 1e6
+        with open(pull, "w") as f:
+            next_edge = time.monotonic()
+            while True:
+                for value in ("pull-up", "pull-down"):
+                    f.seek(0)
+                    f.write(value)
+                    f.flush()
+                    if value == "pull-up":
+                        time.sleep(width)
+                next_edge += period
+                delay = next_edge - time.monotonic()
+                if delay > 0:
+                    time.sleep(delay)
+                else:
+                    next_edge = time.monotonic()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        destroy(chip, bank)
+
+
+if __name__ == "__main__":
+    main()
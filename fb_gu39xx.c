@@ -4,6 +4,10 @@
 #include <linux/init.h>
 #include <linux/gpio.h>
 #include <linux/delay.h>
+#include <linux/interrupt.h>
+#include <linux/completion.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
 
 #include "fbtft.h"
 
@@ -16,8 +20,36 @@
 #define CMD_BRIGHTNESS   0x58
 #define CMD_BITIMAGE     0x46
 
+/* the controller can be busy for milliseconds drawing a bit image */
+#define READY_TIMEOUT_MS 500
+
+static unsigned fifo = 1;
+module_param(fifo, uint, 0);
+MODULE_PARM_DESC(fifo,
+	"Bytes the controller takes without a handshake once ready is asserted (default: 1)");
+
+static unsigned threshold = 26214;
+module_param(threshold, uint, 0);
+MODULE_PARM_DESC(threshold,
+	"With RGB565 video memory: luma (0-65535) above which a pixel is lit (default: 26214, 40%)");
+
+static unsigned ready_spin = 20;
+module_param(ready_spin, uint, 0);
+MODULE_PARM_DESC(ready_spin,
+	"Microseconds to poll the ready line before waiting for its interrupt (default: 20)");
+
 int init[] = { -3 };
 
+/* per device, in par->extra */
+struct gu39xx {
+	int irq;
+	struct completion ready;
+
+	/* what the display shows, unknown while stale */
+	bool stale;
+	u8 image[];
+};
+
 
 /* this does nothing, we set the address window in write_vmem */
 static void set_addr_win(struct fbtft_par *par, int xs, int ys, int xe, int ye)
@@ -36,113 +68,202 @@ static int blank(struct fbtft_par *par, bool on)
 	return 0;
 }
 
-static int write(struct fbtft_par *par, void *buf, size_t len)
+static irqreturn_t ready_irq(int irq, void *data)
 {
-	u8 data;
-	int i;
-	static u8 prev_data;
+	struct fbtft_par *par = data;
+	struct gu39xx *gu = par->extra;
 
-	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
-		"%s(len=%d): ", __func__, len);
+	complete(&gu->ready);
 
-	while (len--) {
-		data = *(u8 *) buf;
-
-		/* wait for ready line to be asserted */
-		while(gpio_get_value(par->gpio.aux[0]) == 0)
-			yield();
-
-		/* Start writing by pulling down /WR */
-		gpio_set_value(par->gpio.wr, 0);
-
-		/* Set data */
-		if (data == prev_data) {
-			gpio_set_value(par->gpio.wr, 0); /* used as delay */
-		} else {
-			for (i = 0; i < 8; i++) {
-				if ((data & 1) != (prev_data & 1))
-					gpio_set_value(par->gpio.db[i],
-								(data & 1));
-				data >>= 1;
-				prev_data >>= 1;
-			}
-		}
+	return IRQ_HANDLED;
+}
 
-		/* Pullup /WR */
-		gpio_set_value(par->gpio.wr, 1);
+/*
+ * Wait for the ready line. Short busy periods are polled, longer ones
+ * (drawing, clearing) sleep until the interrupt on the rising edge.
+ * The interrupt is only enabled while waiting for it.
+ */
+static int wait_ready(struct fbtft_par *par)
+{
+	struct gu39xx *gu = par->extra;
+	int ready = par->gpio.aux[0];
+	unsigned long timeout = msecs_to_jiffies(READY_TIMEOUT_MS);
+	u64 spin_end;
+	int ret = 0;
 
-		prev_data = *(u8 *) buf;
-		buf++;
+	if (gpio_get_value(ready))
+		return 0;
+
+	spin_end = ktime_to_ns(ktime_get()) + ready_spin * NSEC_PER_USEC;
+	do {
+		cpu_relax();
+		if (gpio_get_value(ready))
+			return 0;
+	} while (ktime_to_ns(ktime_get()) < spin_end);
+
+	if (gu->irq < 0) {
+		timeout += jiffies;
+		while (!gpio_get_value(ready)) {
+			if (time_after(jiffies, timeout)) {
+				ret = -ETIMEDOUT;
+				break;
+			}
+			usleep_range(50, 100);
+		}
+	} else {
+		enable_irq(gu->irq);
+		for (;;) {
+			/* an edge from before enable_irq() may be replayed */
+			reinit_completion(&gu->ready);
+			if (gpio_get_value(ready))
+				break;
+			if (!wait_for_completion_timeout(&gu->ready, timeout)) {
+				ret = -ETIMEDOUT;
+				break;
+			}
+		}
+		disable_irq(gu->irq);
 	}
 
-	return 0;
-}
+	if (ret)
+		dev_err(par->info->device,
+			"%s: timeout waiting for the ready line\n", __func__);
 
-#define CYR     613    /* 2.392 */
-#define CYG     601    /* 2.348 */
-#define CYB     233    /* 0.912 */
-
-#define THRESH  ((int)(65536 * 0.4))
+	return ret;
+}
 
-static unsigned int rgb565_to_m(unsigned int rgb)
+/*
+ * Write in batches of 'fifo' bytes, handshaking on the ready line
+ * before each batch
+ */
+static int write(struct fbtft_par *par, void *buf, size_t len)
 {
-	unsigned int value;
+	size_t n;
+	int ret;
 
-	rgb = cpu_to_le16(rgb);
-	value = CYR * (rgb >> 11) + CYG * (rgb >> 5 & 0x3F) + CYB * (rgb & 0x1F);
+	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
+		"%s(len=%d): ", __func__, len);
 
-	return (value > THRESH) ? 1 : 0;
+	while (len) {
+		ret = wait_ready(par);
+		if (ret)
+			return ret;
+
+		n = min_t(size_t, len, max(fifo, 1U));
+		ret = fbtft_write_gpio8_wr(par, buf, n);
+		if (ret)
+			return ret;
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
 }
 
+/*
+ * The bit image is column-major, a byte is 8 rows of a column. Only the
+ * bytes in the rows of offset..offset+len are converted, and of those
+ * the span that changed goes out, at its CMD_BITIMAGE address. A full
+ * screen update is always sent in full.
+ */
 static int write_vmem(struct fbtft_par *par, size_t offset, size_t len)
 {
-	u16 *vmem16 = (u16 *)(par->info->screen_base);
-	u8 *buf = par->txbuf.buf;
-	uint16_t wr_addr, wr_len;
-	int y, x, bl_height, bl_width;
-	unsigned int offs;
-	int ret = 0;
-
-	bl_width = par->info->var.xres;
-	bl_height = par->info->var.yres;
-
-	fbtft_par_dbg(DEBUG_WRITE_VMEM, par,
-		"%s(offset=0x%x bl_width=%d bl_height=%d)\n", __func__, offset, bl_width, bl_height);
-
-	for (x = 0; x < bl_width; x ++) {
-		for (y = 0; y < bl_height; y += 8) {
-			offs = (y * bl_width) + x;
-			/* each byte contains 8 pixels in incrementing height */
-			*buf =    rgb565_to_m(vmem16[offs]) << 7;
-			offs += bl_width;
-			*buf |=   rgb565_to_m(vmem16[offs]) << 6;
-			offs += bl_width;
-			*buf |=   rgb565_to_m(vmem16[offs]) << 5;
-			offs += bl_width;
-			*buf |=   rgb565_to_m(vmem16[offs]) << 4;
-			offs += bl_width;
-			*buf |=   rgb565_to_m(vmem16[offs]) << 3;
-			offs += bl_width;
-			*buf |=   rgb565_to_m(vmem16[offs]) << 2;
-			offs += bl_width;
-			*buf |=   rgb565_to_m(vmem16[offs]) << 1;
-			offs += bl_width;
-			*buf++ |= rgb565_to_m(vmem16[offs]) << 0;
+	struct gu39xx *gu = par->extra;
+	unsigned width = par->panel.width;
+	unsigned rows = par->panel.height / 8;
+	size_t line_length = par->panel.line_length;
+	u8 *vmem8 = fbtft_vmem(par) + fbtft_line_offset(par, 0);
+	u8 *col = par->txbuf.buf;
+	unsigned ys, ye, x, r, n, first, last;
+	const u8 *src;
+	int ret;
+
+	ys = fbtft_offset_line(par, offset);
+	ye = ys + len / line_length - 1;
+
+	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s(ys=%u, ye=%u)\n", __func__,
+		ys, ye);
+
+	if (!ys && ye == par->panel.height - 1)
+		gu->stale = true;
+
+	first = width * rows;
+	last = 0;
+	for (r = ys / 8; r <= ye / 8; r++) {
+		/* each byte contains 8 pixels in incrementing height */
+		src = vmem8 + r * 8 * line_length;
+		if (par->info->var.bits_per_pixel == 1)
+			fbtft_conv_col1(src, line_length, col, 1, width, true);
+		else
+			fbtft_conv_mono_col(par->conv, (u16 *)src, width,
+				col, 1, width, true);
+
+		for (x = 0, n = r; x < width; x++, n += rows) {
+			if (col[x] == gu->image[n])
+				continue;
+			gu->image[n] = col[x];
+			first = min(first, n);
+			last = max(last, n);
 		}
 	}
 
+	if (gu->stale) {
+		first = 0;
+		last = width * rows - 1;
+	}
+	if (first > last)
+		return 0;
+
 	/* Write data */
-	wr_addr = cpu_to_le16(0);
-	wr_len = cpu_to_le16(bl_width * bl_height / 8);
-	write_reg(par, CMD_STX, 0x44, ADDRESS, CMD_BITIMAGE, wr_addr, wr_addr >> 8, wr_len, wr_len >> 8);
-	ret = par->fbtftops.write(par, par->txbuf.buf, wr_len);
+	n = last - first + 1;
+	write_reg(par, CMD_STX, 0x44, ADDRESS, CMD_BITIMAGE,
+		first & 0xFF, first >> 8, n & 0xFF, n >> 8);
+	ret = par->fbtftops.write(par, gu->image + first, n);
 	if (ret < 0)
 		dev_err(par->info->device, "%s: write failed and returned: %d\n", __func__, ret);
+	gu->stale = ret < 0;
 
 	return ret;
 }
 
 
+/* verify_gpios() is the one hook that runs once per device */
+static int device_init(struct fbtft_par *par)
+{
+	struct device *dev = par->info->device;
+	struct gu39xx *gu;
+	int ret;
+
+	ret = fbtft_conv_init(par, 2, min(threshold, 0xFFFFU), NULL);
+	if (ret)
+		return ret;
+
+	gu = vzalloc(sizeof(*gu) +
+			par->info->var.xres * par->info->var.yres / 8);
+	if (!gu)
+		return -ENOMEM;
+	init_completion(&gu->ready);
+	gu->stale = true;
+	par->extra = gu;
+
+	gu->irq = gpio_to_irq(par->gpio.aux[0]);
+	if (gu->irq >= 0) {
+		irq_set_status_flags(gu->irq, IRQ_NOAUTOEN);
+		ret = devm_request_irq(dev, gu->irq, ready_irq,
+					IRQF_TRIGGER_RISING, DRVNAME, par);
+		if (ret) {
+			irq_clear_status_flags(gu->irq, IRQ_NOAUTOEN);
+			gu->irq = ret;
+		}
+	}
+	if (gu->irq < 0)
+		dev_info(dev,
+			"No interrupt for the 'ready' gpio (%d), polling it\n",
+			gu->irq);
+
+	return 0;
+}
+
 static int verify_gpios(struct fbtft_par *par)
 {
 	int i;
@@ -164,7 +285,7 @@ static int verify_gpios(struct fbtft_par *par)
 		}
 	}
 
-	return 0;
+	return device_init(par);
 }
 
 static unsigned long request_gpios_match(struct fbtft_par *par, const struct fbtft_gpio *gpio)
@@ -181,6 +302,7 @@ static struct fbtft_display display = {
 	.regwidth = 8,
 	.width = WIDTH,
 	.height = HEIGHT,
+	.bpp = 1,
 	.txbuflen = WIDTH*HEIGHT/8,
 	.init_sequence = init,
 	.fbtftops = {
@@ -1,8 +1,9 @@
 /*
  * FB driver for the PCD8544 LCD Controller
  *
- * The display is monochrome and the video memory is RGB565.
- * Any pixel value except 0 turns the pixel on.
+ * The display is monochrome and so is the video memory, 1 bpp. With the
+ * rgb565 parameter of fbtft it is RGB565 instead, and any pixel brighter
+ * than threshold turns the pixel on.
  *
  * Copyright (C) 2013 Noralf Tronnes
  *
@@ -44,11 +45,22 @@ static unsigned bs = 4;
 module_param(bs, uint, 0);
 MODULE_PARM_DESC(bs, "BS[2:0] Bias voltage level: 0-7 (default: 4)");
 
+static unsigned threshold = 0;
+module_param(threshold, uint, 0);
+MODULE_PARM_DESC(threshold,
+	"With RGB565 video memory: luma (0-65535) above which a pixel is on (default: 0, anything but black)");
+
 
 static int init_display(struct fbtft_par *par)
 {
+	int ret;
+
 	fbtft_par_dbg(DEBUG_INIT_DISPLAY, par, "%s()\n", __func__);
 
+	ret = fbtft_conv_init(par, 2, min(threshold, 0xFFFFU), NULL);
+	if (ret)
+		return ret;
+
 	par->fbtftops.reset(par);
 
 	/* Function set */
@@ -75,9 +87,9 @@ static int init_display(struct fbtft_par *par)
 	                      */
 
 	/* Function set */
-	write_reg(par, 0x22); /* 5:1  1
+	write_reg(par, 0x20); /* 5:1  1
 	                         2:0  PD - Powerdown control: chip is active
-							 1:1  V  - Entry mode: vertical addressing
+							 1:0  V  - Entry mode: horizontal addressing
 							 0:0  H  - Extended instruction set control: basic
 						  */
 
@@ -97,39 +109,47 @@ static void set_addr_win(struct fbtft_par *par, int xs, int ys, int xe, int ye)
 	fbtft_par_dbg(DEBUG_SET_ADDR_WIN, par, "%s(xs=%d, ys=%d, xe=%d, ye=%d)\n", __func__, xs, ys, xe, ye);
 
 	/* H=0 Set X address of RAM */
-	write_reg(par, 0x80); /* 7:1  1
-	                         6-0: X[6:0] - 0x00
-	                      */
-
-	/* H=0 Set Y address of RAM */
-	write_reg(par, 0x40); /* 7:0  0
-	                         6:1  1
-	                         2-0: Y[2:0] - 0x0
-	                      */
+	write_reg(par, 0x80 | xs); /* 7:1  1
+	                              6-0: X[6:0]
+	                           */
+
+	/* H=0 Set Y address of RAM, the bank of 8 rows ys is in */
+	write_reg(par, 0x40 | (ys / 8)); /* 7:0  0
+	                                    6:1  1
+	                                    2-0: Y[2:0]
+	                                 */
 }
 
+/* sends the banks of 8 rows the lines in offset..offset+len are in */
 static int write_vmem(struct fbtft_par *par, size_t offset, size_t len)
 {
-	u16 *vmem16 = (u16 *)par->info->screen_base;
+	unsigned width = par->panel.width;
+	size_t line_length = par->panel.line_length;
+	u8 *vmem8 = fbtft_vmem(par) + fbtft_line_offset(par, 0);
 	u8 *buf = par->txbuf.buf;
-	int x, y, i;
+	unsigned ys, ye, bank;
+	const u8 *src;
 	int ret = 0;
 
-	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s()\n", __func__);
+	ys = fbtft_offset_line(par, offset);
+	ye = ys + len / line_length - 1;
+
+	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s(ys=%u, ye=%u)\n", __func__,
+		ys, ye);
 
-	for (x=0;x<84;x++) {
-		for (y=0;y<6;y++) {
-			*buf = 0x00;
-			for (i=0;i<8;i++) {
-				*buf |= (vmem16[(y*8+i)*84+x] ? 1 : 0) << i;
-			}
-			buf++;
-		}
+	/* horizontal addressing: one bank after the other */
+	for (bank = ys / 8; bank <= ye / 8; bank++, buf += width) {
+		src = vmem8 + bank * 8 * line_length;
+		if (par->info->var.bits_per_pixel == 1)
+			fbtft_conv_col1(src, line_length, buf, 1, width, false);
+		else
+			fbtft_conv_mono_col(par->conv, (u16 *)src, width,
+				buf, 1, width, false);
 	}
 
 	/* Write data */
 	gpio_set_value(par->gpio.dc, 1);
-	ret = par->fbtftops.write(par, par->txbuf.buf, 6*84);
+	ret = par->fbtftops.write(par, par->txbuf.buf, buf - (u8 *)par->txbuf.buf);
 	if (ret < 0)
 		dev_err(par->info->device, "%s: write failed and returned: %d\n", __func__, ret);
 
@@ -155,6 +175,7 @@ static struct fbtft_display display = {
 	.regwidth = 8,
 	.width = WIDTH,
 	.height = HEIGHT,
+	.bpp = 1,
 	.txbuflen = TXBUFLEN,
 	.gamma_num = 1,
 	.gamma_len = 1,
@@ -15,11 +15,28 @@
 #define GAMMA_LEN   15
 #define DEFAULT_GAMMA "7 1 1 1 1 2 2 3 3 4 4 5 5 6 6"
 
+static unsigned short gray[15];
+static int gray_num;
+module_param_array(gray, ushort, &gray_num, 0);
+MODULE_PARM_DESC(gray,
+	"With RGB565 video memory: luma (0-65535) where each of the gray levels 1-15 starts, ascending (default: evenly spaced)");
+
 #ifndef dev_fmt
 #define dev_fmt(fmt) fmt
 #endif
 
 static int init_display(struct fbtft_par *par) {
+	int ret;
+
+	if (gray_num && gray_num != ARRAY_SIZE(gray))
+		dev_warn(par->info->device,
+			"gray needs %zu values, using evenly spaced levels\n",
+			ARRAY_SIZE(gray));
+	ret = fbtft_conv_init(par, 16, 0,
+		gray_num == ARRAY_SIZE(gray) ? gray : NULL);
+	if (ret)
+		return ret;
+
 	par->fbtftops.reset(par);
 	gpio_set_value(par->gpio.cs, 0);
 
@@ -48,12 +65,13 @@ static int init_display(struct fbtft_par *par) {
 
 static void set_addr_win(struct fbtft_par *par, int xs, int ys, int xe, int ye)
 {
-	int width = par->info->var.xres;
+	int width = par->panel.width;
 	int offset = (480 - width) / 8;
 
 	fbtft_par_dbg(DEBUG_SET_ADDR_WIN, par, "%s(xs=%d, ys=%d, xe=%d, ye=%d)\n", __func__, xs, ys, xe, ye);
 
-	write_reg(par, 0x15, offset, offset + (width / 4) - 1);
+	/* one column address covers 4 pixels */
+	write_reg(par, 0x15, offset + xs / 4, offset + xe / 4);
 	write_reg(par, 0x75, ys, ye);
 	write_reg(par, 0x5c);
 }
@@ -66,7 +84,7 @@ static void set_addr_win(struct fbtft_par *par, int xs, int ys, int xe, int ye)
 	0 = Setting of GS1 < Setting of GS2 < Setting of GS3..... < Setting of GS14 < Setting of GS15
 
 */
-static int set_gamma(struct fbtft_par *par, u32 *curves)
+static int set_gamma(struct fbtft_par *par, unsigned long *curves)
 {
 	unsigned long tmp[GAMMA_LEN * GAMMA_NUM];
 	int i, acc = 0;
@@ -108,40 +126,27 @@ static int blank(struct fbtft_par *par, bool on)
 }
 
 
-#define CYR     613    /* 2.392 */
-#define CYG     601    /* 2.348 */
-#define CYB     233    /* 0.912 */
-
-static unsigned int rgb565_to_y(unsigned int rgb)
-{
-	rgb = cpu_to_le16(rgb);
-	return CYR * (rgb >> 11) + CYG * (rgb >> 5 & 0x3F) + CYB * (rgb & 0x1F);
-}
-
 static int write_vmem(struct fbtft_par *par, size_t offset, size_t len)
 {
-	u16 *vmem16 = (u16 *)(par->info->screen_base);
-	u8 *buf = par->txbuf.buf;
-	int y, x, bl_height, bl_width;
+	u8 *vmem8 = fbtft_vmem(par);
+	int bl_height, bl_width;
 	int ret = 0;
 
 	/* Set data line beforehand */
-	gpiod_set_value(par->gpio.dc, 1);
+	gpio_set_value(par->gpio.dc, 1);
 
-	/* convert offset to word index from byte index */
-	offset /= 2;
-	bl_width = par->info->var.xres;
-	bl_height = len / par->info->fix.line_length;
+	bl_width = par->panel.width;
+	bl_height = len / par->panel.line_length;
 
 	fbtft_par_dbg(DEBUG_WRITE_VMEM, par,
 		"%s(offset=%zu, len=%zu)\n", __func__, offset, len);
 
-	for (y = 0; y < bl_height; y++) {
-		for (x = 0; x < bl_width / 2; x++) {
-			*buf = cpu_to_le16(rgb565_to_y(vmem16[offset++])) >> 8 & 0xF0;
-			*buf++ |= cpu_to_le16(rgb565_to_y(vmem16[offset++])) >> 12;
-		}
-	}
+	/* whole lines, two pixels per byte */
+	if (par->info->var.bits_per_pixel == 4)
+		fbtft_conv_gray4_native(vmem8 + offset, par->txbuf.buf, len);
+	else
+		fbtft_conv_gray4(par->conv, (u16 *)(vmem8 + offset),
+			par->txbuf.buf, bl_width * bl_height);
 
 	/* Write data */
 	ret = par->fbtftops.write(par, par->txbuf.buf, bl_width/2*bl_height);
@@ -155,6 +160,7 @@ static struct fbtft_display display = {
 	.regwidth = 8,
 	.width = WIDTH,
 	.height = HEIGHT,
+	.bpp = 4,
 	.txbuflen = WIDTH*HEIGHT/2,
 	.gamma_num = GAMMA_NUM,
 	.gamma_len = GAMMA_LEN,
@@ -168,7 +174,7 @@ static struct fbtft_display display = {
 	},
 };
 
-FBTFT_REGISTER_DRIVER(DRVNAME,"soloman,ssd1322", &display);
+FBTFT_REGISTER_DRIVER(DRVNAME, &display);
 
 MODULE_ALIAS("spi:" DRVNAME);
 MODULE_ALIAS("platform:" DRVNAME);
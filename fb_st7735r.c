@@ -181,6 +181,7 @@ static struct fbtft_display display = {
 		.set_addr_win = set_addr_win,
 		.set_var = set_var,
 		.set_gamma = set_gamma,
+		.set_tear = fbtft_set_tear,
 	},
 };
 FBTFT_REGISTER_DRIVER(DRVNAME, &display);
@@ -59,7 +59,7 @@ void func(struct fbtft_par *par, int len, ...)                                \
 		}                                                             \
 		if (par->gpio.dc != -1)                                       \
 			gpio_set_value(par->gpio.dc, 1);                      \
-		ret = par->fbtftops.write(par, par->buf, len * (sizeof(type)+offset)); \
+		ret = par->fbtftops.write(par, par->buf, len * sizeof(type) + offset); \
 		if (ret < 0) {                                                \
 			va_end(args);                                         \
 			dev_err(par->info->device, "%s: write() failed and returned %d\n", __func__, ret); \
@@ -120,6 +120,286 @@ EXPORT_SYMBOL(fbtft_write_reg8_bus9);
 
 
 
+/*****************************************************************************
+ *
+ *   24/32 bpp video memory and RGB666 controllers
+ *
+ *****************************************************************************/
+
+/* what the controller is sent, see fbtft_pack_rgb() */
+enum fbtft_pack {
+	FBTFT_PACK_565_BE,	/* 8/9-bit bus */
+	FBTFT_PACK_666,		/* 8/9-bit bus, controller set to 18-bit */
+	FBTFT_PACK_565,		/* 16-bit bus */
+};
+
+/* pixel @i of video memory as 0x00RRGGBB */
+static inline u32 fbtft_rgb_px(const u8 *src, unsigned src_bpp, size_t i)
+{
+	u16 c;
+
+	switch (src_bpp) {
+	case 4:
+		return ((const u32 *)src)[i];
+	case 3:
+		src += i * 3;
+		return src[0] | src[1] << 8 | src[2] << 16;
+	default:
+		c = ((const u16 *)src)[i];
+		return (c & 0xf800) << 8 | (c & 0xe000) << 3 |
+		       (c & 0x07e0) << 5 | (c & 0x0600) >> 1 |
+		       (c & 0x001f) << 3 | (c & 0x001c) >> 2;
+	}
+}
+
+/*
+ * Converts @n pixels of @src_bpp bytes in one pass. The loops are kept
+ * free of branches on the pixel values so the compiler can vectorize
+ * them. Returns the number of bytes written to @dst.
+ */
+static size_t fbtft_pack_rgb(u8 *dst, const u8 *src, size_t n,
+				unsigned src_bpp, enum fbtft_pack pack)
+{
+	const u16 *src16 = (const u16 *)src;
+	u16 *dst16 = (u16 *)dst;
+	size_t i;
+	u32 p;
+
+	/* RGB565 with the overlay composed in, as it is or byte swapped */
+	if (src_bpp == 2 && pack == FBTFT_PACK_565) {
+		memcpy(dst, src, n * 2);
+		return n * 2;
+	}
+
+	switch (pack) {
+	case FBTFT_PACK_565_BE:
+		if (src_bpp == 2) {
+			for (i = 0; i < n; i++)
+				dst16[i] = cpu_to_be16(src16[i]);
+			return n * 2;
+		}
+		for (i = 0; i < n; i++) {
+			p = fbtft_rgb_px(src, src_bpp, i);
+			dst16[i] = cpu_to_be16((p >> 8 & 0xf800) |
+					(p >> 5 & 0x07e0) | (p >> 3 & 0x001f));
+		}
+		return n * 2;
+	case FBTFT_PACK_666:
+		for (i = 0; i < n; i++) {
+			p = fbtft_rgb_px(src, src_bpp, i);
+			dst[i * 3] = p >> 16 & 0xfc;
+			dst[i * 3 + 1] = p >> 8 & 0xfc;
+			dst[i * 3 + 2] = p & 0xfc;
+		}
+		return n * 3;
+	case FBTFT_PACK_565:
+		for (i = 0; i < n; i++) {
+			p = fbtft_rgb_px(src, src_bpp, i);
+			dst16[i] = (p >> 8 & 0xf800) | (p >> 5 & 0x07e0) |
+				   (p >> 3 & 0x001f);
+		}
+		return n * 2;
+	}
+
+	return 0;
+}
+
+/*
+ * Overlay plane, see fbtft-overlay.c. It's composed over the pixels being
+ * converted, so only the lines written are recomposed and video memory
+ * keeps the background.
+ */
+
+/* true if the overlay covers part of video memory @offset..@len */
+static bool fbtft_overlay_hit(struct fbtft_par *par, size_t offset,
+				size_t len)
+{
+	struct fbtft_overlay *ov = par->overlay;
+	unsigned first, last;
+
+	if (!ov || !ov->visible || !ov->alpha || !len)
+		return false;
+
+	first = fbtft_offset_line(par, offset);
+	last = fbtft_offset_line(par, offset + len - 1);
+
+	return first < ov->y + ov->height && last >= ov->y;
+}
+
+/* blends @n overlay pixels @src over @n pixels of @dst_bpp bytes */
+static void fbtft_overlay_blend(const struct fbtft_overlay *ov, u8 *dst,
+				unsigned dst_bpp, const u16 *src, size_t n)
+{
+	/* 255 is opaque */
+	u32 a = ov->alpha + (ov->alpha >> 7);
+	u32 o, b, p;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (src[i] == ov->colorkey)
+			continue;
+		o = fbtft_rgb_px((const u8 *)src, 2, i);
+		b = fbtft_rgb_px(dst, dst_bpp, i);
+		p = ((o & 0xff00ff) * a + (b & 0xff00ff) * (256 - a)) >> 8 &
+			0xff00ff;
+		p |= ((o & 0x00ff00) * a + (b & 0x00ff00) * (256 - a)) >> 8 &
+			0x00ff00;
+
+		switch (dst_bpp) {
+		case 4:
+			((u32 *)dst)[i] = p | (b & 0xff000000);
+			break;
+		case 3:
+			dst[i * 3] = p;
+			dst[i * 3 + 1] = p >> 8;
+			dst[i * 3 + 2] = p >> 16;
+			break;
+		default:
+			((u16 *)dst)[i] = (p >> 8 & 0xf800) |
+					(p >> 5 & 0x07e0) | (p >> 3 & 0x001f);
+		}
+	}
+}
+
+/*
+ * Composes the overlay over the @n pixels at video memory @offset, @src.
+ * Returns @src if the overlay isn't among them, else the composed copy.
+ */
+static const u8 *fbtft_overlay_compose(struct fbtft_par *par, size_t offset,
+				const u8 *src, size_t n)
+{
+	struct fbtft_overlay *ov = par->overlay;
+	unsigned bpp = par->info->var.bits_per_pixel / 8;
+	size_t xres = par->info->var.xres;
+	size_t first = (offset - fbtft_line_offset(par, 0)) / bpp;
+	size_t last = first + n;
+	size_t right = min_t(size_t, ov->x + ov->width, xres);
+	const u8 *ov_vmem = (const u8 __force *)ov->info->screen_base;
+	size_t ov_line_length = ov->info->fix.line_length;
+	bool composed = false;
+	size_t y, start, end;
+
+	for (y = first / xres; y <= (last - 1) / xres; y++) {
+		if (y < ov->y || y >= ov->y + ov->height)
+			continue;
+		start = max(first, y * xres + ov->x);
+		end = min(last, y * xres + right);
+		if (start >= end)
+			continue;
+		if (!composed) {
+			memcpy(ov->buf, src, n * bpp);
+			composed = true;
+		}
+		fbtft_overlay_blend(ov, ov->buf + (start - first) * bpp, bpp,
+			(const u16 *)(ov_vmem + (y - ov->y) * ov_line_length) +
+				start - y * xres - ov->x,
+			end - start);
+	}
+
+	return composed ? ov->buf : src;
+}
+
+/*
+ * Writes video memory that isn't RGB565, to a controller that doesn't
+ * take RGB565 or with the overlay over it, converting while filling
+ * txbuf. @buswidth is 8, 9 or 16.
+ */
+static int fbtft_write_vmem_rgb(struct fbtft_par *par, size_t offset,
+				size_t len, unsigned buswidth)
+{
+	unsigned src_bpp = par->info->var.bits_per_pixel / 8;
+	u8 *src = fbtft_vmem(par) + offset;
+	u8 *txbuf = par->txbuf.buf;
+	size_t tx_len = par->txbuf.len;
+	size_t startbyte_size = 0;
+	size_t remain = len / src_bpp;
+	size_t to_copy, n;
+	const u8 *p;
+	enum fbtft_pack pack;
+	unsigned tx_bpp;
+	u16 *txbuf16;
+	int ret = 0;
+	int i;
+
+	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s(offset=%zu, len=%zu)\n",
+		__func__, offset, len);
+
+	if (!txbuf) {
+		dev_err(par->info->device, "%s: txbuf.buf is NULL\n", __func__);
+		return -EINVAL;
+	}
+
+	if (buswidth == 16)
+		pack = FBTFT_PACK_565;
+	else if (par->rgb666)
+		pack = FBTFT_PACK_666;
+	else
+		pack = FBTFT_PACK_565_BE;
+	tx_bpp = pack == FBTFT_PACK_666 ? 3 : 2;
+	/* 9-bit words carry one byte each */
+	if (buswidth == 9)
+		tx_bpp *= 2;
+
+	if (buswidth != 9 && par->gpio.dc != -1)
+		gpio_set_value(par->gpio.dc, 1);
+
+	if (buswidth == 8 && par->startbyte) {
+		*txbuf = par->startbyte | 0x2;
+		txbuf++;
+		tx_len--;
+		startbyte_size = 1;
+	}
+
+	while (remain) {
+		to_copy = min(remain, tx_len / tx_bpp);
+		p = src;
+		if (par->overlay) {
+			to_copy = min(to_copy, par->overlay->buflen / src_bpp);
+			p = fbtft_overlay_compose(par, src - fbtft_vmem(par),
+							src, to_copy);
+		}
+		n = fbtft_pack_rgb(txbuf, p, to_copy, src_bpp, pack);
+		if (buswidth == 9) {
+			/* widen in place, from the end, adding dc=1 */
+			txbuf16 = (u16 *)txbuf;
+			for (i = n - 1; i >= 0; i--)
+				txbuf16[i] = 0x0100 | txbuf[i];
+			n *= 2;
+		}
+
+		src += to_copy * src_bpp;
+		ret = par->fbtftops.write(par, par->txbuf.buf,
+						startbyte_size + n);
+		if (ret < 0)
+			return ret;
+		remain -= to_copy;
+	}
+
+	return ret;
+}
+
+/* true if vmem @offset..@len has to go through fbtft_write_vmem_rgb() */
+static inline bool fbtft_vmem_converted(struct fbtft_par *par, size_t offset,
+					size_t len)
+{
+	return par->info->var.bits_per_pixel != 16 || par->rgb666 ||
+		fbtft_overlay_hit(par, offset, len);
+}
+
+/**
+ * fbtft_rgb_capable() - Can 24/32 bpp video memory be written
+ * @par: Driver data
+ *
+ * Return: true if write_vmem() is one of the generic RGB565 functions and
+ * there's a transmit buffer to convert into
+ */
+bool fbtft_rgb_capable(struct fbtft_par *par)
+{
+	return fbtft_write_vmem_generic(par) && par->txbuf.buf;
+}
+EXPORT_SYMBOL(fbtft_rgb_capable);
+
+
 /*****************************************************************************
  *
  *   int (*write_vmem)(struct fbtft_par *par);
@@ -141,8 +421,11 @@ int fbtft_write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s(offset=%zu, len=%zu)\n",
 		__func__, offset, len);
 
+	if (fbtft_vmem_converted(par, offset, len))
+		return fbtft_write_vmem_rgb(par, offset, len, 8);
+
 	remain = len / 2;
-	vmem16 = (u16 *)(par->info->screen_base + offset);
+	vmem16 = (u16 *)(fbtft_vmem(par) + offset);
 
 	if (par->gpio.dc != -1)
 		gpio_set_value(par->gpio.dc, 1);
@@ -200,8 +483,11 @@ int fbtft_write_vmem16_bus9(struct fbtft_par *par, size_t offset, size_t len)
 		return -1;
 	}
 
+	if (fbtft_vmem_converted(par, offset, len))
+		return fbtft_write_vmem_rgb(par, offset, len, 9);
+
 	remain = len;
-	vmem8 = par->info->screen_base + offset;
+	vmem8 = fbtft_vmem(par) + offset;
 
 	tx_array_size = par->txbuf.len / 2;
 
@@ -245,7 +531,10 @@ int fbtft_write_vmem16_bus16(struct fbtft_par *par, size_t offset, size_t len)
 	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s(offset=%zu, len=%zu)\n",
 		__func__, offset, len);
 
-	vmem16 = (u16 *)(par->info->screen_base + offset);
+	if (fbtft_vmem_converted(par, offset, len))
+		return fbtft_write_vmem_rgb(par, offset, len, 16);
+
+	vmem16 = (u16 *)(fbtft_vmem(par) + offset);
 
 	if (par->gpio.dc != -1)
 		gpio_set_value(par->gpio.dc, 1);
@@ -254,3 +543,15 @@ int fbtft_write_vmem16_bus16(struct fbtft_par *par, size_t offset, size_t len)
 	return par->fbtftops.write(par, vmem16, len);
 }
 EXPORT_SYMBOL(fbtft_write_vmem16_bus16);
+
+/*
+ * true if write_vmem() is one of the generic functions above, which write
+ * exactly the offset..len they're given and can be called piecewise
+ */
+bool fbtft_write_vmem_generic(struct fbtft_par *par)
+{
+	return par->fbtftops.write_vmem == fbtft_write_vmem16_bus8 ||
+	       par->fbtftops.write_vmem == fbtft_write_vmem16_bus9 ||
+	       par->fbtftops.write_vmem == fbtft_write_vmem16_bus16;
+}
+EXPORT_SYMBOL(fbtft_write_vmem_generic);
@@ -0,0 +1,285 @@
+/*
+ * RGB565 to gray and mono conversion for the packed pixel controllers
+ *
+ * Luma (Y = 2.392 R + 2.348 G + 0.912 B on the 5/6/5 bit values, so
+ * 0-64089) is linear, so it is the sum of a lookup with the high byte of
+ * the pixel and one with the low byte. The tables are 1 KiB together and
+ * stay in L1. A gray level is then one more lookup with the top 8 bits of
+ * luma, a mono pixel a compare with the threshold.
+ *
+ * The batch functions write the packed format the controllers take
+ * straight from a run of pixels:
+ *
+ *   fbtft_conv_gray4()     4 bits per pixel, first pixel in the high nibble
+ *   fbtft_conv_mono()      1 bit per pixel, first pixel in bit 7
+ *   fbtft_conv_mono_col()  8 rows to one byte per column, for the
+ *                          controllers with vertical byte addressing
+ *
+ * They work on native endian vmem and take 8 pixels per step.
+ *
+ * Displays with 1 and 4 bpp video memory only need the pixels put in the
+ * controller's order: fbtft_conv_col1() and fbtft_conv_gray4_native().
+ * Video memory has the pixel order the fbdev drawing functions use, the
+ * first pixel in the low bits of a byte on little endian hosts and in the
+ * high bits on big endian.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/export.h>
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "fbtft.h"
+
+#ifdef __LITTLE_ENDIAN
+/* byte of a transposed tile that has the column of pixel i */
+#define COL1_SHIFT(i)	(8 * (i))
+#else
+#define COL1_SHIFT(i)	(56 - 8 * (i))
+#endif
+
+/* luma weights in 8.8 fixed point */
+#define CONV_WR		613	/* 2.392 */
+#define CONV_WG		601	/* 2.348 */
+#define CONV_WB		233	/* 0.912 */
+
+/**
+ * fbtft_conv_init() - Set up the conversion tables of a device
+ * @par: Driver data
+ * @levels: Gray levels, 2-16
+ * @threshold: Luma (0-65535) above which a mono pixel is set
+ * @steps: Luma where each of the gray levels 1 to @levels-1 starts, in
+ *         ascending order, NULL for evenly spaced levels. Resolved to
+ *         1/256 of the luma range.
+ *
+ * Can be called again to change the settings.
+ *
+ * Return: 0, or -ENOMEM or -EINVAL
+ */
+int fbtft_conv_init(struct fbtft_par *par, unsigned levels, u16 threshold,
+							const u16 *steps)
+{
+	struct fbtft_conv *conv = par->conv;
+	unsigned i, level = 0;
+
+	if (levels < 2 || levels > 16)
+		return -EINVAL;
+
+	if (!conv) {
+		conv = kzalloc(sizeof(*conv), GFP_KERNEL);
+		if (!conv)
+			return -ENOMEM;
+		par->conv = conv;
+	}
+
+	for (i = 0; i < 256; i++) {
+		/* RRRRRGGG GGGBBBBB */
+		conv->hi[i] = CONV_WR * (i >> 3) + CONV_WG * 8 * (i & 7);
+		conv->lo[i] = CONV_WG * (i >> 5) + CONV_WB * (i & 0x1F);
+
+		if (steps) {
+			while (level < levels - 1 && (i << 8) >= steps[level])
+				level++;
+			conv->level[i] = level;
+		} else {
+			conv->level[i] = i * levels >> 8;
+		}
+	}
+	conv->threshold = threshold;
+
+	return 0;
+}
+EXPORT_SYMBOL(fbtft_conv_init);
+
+static inline unsigned fbtft_conv_luma(const struct fbtft_conv *conv, u16 rgb)
+{
+	return conv->hi[rgb >> 8] + conv->lo[rgb & 0xFF];
+}
+
+static inline unsigned fbtft_conv_level(const struct fbtft_conv *conv,
+								u16 rgb)
+{
+	return conv->level[fbtft_conv_luma(conv, rgb) >> 8];
+}
+
+static inline unsigned fbtft_conv_bit(const struct fbtft_conv *conv, u16 rgb)
+{
+	return fbtft_conv_luma(conv, rgb) > conv->threshold;
+}
+
+/**
+ * fbtft_conv_gray4() - Convert pixels to 4-bit gray
+ * @conv: Conversion tables
+ * @src: Pixels
+ * @dst: Output, (@len + 1) / 2 bytes
+ * @len: Number of pixels
+ */
+void fbtft_conv_gray4(const struct fbtft_conv *conv, const u16 *src, u8 *dst,
+								size_t len)
+{
+	for (; len >= 8; len -= 8, src += 8, dst += 4) {
+		dst[0] = fbtft_conv_level(conv, src[0]) << 4 |
+			 fbtft_conv_level(conv, src[1]);
+		dst[1] = fbtft_conv_level(conv, src[2]) << 4 |
+			 fbtft_conv_level(conv, src[3]);
+		dst[2] = fbtft_conv_level(conv, src[4]) << 4 |
+			 fbtft_conv_level(conv, src[5]);
+		dst[3] = fbtft_conv_level(conv, src[6]) << 4 |
+			 fbtft_conv_level(conv, src[7]);
+	}
+	for (; len >= 2; len -= 2, src += 2)
+		*dst++ = fbtft_conv_level(conv, src[0]) << 4 |
+			 fbtft_conv_level(conv, src[1]);
+	if (len)
+		*dst = fbtft_conv_level(conv, src[0]) << 4;
+}
+EXPORT_SYMBOL(fbtft_conv_gray4);
+
+/* 8 pixels to a byte, the first in bit 7 */
+static inline u8 fbtft_conv_mono8(const struct fbtft_conv *conv,
+							const u16 *src)
+{
+	return fbtft_conv_bit(conv, src[0]) << 7 |
+	       fbtft_conv_bit(conv, src[1]) << 6 |
+	       fbtft_conv_bit(conv, src[2]) << 5 |
+	       fbtft_conv_bit(conv, src[3]) << 4 |
+	       fbtft_conv_bit(conv, src[4]) << 3 |
+	       fbtft_conv_bit(conv, src[5]) << 2 |
+	       fbtft_conv_bit(conv, src[6]) << 1 |
+	       fbtft_conv_bit(conv, src[7]);
+}
+
+/**
+ * fbtft_conv_mono() - Convert pixels to 1 bit per pixel
+ * @conv: Conversion tables
+ * @src: Pixels
+ * @dst: Output, (@len + 7) / 8 bytes
+ * @len: Number of pixels
+ */
+void fbtft_conv_mono(const struct fbtft_conv *conv, const u16 *src, u8 *dst,
+								size_t len)
+{
+	unsigned i;
+	u8 byte;
+
+	for (; len >= 8; len -= 8, src += 8)
+		*dst++ = fbtft_conv_mono8(conv, src);
+	if (len) {
+		for (byte = 0, i = 0; i < len; i++)
+			byte |= fbtft_conv_bit(conv, src[i]) << (7 - i);
+		*dst = byte;
+	}
+}
+EXPORT_SYMBOL(fbtft_conv_mono);
+
+/**
+ * fbtft_conv_mono_col() - Convert 8 rows of pixels to a byte per column
+ * @conv: Conversion tables
+ * @src: First pixel of the top row
+ * @stride: Pixels from one row to the next
+ * @dst: Byte of the first column
+ * @step: Bytes from one column's byte to the next
+ * @len: Number of columns
+ * @top_msb: Top row in bit 7, else in bit 0
+ *
+ * Works on tiles of 8x8 pixels from left to right: each row of a tile is
+ * thresholded to a byte like fbtft_conv_mono() does, and the tile is
+ * transposed in a register. The 8 rows are each read in order, a cache
+ * line once.
+ */
+void fbtft_conv_mono_col(const struct fbtft_conv *conv, const u16 *src,
+		size_t stride, u8 *dst, size_t step, size_t len, bool top_msb)
+{
+	unsigned i, shift;
+	size_t x;
+	u64 tile;
+	u8 byte;
+
+	for (x = 0; x + 8 <= len; x += 8, src += 8, dst += 8 * step) {
+		/* the row that goes to bit 7 in the top byte */
+		tile = 0;
+		for (i = 0; i < 8; i++)
+			tile = tile << 8 | fbtft_conv_mono8(conv,
+				src + (top_msb ? i : 7 - i) * stride);
+
+		tile = fbtft_transpose8(tile);
+
+		for (i = 0; i < 8; i++)
+			dst[i * step] = tile >> (56 - 8 * i);
+	}
+
+	/* the columns that don't fill a tile */
+	for (; x < len; x++, src++, dst += step) {
+		for (byte = 0, i = 0; i < 8; i++) {
+			shift = top_msb ? 7 - i : i;
+			byte |= fbtft_conv_bit(conv, src[i * stride]) << shift;
+		}
+		*dst = byte;
+	}
+}
+EXPORT_SYMBOL(fbtft_conv_mono_col);
+
+/**
+ * fbtft_conv_col1() - Turn 8 rows of 1 bpp video memory to a byte per column
+ * @src: First byte of the top row
+ * @pitch: Bytes from one row to the next
+ * @dst: Byte of the first column
+ * @step: Bytes from one column's byte to the next
+ * @len: Number of columns
+ * @top_msb: Top row in bit 7, else in bit 0
+ *
+ * Each byte of the 8 rows is an 8x8 tile, transposed like in
+ * fbtft_conv_mono_col().
+ */
+void fbtft_conv_col1(const u8 *src, size_t pitch, u8 *dst, size_t step,
+						size_t len, bool top_msb)
+{
+	unsigned i, n;
+	size_t x;
+	u64 tile;
+
+	for (x = 0; x < len; x += 8, src++) {
+		tile = 0;
+		for (i = 0; i < 8; i++)
+			tile = tile << 8 | src[(top_msb ? i : 7 - i) * pitch];
+
+		tile = fbtft_transpose8(tile);
+
+		n = min_t(size_t, len - x, 8);
+		for (i = 0; i < n; i++, dst += step)
+			*dst = tile >> COL1_SHIFT(i);
+	}
+}
+EXPORT_SYMBOL(fbtft_conv_col1);
+
+/**
+ * fbtft_conv_gray4_native() - Copy 4 bpp video memory in controller order
+ * @src: Video memory
+ * @dst: Output
+ * @len: Number of bytes
+ *
+ * The controllers take the first pixel in the high nibble, which on little
+ * endian hosts means swapping the nibbles of each byte.
+ */
+void fbtft_conv_gray4_native(const u8 *src, u8 *dst, size_t len)
+{
+#ifdef __LITTLE_ENDIAN
+	u32 v;
+
+	for (; len >= 4; len -= 4, src += 4, dst += 4) {
+		memcpy(&v, src, 4);
+		v = (v & 0x0F0F0F0F) << 4 | (v >> 4 & 0x0F0F0F0F);
+		memcpy(dst, &v, 4);
+	}
+	for (; len; len--, src++)
+		*dst++ = *src << 4 | *src >> 4;
+#else
+	memcpy(dst, src, len);
+#endif
+}
+EXPORT_SYMBOL(fbtft_conv_gray4_native);
@@ -36,6 +36,7 @@
 #include <linux/backlight.h>
 #include <linux/platform_device.h>
 #include <linux/spinlock.h>
+#include <linux/ktime.h>
 
 #include "fbtft.h"
 
@@ -49,6 +50,51 @@ static unsigned long debug;
 module_param(debug, ulong , 0);
 MODULE_PARM_DESC(debug, "override device debug level");
 
+static unsigned trace;
+module_param(trace, uint, 0);
+MODULE_PARM_DESC(trace,
+"Capture bus messages in a ring of this many records (debugfs, default: 0=off)");
+
+static unsigned trace_payload = FBTFT_TRACE_DATA_LEN;
+module_param(trace_payload, uint, 0);
+MODULE_PARM_DESC(trace_payload,
+"Payload bytes captured per trace record (max/default: 12)");
+
+static unsigned bands = 8;
+module_param(bands, uint, 0);
+MODULE_PARM_DESC(bands,
+"Split display updates in this many bands and write small new damage " \
+"between them (default: 8, 0/1=off)");
+
+static unsigned max_bpp;
+module_param(max_bpp, uint, 0);
+MODULE_PARM_DESC(max_bpp,
+"Size video memory for 24 or 32 bpp, selectable with FBIOPUT_VSCREENINFO " \
+"on RGB565 displays (default: 0=display bpp)");
+
+static bool rgb565;
+module_param(rgb565, bool, 0);
+MODULE_PARM_DESC(rgb565,
+"Use RGB565 video memory on gray and mono displays instead of their " \
+"native 1, 4 or 8 bpp (default: off)");
+
+static unsigned buffers = 1;
+module_param(buffers, uint, 0);
+MODULE_PARM_DESC(buffers,
+"Video memory for this many frames, to flip between with " \
+"FBIOPAN_DISPLAY (1-3, default: 1)");
+
+static bool overlay;
+module_param(overlay, bool, 0);
+MODULE_PARM_DESC(overlay,
+"Register a second framebuffer per RGB565 display as an overlay plane " \
+"over it (default: off)");
+
+static bool selftest;
+module_param(selftest, bool, 0);
+MODULE_PARM_DESC(selftest,
+"Measure bus throughput and achievable fps when a display is registered");
+
 
 void fbtft_dbg_hex(const struct device *dev, int groupsize,
 			void *buf, size_t len, const char *fmt, ...)
@@ -99,6 +145,9 @@ unsigned long fbtft_request_gpios_match(struct fbtft_par *par,
 	} else if (strcasecmp(gpio->name, "latch") == 0) {
 		par->gpio.latch = gpio->gpio;
 		return GPIOF_OUT_INIT_LOW;
+	} else if (strcasecmp(gpio->name, "te") == 0) {
+		par->gpio.te = gpio->gpio;
+		return GPIOF_IN;
 	} else if (gpio->name[0] == 'd' && gpio->name[1] == 'b') {
 		ret = kstrtol(&gpio->name[2], 10, &val);
 		if (ret == 0 && val < 16) {
@@ -128,6 +177,7 @@ int fbtft_request_gpios(struct fbtft_par *par)
 	par->gpio.wr = -1;
 	par->gpio.cs = -1;
 	par->gpio.latch = -1;
+	par->gpio.te = -1;
 	for (i = 0; i < 16; i++) {
 		par->gpio.db[i] = -1;
 		par->gpio.led[i] = -1;
@@ -309,12 +359,130 @@ void fbtft_reset(struct fbtft_par *par)
 }
 
 
+/*
+ * Writes lines start_line..end_line in bands. Small damage that comes in
+ * meanwhile, and isn't among the lines still to be written, goes out
+ * between two bands, after which the update resumes where it was.
+ * Returns the number of such urgent lines written in @urgent.
+ */
+static int fbtft_write_bands(struct fbtft_par *par, unsigned start_line,
+				unsigned end_line, unsigned *urgent)
+{
+	struct fb_info *info = par->info;
+	size_t line_length = info->fix.line_length;
+	unsigned band = end_line - start_line + 1;
+	unsigned bs, be, ds = 1, de = 0;
+	bool resume = true;
+	int ret = 0;
+
+	/* only the generic write_vmem() functions write just offset..len */
+	if (bands > 1 && fbtft_write_vmem_generic(par))
+		band = max_t(unsigned, 1, DIV_ROUND_UP(info->var.yres, bands));
+
+	for (bs = start_line; bs <= end_line; bs = be + 1) {
+		be = min(bs + band - 1, end_line);
+
+		spin_lock(&par->dirty_lock);
+		par->inflight.next = be + 1;
+		par->inflight.end = end_line;
+		ds = par->dirty_lines_start;
+		de = par->dirty_lines_end;
+		/* not while a flip waits, they'd come from the old frame */
+		if (bs != start_line && ds <= de && de - ds < band &&
+				!par->pan.pending) {
+			par->dirty_lines_start = info->var.yres - 1;
+			par->dirty_lines_end = 0;
+		} else {
+			de = 0;
+			ds = 1;
+		}
+		spin_unlock(&par->dirty_lock);
+
+		if (ds <= de) {
+			if (par->fbtftops.set_addr_win)
+				par->fbtftops.set_addr_win(par, 0, ds,
+						info->var.xres - 1, de);
+			ret = par->fbtftops.write_vmem(par,
+						fbtft_line_offset(par, ds),
+						(de - ds + 1) * line_length);
+			if (ret < 0)
+				break;
+			*urgent += de - ds + 1;
+			de = 0;
+			ds = 1;
+			resume = true;
+		}
+
+		if (resume && par->fbtftops.set_addr_win)
+			par->fbtftops.set_addr_win(par, 0, bs,
+					info->var.xres - 1, end_line);
+		resume = false;
+		ret = par->fbtftops.write_vmem(par, fbtft_line_offset(par, bs),
+					(be - bs + 1) * line_length);
+		if (ret < 0)
+			break;
+	}
+
+	spin_lock(&par->dirty_lock);
+	/*
+	 * fbtft_mkdirty() dropped damage to the lines that were still to be
+	 * written, and the urgent lines were taken off the dirty range. Put
+	 * back what didn't make it, so it's written with the next update.
+	 */
+	if (ret < 0) {
+		if (ds <= de) {
+			par->dirty_lines_start = min(par->dirty_lines_start, ds);
+			par->dirty_lines_end = max(par->dirty_lines_end, de);
+		}
+		par->dirty_lines_start = min(par->dirty_lines_start, bs);
+		par->dirty_lines_end = max(par->dirty_lines_end, end_line);
+	}
+	par->inflight.next = 1;
+	par->inflight.end = 0;
+	spin_unlock(&par->dirty_lock);
+
+	if (ret < 0)
+		schedule_delayed_work(&info->deferred_work,
+					info->fbdefio->delay);
+
+	return ret;
+}
+
+/* account for a display update of panel lines that started at @start ns */
+void fbtft_update_stats(struct fbtft_par *par, unsigned lines,
+				unsigned urgent, u64 start, int te)
+{
+	size_t line_length = par->panel.line_length;
+	u64 done = ktime_to_ns(ktime_get());
+
+	spin_lock(&par->dirty_lock);
+	par->stats.frames++;
+	par->stats.lines += lines + urgent;
+	par->stats.bytes += (lines + urgent) * line_length;
+	par->stats.urgent_lines += urgent;
+	par->stats.busy_ns += done - start;
+	par->stats.last_ns = done - start;
+	par->stats.last_done = done;
+	if (te == 0)
+		par->stats.te_synced++;
+	else if (te > 0)
+		par->stats.te_late++;
+	else if (te == -ETIMEDOUT)
+		par->stats.te_unsynced++;
+	spin_unlock(&par->dirty_lock);
+}
+EXPORT_SYMBOL(fbtft_update_stats);
+
 void fbtft_update_display(struct fbtft_par *par, unsigned start_line, unsigned end_line)
 {
-	size_t offset, len;
 	struct timespec ts_start, ts_end, test_of_time;
 	long ms, us, ns;
 	bool timeit = false;
+	u64 start;
+	unsigned urgent = 0;
+	unsigned lines;
+	u64 seq;
+	int te = -ENODEV;
 	int ret = 0;
 
 	if (unlikely(par->debug & (DEBUG_TIME_FIRST_UPDATE | DEBUG_TIME_EACH_UPDATE))) {
@@ -344,18 +512,38 @@ void fbtft_update_display(struct fbtft_par *par, unsigned start_line, unsigned e
 	fbtft_par_dbg(DEBUG_UPDATE_DISPLAY, par, "%s(start_line=%u, end_line=%u)\n",
 		__func__, start_line, end_line);
 
-	if (par->fbtftops.set_addr_win)
-		par->fbtftops.set_addr_win(par, 0, start_line,
-				par->info->var.xres-1, end_line);
-
-	offset = start_line * par->info->fix.line_length;
-	len = (end_line - start_line + 1) * par->info->fix.line_length;
-	ret = par->fbtftops.write_vmem(par, offset, len);
+	mutex_lock(&par->update_lock);
+	seq = fbtft_flush_begin(par);
+
+	lines = end_line - start_line + 1;
+	if (par->panel.buf) {
+		/* the panel lines differ from the frame's, no bands or TE */
+		start = ktime_to_ns(ktime_get());
+		ret = fbtft_rotate_update(par, start_line, end_line);
+		lines = ret;
+	} else if (fbtft_te_chasing(par)) {
+		/* bands written behind the scanline */
+		start = ktime_to_ns(ktime_get());
+		ret = fbtft_te_chase(par, start_line, end_line);
+	} else {
+		if (par->te)
+			te = fbtft_te_sync(par, start_line, end_line);
+
+		start = ktime_to_ns(ktime_get());
+		ret = fbtft_write_bands(par, start_line, end_line, &urgent);
+		if (par->te)
+			fbtft_te_account(par, end_line - start_line + 1,
+					ktime_to_ns(ktime_get()) - start);
+	}
 	if (ret < 0)
 		dev_err(par->info->device,
 			"%s: write_vmem failed to update display buffer\n",
 			__func__);
 
+	fbtft_update_stats(par, ret < 0 ? 0 : lines, urgent, start, te);
+	fbtft_flush_end(par, seq);
+	mutex_unlock(&par->update_lock);
+
 	if (unlikely(timeit)) {
 		getnstimeofday(&ts_end);
 		test_of_time = timespec_sub(ts_end, ts_start);
@@ -377,14 +565,33 @@ void fbtft_mkdirty(struct fb_info *info, int y, int height)
 	struct fbtft_par *par = info->par;
 	struct fb_deferred_io *fbdefio = info->fbdefio;
 
+	spin_lock(&par->dirty_lock);
+
 	/* special case, needed ? */
 	if (y == -1) {
 		y = 0;
 		height = info->var.yres - 1;
+	} else {
+		/* lines of other frames go out when they're panned to */
+		y -= (int)par->pan.yoffset;
+		if (y < 0) {
+			height += y;
+			y = 0;
+		}
+		height = min_t(int, height, info->var.yres - y);
+		if (height <= 0) {
+			spin_unlock(&par->dirty_lock);
+			return;
+		}
 	}
 
 	/* Mark display lines/area as dirty */
-	spin_lock(&par->dirty_lock);
+	if (!par->pan.pending && y >= par->inflight.next &&
+			y + height - 1 <= par->inflight.end) {
+		/* still to be sent by the update in progress */
+		spin_unlock(&par->dirty_lock);
+		return;
+	}
 	if (y < par->dirty_lines_start)
 		par->dirty_lines_start = y;
 	if (y + height - 1 > par->dirty_lines_end)
@@ -402,9 +609,15 @@ void fbtft_deferred_io(struct fb_info *info, struct list_head *pagelist)
 	struct page *page;
 	unsigned long index;
 	unsigned y_low = 0, y_high = 0;
-	int count = 0;
+	unsigned scanout;
 
 	spin_lock(&par->dirty_lock);
+	/* flip to the frame given to fbtft_fb_pan_display() */
+	if (par->pan.pending) {
+		par->pan.scanout = par->pan.yoffset;
+		par->pan.pending = false;
+	}
+	scanout = par->pan.scanout;
 	dirty_lines_start = par->dirty_lines_start;
 	dirty_lines_end = par->dirty_lines_end;
 	/* set display line markers as clean */
@@ -414,21 +627,36 @@ void fbtft_deferred_io(struct fb_info *info, struct list_head *pagelist)
 
 	/* Mark display lines as dirty */
 	list_for_each_entry(page, pagelist, lru) {
-		count++;
+		if (par->flush.no_faults)
+			break;
 		index = page->index << PAGE_SHIFT;
 		y_low = index / info->fix.line_length;
 		y_high = (index + PAGE_SIZE - 1) / info->fix.line_length;
 		fbtft_dev_dbg(DEBUG_DEFERRED_IO, par, info->device,
 			"page->index=%lu y_low=%d y_high=%d\n",
 			page->index, y_low, y_high);
-		if (y_high > info->var.yres - 1)
-			y_high = info->var.yres - 1;
+		/* only lines of the frame being displayed */
+		if (y_high < scanout || y_low > scanout + info->var.yres - 1)
+			continue;
+		y_low = max(y_low, scanout) - scanout;
+		y_high = min(y_high, scanout + info->var.yres - 1) - scanout;
 		if (y_low < dirty_lines_start)
 			dirty_lines_start = y_low;
 		if (y_high > dirty_lines_end)
 			dirty_lines_end = y_high;
 	}
 
+	/*
+	 * already written between the bands of an earlier update, or a
+	 * flip to an identical frame
+	 */
+	if (dirty_lines_start > dirty_lines_end) {
+		mutex_lock(&par->update_lock);
+		fbtft_flush_end(par, fbtft_flush_begin(par));
+		mutex_unlock(&par->update_lock);
+		return;
+	}
+
 	par->fbtftops.update_display(info->par,
 					dirty_lines_start, dirty_lines_end);
 }
@@ -470,19 +698,130 @@ void fbtft_fb_imageblit(struct fb_info *info, const struct fb_image *image)
 	par->fbtftops.mkdirty(info, image->dy, image->height);
 }
 
+/**
+ * fbtft_stream_capable() - Can whole frames be written without vmem
+ * @par: Driver data
+ *
+ * Return: true if write_vmem() is fbtft_write_vmem16_bus8() through a
+ * transmit buffer, which is what fbtft_fb_write_stream() replaces, and
+ * the frame isn't rotated in software
+ */
+bool fbtft_stream_capable(struct fbtft_par *par)
+{
+	return par->fbtftops.write_vmem == fbtft_write_vmem16_bus8 &&
+		par->txbuf.buf && !par->startbyte && !par->rgb666 &&
+		!par->panel.buf;
+}
+
+/*
+ * Converts a whole frame from userspace straight into txbuf and writes it,
+ * instead of going through vmem and a deferred update. Each chunk is also
+ * copied to vmem while it's still in the cache, so that fb_read(), mmap
+ * clients and later partial updates see the frame. Returns when the frame
+ * is on the display, which paces the producer to the bus.
+ */
+static ssize_t fbtft_fb_write_stream(struct fb_info *info,
+				const char __user *buf, size_t count)
+{
+	struct fbtft_par *par = info->par;
+	u16 *txbuf16 = par->txbuf.buf;
+	size_t chunk = par->txbuf.len & ~1;
+	size_t pos, to_copy;
+	int te = -ENODEV;
+	u64 seq, start;
+	int ret = 0;
+	int i;
+
+	if (mutex_lock_interruptible(&par->update_lock))
+		return -ERESTARTSYS;
+	seq = fbtft_flush_begin(par);
+
+	/* the frame replaces whatever damage is pending */
+	spin_lock(&par->dirty_lock);
+	par->dirty_lines_start = info->var.yres - 1;
+	par->dirty_lines_end = 0;
+	spin_unlock(&par->dirty_lock);
+
+	if (par->te)
+		te = fbtft_te_sync(par, 0, info->var.yres - 1);
+
+	start = ktime_to_ns(ktime_get());
+	if (par->fbtftops.set_addr_win)
+		par->fbtftops.set_addr_win(par, 0, 0,
+				info->var.xres - 1, info->var.yres - 1);
+	if (par->gpio.dc != -1)
+		gpio_set_value(par->gpio.dc, 1);
+
+	for (pos = 0; pos < count; pos += to_copy) {
+		to_copy = min(count - pos, chunk);
+		if (copy_from_user(txbuf16, buf + pos, to_copy)) {
+			ret = -EFAULT;
+			break;
+		}
+		memcpy(info->screen_base + pos, txbuf16, to_copy);
+		for (i = 0; i < to_copy / 2; i++)
+			txbuf16[i] = cpu_to_be16(txbuf16[i]);
+		ret = par->fbtftops.write(par, txbuf16, to_copy);
+		if (ret < 0) {
+			dev_err(info->device,
+				"%s: write failed and returned %d\n",
+				__func__, ret);
+			break;
+		}
+	}
+
+	if (par->te)
+		fbtft_te_account(par, info->var.yres,
+				ktime_to_ns(ktime_get()) - start);
+	fbtft_update_stats(par, DIV_ROUND_UP(pos, info->fix.line_length), 0,
+				start, te);
+	spin_lock(&par->dirty_lock);
+	par->stats.stream_frames++;
+	spin_unlock(&par->dirty_lock);
+
+	fbtft_flush_end(par, seq);
+	mutex_unlock(&par->update_lock);
+
+	if (pos)
+		return pos;
+
+	return ret < 0 ? ret : 0;
+}
+
 ssize_t fbtft_fb_write(struct fb_info *info,
 			const char __user *buf, size_t count, loff_t *ppos)
 {
 	struct fbtft_par *par = info->par;
+	size_t line_length = info->fix.line_length;
+	unsigned long p = *ppos;
+	unsigned first, last;
 	ssize_t res;
 
 	fbtft_dev_dbg(DEBUG_FB_WRITE, par, info->dev,
 		"%s: count=%zd, ppos=%llu\n", __func__,  count, *ppos);
+
+	if (par->stream && !p && count == line_length * info->var.yres &&
+			info->var.bits_per_pixel == 16 &&
+			info->var.yres_virtual == info->var.yres &&
+			!fbtft_te_chasing(par) &&
+			!(par->overlay && par->overlay->visible)) {
+		res = fbtft_fb_write_stream(info, buf, count);
+		if (res > 0)
+			*ppos += res;
+		return res;
+	}
+
 	res = fb_sys_write(info, buf, count, ppos);
+	if (res <= 0)
+		return res;
 
-	/* TODO: only mark changed area
-	   update all for now */
-	par->fbtftops.mkdirty(info, -1, 0);
+	/* only the lines that were written to */
+	first = p / line_length;
+	last = (p + res - 1) / line_length;
+	if (first > info->var.yres_virtual - 1)
+		return res;
+	last = min(last, info->var.yres_virtual - 1);
+	par->fbtftops.mkdirty(info, first, last - first + 1);
 
 	return res;
 }
@@ -525,6 +864,173 @@ int fbtft_fb_setcolreg(unsigned regno,
 	return ret;
 }
 
+static void fbtft_set_bitfields(struct fb_var_screeninfo *var)
+{
+	if (var->bits_per_pixel <= 8) {
+		/* gray levels, 1 bpp is black and white */
+		var->red.offset = 0;
+		var->red.length = var->bits_per_pixel;
+		var->green = var->red;
+		var->blue = var->red;
+		var->transp.offset = 0;
+		var->transp.length = 0;
+		return;
+	}
+
+	if (var->bits_per_pixel == 16) {
+		/* RGB565 */
+		var->red.offset = 11;
+		var->red.length = 5;
+		var->green.offset = 5;
+		var->green.length = 6;
+	} else {
+		/* RGB888 or XRGB8888 */
+		var->red.offset = 16;
+		var->red.length = 8;
+		var->green.offset = 8;
+		var->green.length = 8;
+	}
+	var->blue.offset = 0;
+	var->blue.length = var->bits_per_pixel == 16 ? 5 : 8;
+	var->transp.offset = 0;
+	var->transp.length = 0;
+}
+
+/*
+ * Only the pixel format can be changed. RGB565 displays written with the
+ * generic write_vmem() functions also do 24 and 32 bpp, converted while
+ * being sent, if video memory was sized for it (max_bpp).
+ */
+int fbtft_fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info)
+{
+	struct fbtft_par *par = info->par;
+	bool rgb = fbtft_rgb_capable(par);
+	unsigned bpp = var->bits_per_pixel;
+
+	if (!rgb) {
+		if (bpp != info->var.bits_per_pixel)
+			return -EINVAL;
+	} else if (bpp <= 16) {
+		bpp = 16;
+	} else if (bpp <= 24) {
+		bpp = 24;
+	} else if (bpp <= 32) {
+		bpp = 32;
+	} else {
+		return -EINVAL;
+	}
+	if (info->var.xres * info->var.yres_virtual * bpp / 8 >
+			info->fix.smem_len)
+		return -EINVAL;
+	if (var->yoffset + info->var.yres > info->var.yres_virtual)
+		return -EINVAL;
+
+	var->xres = info->var.xres;
+	var->yres = info->var.yres;
+	var->xres_virtual = info->var.xres_virtual;
+	var->yres_virtual = info->var.yres_virtual;
+	var->xoffset = 0;
+	var->rotate = info->var.rotate;
+	var->bits_per_pixel = bpp;
+	var->grayscale = info->var.grayscale;
+	var->nonstd = info->var.nonstd;
+	if (rgb) {
+		fbtft_set_bitfields(var);
+	} else {
+		var->red = info->var.red;
+		var->green = info->var.green;
+		var->blue = info->var.blue;
+		var->transp = info->var.transp;
+	}
+
+	return 0;
+}
+
+int fbtft_fb_set_par(struct fb_info *info)
+{
+	struct fbtft_par *par = info->par;
+	u32 line_length = DIV_ROUND_UP(info->var.xres *
+					info->var.bits_per_pixel, 8);
+
+	if (line_length == info->fix.line_length)
+		return 0;
+
+	mutex_lock(&par->update_lock);
+	info->fix.line_length = line_length;
+	par->panel.line_length = DIV_ROUND_UP(par->panel.width *
+					info->var.bits_per_pixel, 8);
+	/* old pixels make no sense in the new format */
+	memset(info->screen_base, 0, info->fix.smem_len);
+	mutex_unlock(&par->update_lock);
+
+	par->fbtftops.mkdirty(info, info->var.yoffset, info->var.yres);
+
+	return 0;
+}
+
+/*
+ * Page flipping: the frame at var->yoffset is displayed from the next
+ * display update on. Only the lines that differ from the frame on the
+ * display are written, which is known for sure unless an earlier flip is
+ * still waiting. Completion is signalled like for any other update, see
+ * FBIO_WAITFORVSYNC and FBTFT_IOCTL_FLUSH.
+ */
+int fbtft_fb_pan_display(struct fb_var_screeninfo *var, struct fb_info *info)
+{
+	struct fbtft_par *par = info->par;
+	size_t line_length = info->fix.line_length;
+	u8 *vmem = (u8 __force *)info->screen_base;
+	unsigned yres = info->var.yres;
+	unsigned first, last;
+	u32 old;
+	bool pending;
+
+	if (var->xoffset || var->yoffset + yres > info->var.yres_virtual)
+		return -EINVAL;
+	/* drivers with their own write_vmem() read from the start of vmem */
+	if (var->yoffset && !fbtft_write_vmem_generic(par))
+		return -EINVAL;
+
+	spin_lock(&par->dirty_lock);
+	old = par->pan.yoffset;
+	pending = par->pan.pending;
+	spin_unlock(&par->dirty_lock);
+
+	if (var->yoffset == old)
+		return 0;
+
+	first = 0;
+	last = yres - 1;
+	if (!pending) {
+		while (first < yres &&
+			!memcmp(vmem + (old + first) * line_length,
+				vmem + (var->yoffset + first) * line_length,
+				line_length))
+			first++;
+		while (last > first &&
+			!memcmp(vmem + (old + last) * line_length,
+				vmem + (var->yoffset + last) * line_length,
+				line_length))
+			last--;
+	}
+
+	spin_lock(&par->dirty_lock);
+	par->pan.yoffset = var->yoffset;
+	par->pan.pending = true;
+	if (first <= last) {
+		if (first < par->dirty_lines_start)
+			par->dirty_lines_start = first;
+		if (last > par->dirty_lines_end)
+			par->dirty_lines_end = last;
+	}
+	par->stats.flips++;
+	spin_unlock(&par->dirty_lock);
+
+	schedule_delayed_work(&info->deferred_work, info->fbdefio->delay);
+
+	return 0;
+}
+
 int fbtft_fb_blank(int blank, struct fb_info *info)
 {
 	struct fbtft_par *par = info->par;
@@ -588,6 +1094,8 @@ void fbtft_merge_fbtftops(struct fbtft_ops *dst, struct fbtft_ops *src)
 		dst->set_var = src->set_var;
 	if (src->set_gamma)
 		dst->set_gamma = src->set_gamma;
+	if (src->set_tear)
+		dst->set_tear = src->set_tear;
 }
 
 /**
@@ -621,6 +1129,7 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 	void *buf = NULL;
 	unsigned width;
 	unsigned height;
+	unsigned line_length;
 	int txbuflen = display->txbuflen;
 	unsigned bpp = display->bpp;
 	unsigned fps = display->fps;
@@ -628,6 +1137,7 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 	bool bgr = false;
 	u8 startbyte = 0;
 	int vmem_size;
+	unsigned frames;
 	int *init_sequence = display->init_sequence;
 	char *gamma = display->gamma;
 	unsigned long *gamma_curves = NULL;
@@ -643,10 +1153,12 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 	/* defaults */
 	if (!fps)
 		fps = 20;
-	if (!bpp)
+	if (!bpp || (bpp < 16 && rgb565))
 		bpp = 16;
-
-	vmem_size = display->width*display->height*bpp/8;
+	if (bpp != 1 && bpp != 4 && bpp != 8 && bpp != 16) {
+		dev_err(dev, "%s: %u bpp is not supported\n", __func__, bpp);
+		return NULL;
+	}
 
 	/* platform_data override ? */
 	if (pdata) {
@@ -681,7 +1193,16 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 		height = display->height;
 	}
 
-	vmem = vzalloc(vmem_size);
+	/* rows of 1 and 4 bpp pixels start on a byte */
+	line_length = DIV_ROUND_UP(width * bpp, 8);
+	vmem_size = line_length * height;
+	if (bpp == 16 && (max_bpp == 24 || max_bpp == 32))
+		vmem_size = width * height * max_bpp / 8;
+	frames = clamp(buffers, 1U, 3U);
+	vmem_size *= frames;
+
+	/* zeroed, and mappable by remap_vmalloc_range(), see fbtft_fb_mmap() */
+	vmem = vmalloc_user(vmem_size);
 	if (!vmem)
 		goto alloc_fail;
 
@@ -719,6 +1240,10 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 	fbops->fb_imageblit =      fbtft_fb_imageblit;
 	fbops->fb_setcolreg =      fbtft_fb_setcolreg;
 	fbops->fb_blank     =      fbtft_fb_blank;
+	fbops->fb_ioctl     =      fbtft_fb_ioctl;
+	fbops->fb_check_var =      fbtft_fb_check_var;
+	fbops->fb_set_par   =      fbtft_fb_set_par;
+	fbops->fb_pan_display =    fbtft_fb_pan_display;
 
 	fbdefio->delay =           HZ/fps;
 	fbdefio->deferred_io =     fbtft_deferred_io;
@@ -726,11 +1251,16 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 
 	strncpy(info->fix.id, dev->driver->name, 16);
 	info->fix.type =           FB_TYPE_PACKED_PIXELS;
-	info->fix.visual =         FB_VISUAL_TRUECOLOR;
+	if (bpp == 1)
+		info->fix.visual = FB_VISUAL_MONO10;
+	else if (bpp <= 8)
+		info->fix.visual = FB_VISUAL_STATIC_PSEUDOCOLOR;
+	else
+		info->fix.visual = FB_VISUAL_TRUECOLOR;
 	info->fix.xpanstep =	   0;
-	info->fix.ypanstep =	   0;
+	info->fix.ypanstep =	   frames > 1 ? 1 : 0;
 	info->fix.ywrapstep =	   0;
-	info->fix.line_length =    width*bpp/8;
+	info->fix.line_length =    line_length;
 	info->fix.accel =          FB_ACCEL_NONE;
 	info->fix.smem_len =       vmem_size;
 
@@ -738,19 +1268,11 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 	info->var.xres =           width;
 	info->var.yres =           height;
 	info->var.xres_virtual =   info->var.xres;
-	info->var.yres_virtual =   info->var.yres;
+	info->var.yres_virtual =   info->var.yres * frames;
 	info->var.bits_per_pixel = bpp;
+	info->var.grayscale =      bpp <= 8;
 	info->var.nonstd =         1;
-
-	/* RGB565 */
-	info->var.red.offset =     11;
-	info->var.red.length =     5;
-	info->var.green.offset =   5;
-	info->var.green.length =   6;
-	info->var.blue.offset =    0;
-	info->var.blue.length =    5;
-	info->var.transp.offset =  0;
-	info->var.transp.length =  0;
+	fbtft_set_bitfields(&info->var);
 
 	info->flags =              FBINFO_FLAG_DEFAULT | FBINFO_VIRTFB;
 
@@ -759,14 +1281,30 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 	par->pdata = dev->platform_data;
 	par->debug = display->debug;
 	par->buf = buf;
+	/* until fbtft_rotate_init(), the controller rotates if at all */
+	par->panel.width = width;
+	par->panel.height = height;
+	par->panel.line_length = line_length;
 	spin_lock_init(&par->dirty_lock);
+	par->inflight.next = 1;
+	par->inflight.end = 0;
 	par->bgr = bgr;
 	par->startbyte = startbyte;
+	if (pdata) {
+		par->speed.cmd = pdata->speed_cmd;
+		par->speed.read = pdata->speed_read;
+		par->rgb666 = pdata->rgb666;
+	}
 	par->init_sequence = init_sequence;
 	par->gamma.curves = gamma_curves;
 	par->gamma.num_curves = display->gamma_num;
 	par->gamma.num_values = display->gamma_len;
 	mutex_init(&par->gamma.lock);
+	mutex_init(&par->update_lock);
+	init_waitqueue_head(&par->flush.wait);
+	/* wrap the deferred io mmap so fault tracking can be turned off */
+	par->flush.mmap = fbops->fb_mmap;
+	fbops->fb_mmap = fbtft_fb_mmap;
 	info->pseudo_palette = par->pseudo_palette;
 
 	if (par->gamma.curves && gamma)
@@ -775,7 +1313,7 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 
 	/* Transmit buffer */
 	if (txbuflen == -1)
-		txbuflen = vmem_size;
+		txbuflen = vmem_size / frames;
 
 #ifdef __LITTLE_ENDIAN
 	if ((!txbuflen) && (bpp > 8))
@@ -835,13 +1373,17 @@ void fbtft_framebuffer_release(struct fb_info *info)
 	struct fbtft_par *par = info->par;
 
 	fb_deferred_io_cleanup(info);
+	/* not before, a deferred update may still write through the tables */
+	fbtft_gpio_bus_exit(par);
 	vfree(info->screen_base);
 	if (par->txbuf.buf)
 		kfree(par->txbuf.buf);
 	vfree(par->buf);
+	vfree(par->panel.buf);
 	kfree(info->fbops);
 	kfree(info->fbdefio);
 	kfree(par->gamma.curves);
+	kfree(par->conv);
 	framebuffer_release(info);
 }
 EXPORT_SYMBOL(fbtft_framebuffer_release);
@@ -864,6 +1406,7 @@ int fbtft_register_framebuffer(struct fb_info *fb_info)
 	int ret;
 	char text1[50] = "";
 	char text2[50] = "";
+	char text3[80] = "";
 	struct fbtft_par *par = fb_info->par;
 	struct spi_device *spi = par->spi;
 
@@ -888,6 +1431,12 @@ int fbtft_register_framebuffer(struct fb_info *fb_info)
 			goto reg_fail;
 	}
 
+	ret = fbtft_gpio_bus_init(par);
+	if (ret < 0)
+		goto reg_fail;
+
+	fbtft_trace_init(par, trace, trace_payload);
+
 	ret = par->fbtftops.init_display(par);
 	if (ret < 0)
 		goto reg_fail;
@@ -895,8 +1444,15 @@ int fbtft_register_framebuffer(struct fb_info *fb_info)
 		ret = par->fbtftops.set_var(par);
 		if (ret < 0)
 			goto reg_fail;
+	} else if (fb_info->var.rotate) {
+		ret = fbtft_rotate_init(par);
+		if (ret < 0)
+			goto reg_fail;
 	}
 
+	if (par->pdata && par->pdata->calibrate)
+		fbtft_calibrate_speed(par, par->pdata->calibrate);
+
 	/* update the entire display */
 	par->fbtftops.update_display(par, 0, par->info->var.yres - 1);
 
@@ -906,25 +1462,39 @@ int fbtft_register_framebuffer(struct fb_info *fb_info)
 			goto reg_fail;
 	}
 
+	fbtft_te_init(par);
+
 	if (par->fbtftops.register_backlight)
 		par->fbtftops.register_backlight(par);
 
+	if (selftest)
+		fbtft_selftest(par);
+
 	ret = register_framebuffer(fb_info);
 	if (ret < 0)
 		goto reg_fail;
 
 	fbtft_sysfs_init(par);
+	if (overlay)
+		fbtft_overlay_init(par);
 
 	if (par->txbuf.buf)
 		sprintf(text1, ", %d KiB buffer memory", par->txbuf.len >> 10);
 	if (spi)
 		sprintf(text2, ", spi%d.%d at %d MHz", spi->master->bus_num,
 				spi->chip_select, spi->max_speed_hz/1000000);
+	if (par->selftest.done)
+		snprintf(text3, sizeof(text3),
+			"fps=%u measured (%u partial, %lu configured)",
+			min_t(u32, par->selftest.full_fps,
+				HZ/fb_info->fbdefio->delay),
+			par->selftest.partial_fps, HZ/fb_info->fbdefio->delay);
+	else
+		sprintf(text3, "fps=%lu", HZ/fb_info->fbdefio->delay);
 	dev_info(fb_info->dev,
-		"%s frame buffer, %dx%d, %d KiB video memory%s, fps=%lu%s\n",
+		"%s frame buffer, %dx%d, %d KiB video memory%s, %s%s\n",
 		fb_info->fix.id, fb_info->var.xres, fb_info->var.yres,
-		fb_info->fix.smem_len >> 10, text1,
-		HZ/fb_info->fbdefio->delay, text2);
+		fb_info->fix.smem_len >> 10, text1, text3, text2);
 
 	/* Turn on backlight if available */
 	if (fb_info->bl_dev) {
@@ -941,7 +1511,9 @@ reg_fail:
 		spi_set_drvdata(spi, NULL);
 	if (par->pdev)
 		platform_set_drvdata(par->pdev, NULL);
+	fbtft_te_exit(par);
 	par->fbtftops.free_gpios(par);
+	fbtft_trace_exit(par);
 
 	return ret;
 }
@@ -966,15 +1538,47 @@ int fbtft_unregister_framebuffer(struct fb_info *fb_info)
 		spi_set_drvdata(spi, NULL);
 	if (par->pdev)
 		platform_set_drvdata(par->pdev, NULL);
+	fbtft_overlay_exit(par);
 	fbtft_sysfs_exit(par);
+	fbtft_te_exit(par);
+	fbtft_flush_exit(par);
 	par->fbtftops.free_gpios(par);
 	ret = unregister_framebuffer(fb_info);
 	if (par->fbtftops.unregister_backlight)
 		par->fbtftops.unregister_backlight(par);
+	fbtft_trace_exit(par);
 	return ret;
 }
 EXPORT_SYMBOL(fbtft_unregister_framebuffer);
 
+/**
+ * fbtft_find_framebuffer() - Look up a registered FBTFT display
+ * @name: Name of the display's device, e.g. "spi0.0"
+ *
+ * No reference is taken. The caller must have an fb notifier registered
+ * that holds FB_EVENT_FB_UNREGISTERED off during the lookup, e.g. with a
+ * lock the lookup is done under. The frame buffer then stays valid until
+ * the notifier sees that event for it.
+ *
+ * Return: frame buffer info, NULL if no FBTFT display has that name
+ */
+struct fb_info *fbtft_find_framebuffer(const char *name)
+{
+	struct fb_info *info;
+	int i;
+
+	for (i = 0; i < FB_MAX; i++) {
+		info = registered_fb[i];
+		if (info && info->device &&
+				info->fbops->fb_ioctl == fbtft_fb_ioctl &&
+				!strcmp(dev_name(info->device), name))
+			return info;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL(fbtft_find_framebuffer);
+
 /**
  * fbtft_init_display() - Generic init_display() function
  * @par: Driver data
@@ -1266,6 +1870,8 @@ int fbtft_probe_common(struct fbtft_display *display,
 	return 0;
 
 out_release:
+	if (par->extra)
+		vfree(par->extra);
 	fbtft_framebuffer_release(info);
 
 	return ret;
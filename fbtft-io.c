@@ -1,12 +1,40 @@
 #include <linux/export.h>
 #include <linux/errno.h>
 #include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/io.h>
+#include <linux/slab.h>
 #include <linux/spi/spi.h>
+#include <linux/version.h>
 #ifdef CONFIG_ARCH_BCM2708
 #include <mach/platform.h>
 #endif
 #include "fbtft.h"
 
+/*
+ * Commands and their parameters are sent from par->buf (see fbtft-bus.c),
+ * everything else is pixel data. 0 means spi->max_speed_hz.
+ */
+static u32 fbtft_write_speed_hz(struct fbtft_par *par, void *buf)
+{
+	return buf == par->buf ? par->speed.cmd : par->speed.data;
+}
+
+static int fbtft_spi_write_speed(struct fbtft_par *par, void *buf,
+						size_t len, u32 speed_hz)
+{
+	struct spi_transfer t = {
+			.tx_buf		= buf,
+			.len		= len,
+			.speed_hz	= speed_hz,
+		};
+	struct spi_message m;
+
+	spi_message_init(&m);
+	spi_message_add_tail(&t, &m);
+	return spi_sync(par->spi, &m);
+}
+
 int fbtft_write_spi(struct fbtft_par *par, void *buf, size_t len)
 {
 	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
@@ -17,7 +45,8 @@ int fbtft_write_spi(struct fbtft_par *par, void *buf, size_t len)
 			"%s: par->spi is unexpectedly NULL\n", __func__);
 		return -1;
 	}
-	return spi_write(par->spi, buf, len);
+	return fbtft_spi_write_speed(par, buf, len,
+					fbtft_write_speed_hz(par, buf));
 }
 EXPORT_SYMBOL(fbtft_write_spi);
 
@@ -36,6 +65,7 @@ int fbtft_write_spi_emulate_9(struct fbtft_par *par, void *buf, size_t len)
 	u8 *dst = par->extra;
 	size_t size = len / 2;
 	size_t added = 0;
+	u32 speed_hz = fbtft_write_speed_hz(par, buf);
 	int bits, i, j;
 	u64 val, dc, tmp;
 
@@ -72,7 +102,7 @@ int fbtft_write_spi_emulate_9(struct fbtft_par *par, void *buf, size_t len)
 		added++;
 	}
 
-	return spi_write(par->spi, par->extra, size + added);
+	return fbtft_spi_write_speed(par, par->extra, size + added, speed_hz);
 }
 EXPORT_SYMBOL(fbtft_write_spi_emulate_9);
 
@@ -81,7 +111,8 @@ int fbtft_read_spi(struct fbtft_par *par, void *buf, size_t len)
 	int ret;
 	u8 txbuf[32] = { 0, };
 	struct spi_transfer	t = {
-			.speed_hz = 2000000,
+			.speed_hz	= par->speed.read ? par->speed.read
+							  : 2000000,
 			.rx_buf		= buf,
 			.len		= len,
 		};
@@ -117,280 +148,372 @@ int fbtft_read_spi(struct fbtft_par *par, void *buf, size_t len)
 EXPORT_SYMBOL(fbtft_read_spi);
 
 
-#ifdef CONFIG_ARCH_BCM2708
+/*****************************************************************************
+ *
+ *   Parallel bus
+ *
+ *****************************************************************************/
 
 /*
- *  Raspberry Pi
- *  -  writing directly to the registers is 40-50% faster than
- *     optimized use of gpiolib
+ * Generic parallel bus on gpiolib's array functions: the data lines and
+ * /WR change in one call (see fbtft_gpio_bus_set() for the kernel
+ * versions), which gpiolib turns into a single set_multiple() per gpio
+ * chip, and /WR goes high in a second one. The data lines are
+ * only written when they change. Everything can sleep, display updates
+ * run in process context.
+ *
+ * Where the gpios have memory mapped set and clear registers (Raspberry
+ * Pi), those are written directly instead, which is 40-50% faster than
+ * gpiolib. Per device tables give the register values for each byte, see
+ * fbtft_gpio_regs_init().
  */
 
-#define GPIOSET(no, ishigh)           \
-do {                                  \
-	if (ishigh)                   \
-		set |= (1 << (no));   \
-	else                          \
-		reset |= (1 << (no)); \
-} while (0)
+static bool fbtft_gpio_regs_line(int gpio, unsigned base)
+{
+	return gpio >= (int)base && gpio < (int)base + 32;
+}
 
-int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len)
+/**
+ * fbtft_gpio_regs_init() - Drive the parallel bus through registers
+ * @par: Driver data
+ * @set: Register that drives the lines of the bits written to it high
+ * @clr: Register that drives the lines of the bits written to it low
+ * @base: Gpio number of bit 0 in @set and @clr
+ *
+ * Builds the tables of @set and @clr values for each byte on db0-db7 and
+ * db8-db15, and /WR and latch bits that go through the same registers.
+ * A bus cycle is then two or three register writes. Needs
+ * fbtft_gpio_bus_init() to have found the data lines.
+ *
+ * Return: 0, -EINVAL if a bus line isn't in the registers, -ENOMEM
+ */
+int fbtft_gpio_regs_init(struct fbtft_par *par, void __iomem *set,
+				void __iomem *clr, unsigned base)
 {
-	unsigned int set = 0;
-	unsigned int reset = 0;
-	u8 data;
+	unsigned width = par->gpio_bus.width;
+	struct fbtft_gpio_regs *regs;
+	unsigned lane, bit, val;
+	u32 mask;
 
-	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
-		"%s(len=%d): ", __func__, len);
+	if (!width || !fbtft_gpio_regs_line(par->gpio.wr, base))
+		return -EINVAL;
+	if (par->gpio.latch >= 0 &&
+			!fbtft_gpio_regs_line(par->gpio.latch, base))
+		return -EINVAL;
+	for (bit = 0; bit < width; bit++)
+		if (!fbtft_gpio_regs_line(par->gpio.db[bit], base))
+			return -EINVAL;
 
-	while (len--) {
-		data = *(u8 *) buf;
-		buf++;
-
-		/* Set data */
-		GPIOSET(par->gpio.db[0], (data&0x01));
-		GPIOSET(par->gpio.db[1], (data&0x02));
-		GPIOSET(par->gpio.db[2], (data&0x04));
-		GPIOSET(par->gpio.db[3], (data&0x08));
-		GPIOSET(par->gpio.db[4], (data&0x10));
-		GPIOSET(par->gpio.db[5], (data&0x20));
-		GPIOSET(par->gpio.db[6], (data&0x40));
-		GPIOSET(par->gpio.db[7], (data&0x80));
-		writel(set, __io_address(GPIO_BASE+0x1C));
-		writel(reset, __io_address(GPIO_BASE+0x28));
-
-		/* Pulse /WR low */
-		writel((1<<par->gpio.wr),  __io_address(GPIO_BASE+0x28));
-		writel(0,  __io_address(GPIO_BASE+0x28)); /* used as a delay */
-		writel((1<<par->gpio.wr),  __io_address(GPIO_BASE+0x1C));
-
-		set = 0;
-		reset = 0;
+	regs = kzalloc(sizeof(*regs), GFP_KERNEL);
+	if (!regs)
+		return -ENOMEM;
+
+	regs->set = set;
+	regs->clr = clr;
+	for (lane = 0; lane < width / 8; lane++) {
+		for (bit = 0; bit < 8; bit++) {
+			mask = 1U << (par->gpio.db[lane * 8 + bit] - base);
+			for (val = 0; val < 256; val++) {
+				if (val & (1 << bit))
+					regs->set_mask[lane][val] |= mask;
+				else
+					regs->clr_mask[lane][val] |= mask;
+			}
+		}
 	}
+	regs->wr = 1U << (par->gpio.wr - base);
+	if (par->gpio.latch >= 0)
+		regs->latch = 1U << (par->gpio.latch - base);
+
+	par->gpio_regs = regs;
 
 	return 0;
 }
-EXPORT_SYMBOL(fbtft_write_gpio8_wr);
+EXPORT_SYMBOL(fbtft_gpio_regs_init);
 
-int fbtft_write_gpio16_wr(struct fbtft_par *par, void *buf, size_t len)
+/**
+ * fbtft_gpio_bus_init() - Set up the parallel bus
+ * @par: Driver data
+ *
+ * Called by fbtft_register_framebuffer() once the gpios are requested.
+ *
+ * Return: 0, or -EINVAL if the data lines don't start at db0
+ */
+int fbtft_gpio_bus_init(struct fbtft_par *par)
 {
-	unsigned int set = 0;
-	unsigned int reset = 0;
-	u16 data;
+	struct fbtft_gpio_bus *bus = &par->gpio_bus;
+	unsigned i;
 
-	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
-		"%s(len=%d): ", __func__, len);
+	if (par->gpio.wr < 0)
+		return 0;
 
-	while (len) {
-		len -= 2;
-		data = *(u16 *) buf;
-		buf += 2;
+	for (i = 0; i < 16 && par->gpio.db[i] >= 0; i++)
+		bus->desc[i] = gpio_to_desc(par->gpio.db[i]);
+	if (i != 8 && i != 16) {
+		dev_err(par->info->device,
+			"%s: need db0-db7 or db0-db15, found %u data lines\n",
+			__func__, i);
+		return -EINVAL;
+	}
+	bus->width = i;
 
-		/* Start writing by pulling down /WR */
-		gpio_set_value(par->gpio.wr, 0);
-
-		/* Set data */
-		GPIOSET(par->gpio.db[0],  (data&0x0001));
-		GPIOSET(par->gpio.db[1],  (data&0x0002));
-		GPIOSET(par->gpio.db[2],  (data&0x0004));
-		GPIOSET(par->gpio.db[3],  (data&0x0008));
-		GPIOSET(par->gpio.db[4],  (data&0x0010));
-		GPIOSET(par->gpio.db[5],  (data&0x0020));
-		GPIOSET(par->gpio.db[6],  (data&0x0040));
-		GPIOSET(par->gpio.db[7],  (data&0x0080));
-
-		GPIOSET(par->gpio.db[8],  (data&0x0100));
-		GPIOSET(par->gpio.db[9],  (data&0x0200));
-		GPIOSET(par->gpio.db[10], (data&0x0400));
-		GPIOSET(par->gpio.db[11], (data&0x0800));
-		GPIOSET(par->gpio.db[12], (data&0x1000));
-		GPIOSET(par->gpio.db[13], (data&0x2000));
-		GPIOSET(par->gpio.db[14], (data&0x4000));
-		GPIOSET(par->gpio.db[15], (data&0x8000));
-
-		writel(set, __io_address(GPIO_BASE+0x1C));
-		writel(reset, __io_address(GPIO_BASE+0x28));
+	/* /WR follows the data lines it's written with */
+	bus->wr = gpio_to_desc(par->gpio.wr);
+	bus->desc[bus->width] = bus->wr;
+	if (par->gpio.latch >= 0)
+		bus->latch = gpio_to_desc(par->gpio.latch);
+	bus->valid = false;
 
-		/* Pullup /WR */
-		gpio_set_value(par->gpio.wr, 1);
+#ifdef CONFIG_ARCH_BCM2708
+	if (fbtft_gpio_regs_init(par, __io_address(GPIO_BASE + 0x1C),
+				__io_address(GPIO_BASE + 0x28), 0))
+		dev_info(par->info->device,
+			"parallel bus not on gpio 0-31, using gpiolib\n");
+#endif
+
+	return 0;
+}
+
+/* called by fbtft_framebuffer_release(), once deferred io has stopped */
+void fbtft_gpio_bus_exit(struct fbtft_par *par)
+{
+	kfree(par->gpio_regs);
+	par->gpio_regs = NULL;
+}
+
+/*
+ * Set the first @n lines of @bus->desc to the bits of @bitmap, in one
+ * array call. It takes a bitmap from 5.0 on, and an int per line before
+ * that (as gpiod_set_raw_array_cansleep() before 4.3).
+ */
+static void fbtft_gpio_bus_set(struct fbtft_gpio_bus *bus, unsigned n,
+				unsigned long bitmap)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0)
+	gpiod_set_raw_array_value_cansleep(n, bus->desc, NULL, &bitmap);
+#else
+	int value[ARRAY_SIZE(bus->desc)];
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		value[i] = (bitmap >> i) & 1;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0)
+	gpiod_set_raw_array_value_cansleep(n, bus->desc, value);
+#else
+	gpiod_set_raw_array_cansleep(n, bus->desc, value);
+#endif
+#endif
+}
+
+/*
+ * Put @data on the data lines, together with /WR low. Lines above the
+ * bits of @data go low, so @bus->prev always tells what's on the bus.
+ */
+static void fbtft_gpio_bus_data(struct fbtft_gpio_bus *bus,
+				unsigned long data)
+{
+	fbtft_gpio_bus_set(bus, bus->width + 1, data);
+	bus->prev = data;
+	bus->valid = true;
+}
+
+static int fbtft_gpiod_write_wr(struct fbtft_par *par, void *buf,
+				size_t len, unsigned width)
+{
+	struct fbtft_gpio_bus *bus = &par->gpio_bus;
+	unsigned long data;
+
+	while (len) {
+		if (width == 8) {
+			data = *(u8 *)buf;
+			buf++;
+			len--;
+		} else {
+			data = *(u16 *)buf;
+			buf += 2;
+			len -= 2;
+		}
+
+		if (bus->valid && data == bus->prev)
+			gpiod_set_raw_value_cansleep(bus->wr, 0);
+		else
+			fbtft_gpio_bus_data(bus, data);
 
-		set = 0;
-		reset = 0;
+		/* the controller takes the data on the rising edge */
+		gpiod_set_raw_value_cansleep(bus->wr, 1);
 	}
 
 	return 0;
 }
-EXPORT_SYMBOL(fbtft_write_gpio16_wr);
 
-int fbtft_write_gpio16_wr_latched(struct fbtft_par *par, void *buf, size_t len)
+static int fbtft_gpiod_write_wr_latched(struct fbtft_par *par, void *buf,
+					size_t len)
 {
-	unsigned int set = 0;
-	unsigned int reset = 0;
+	struct fbtft_gpio_bus *bus = &par->gpio_bus;
+	unsigned long bitmap;
 	u16 data;
 
-	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
-		"%s(len=%d): ", __func__, len);
-
 	while (len) {
-		len -= 2;
-		data = *(u16 *) buf;
+		data = *(u16 *)buf;
 		buf += 2;
+		len -= 2;
 
-		/* Start writing by pulling down /WR */
-		gpio_set_value(par->gpio.wr, 0);
-
-		/* Low byte */
-		GPIOSET(par->gpio.db[0],  (data&0x0001));
-		GPIOSET(par->gpio.db[1],  (data&0x0002));
-		GPIOSET(par->gpio.db[2],  (data&0x0004));
-		GPIOSET(par->gpio.db[3],  (data&0x0008));
-		GPIOSET(par->gpio.db[4],  (data&0x0010));
-		GPIOSET(par->gpio.db[5],  (data&0x0020));
-		GPIOSET(par->gpio.db[6],  (data&0x0040));
-		GPIOSET(par->gpio.db[7],  (data&0x0080));
-		writel(set, __io_address(GPIO_BASE+0x1C));
-		writel(reset, __io_address(GPIO_BASE+0x28));
+		/* Low byte, with /WR low */
+		if (bus->valid && (data & 0xFF) == bus->prev)
+			gpiod_set_raw_value_cansleep(bus->wr, 0);
+		else
+			fbtft_gpio_bus_data(bus, data & 0xFF);
 
 		/* Pulse 'latch' high */
-		gpio_set_value(par->gpio.latch, 1);
-		gpio_set_value(par->gpio.latch, 0);
+		gpiod_set_raw_value_cansleep(bus->latch, 1);
+		gpiod_set_raw_value_cansleep(bus->latch, 0);
 
 		/* High byte */
-		GPIOSET(par->gpio.db[0], (data&0x0100));
-		GPIOSET(par->gpio.db[1], (data&0x0200));
-		GPIOSET(par->gpio.db[2], (data&0x0400));
-		GPIOSET(par->gpio.db[3], (data&0x0800));
-		GPIOSET(par->gpio.db[4], (data&0x1000));
-		GPIOSET(par->gpio.db[5], (data&0x2000));
-		GPIOSET(par->gpio.db[6], (data&0x4000));
-		GPIOSET(par->gpio.db[7], (data&0x8000));
-		writel(set, __io_address(GPIO_BASE+0x1C));
-		writel(reset, __io_address(GPIO_BASE+0x28));
+		if ((data >> 8) != bus->prev) {
+			bitmap = data >> 8;
+			fbtft_gpio_bus_set(bus, 8, bitmap);
+			bus->prev = bitmap;
+		}
 
 		/* Pullup /WR */
-		gpio_set_value(par->gpio.wr, 1);
-
-		set = 0;
-		reset = 0;
+		gpiod_set_raw_value_cansleep(bus->wr, 1);
 	}
 
 	return 0;
 }
-EXPORT_SYMBOL(fbtft_write_gpio16_wr_latched);
 
-#undef GPIOSET
+static int fbtft_regs_write_wr(struct fbtft_par *par, void *buf,
+				size_t len, unsigned width)
+{
+	struct fbtft_gpio_bus *bus = &par->gpio_bus;
+	struct fbtft_gpio_regs *regs = par->gpio_regs;
+	u32 set, clr;
+	u16 data;
 
-#else
+	while (len) {
+		if (width == 8) {
+			data = *(u8 *)buf;
+			buf++;
+			len--;
+			set = regs->set_mask[0][data];
+			/* db8-db15 go low, see fbtft_gpio_bus_data() */
+			clr = regs->clr_mask[0][data] | regs->clr_mask[1][0];
+		} else {
+			data = *(u16 *)buf;
+			buf += 2;
+			len -= 2;
+			set = regs->set_mask[0][data & 0xFF] |
+			      regs->set_mask[1][data >> 8];
+			clr = regs->clr_mask[0][data & 0xFF] |
+			      regs->clr_mask[1][data >> 8];
+		}
 
-/*
- * Optimized use of gpiolib is twice as fast as no optimization
- * only one driver can use the optimized version at a time
- */
-int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len)
-{
-	u8 data;
-	int i;
-#ifndef DO_NOT_OPTIMIZE_FBTFT_WRITE_GPIO
-	static u8 prev_data;
-#endif
+		/* Set data, pull down /WR with the lines that go low */
+		if (bus->valid && data == bus->prev) {
+			writel(regs->wr, regs->clr);
+		} else {
+			writel(set, regs->set);
+			writel(clr | regs->wr, regs->clr);
+			bus->prev = data;
+			bus->valid = true;
+		}
 
-	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
-		"%s(len=%d): ", __func__, len);
+		/* Pullup /WR */
+		writel(regs->wr, regs->set);
+	}
 
-	while (len--) {
-		data = *(u8 *) buf;
+	return 0;
+}
+
+static int fbtft_regs_write_wr_latched(struct fbtft_par *par, void *buf,
+					size_t len)
+{
+	struct fbtft_gpio_bus *bus = &par->gpio_bus;
+	struct fbtft_gpio_regs *regs = par->gpio_regs;
+	u8 lo, hi;
 
-		/* Start writing by pulling down /WR */
-		gpio_set_value(par->gpio.wr, 0);
+	while (len) {
+		lo = *(u16 *)buf & 0xFF;
+		hi = *(u16 *)buf >> 8;
+		buf += 2;
+		len -= 2;
 
-		/* Set data */
-#ifndef DO_NOT_OPTIMIZE_FBTFT_WRITE_GPIO
-		if (data == prev_data) {
-			gpio_set_value(par->gpio.wr, 0); /* used as delay */
+		/* Low byte, with /WR low */
+		if (bus->valid && lo == bus->prev) {
+			writel(regs->wr, regs->clr);
 		} else {
-			for (i = 0; i < 8; i++) {
-				if ((data & 1) != (prev_data & 1))
-					gpio_set_value(par->gpio.db[i],
-								(data & 1));
-				data >>= 1;
-				prev_data >>= 1;
-			}
+			writel(regs->set_mask[0][lo], regs->set);
+			writel(regs->clr_mask[0][lo] | regs->wr, regs->clr);
 		}
-#else
-		for (i = 0; i < 8; i++) {
-			gpio_set_value(par->gpio.db[i], (data & 1));
-			data >>= 1;
+
+		/* Pulse 'latch' high */
+		writel(regs->latch, regs->set);
+		writel(regs->latch, regs->clr);
+
+		/* High byte */
+		if (hi != lo) {
+			writel(regs->set_mask[0][hi], regs->set);
+			writel(regs->clr_mask[0][hi], regs->clr);
 		}
-#endif
+		bus->prev = hi;
+		bus->valid = true;
 
 		/* Pullup /WR */
-		gpio_set_value(par->gpio.wr, 1);
-
-#ifndef DO_NOT_OPTIMIZE_FBTFT_WRITE_GPIO
-		prev_data = *(u8 *) buf;
-#endif
-		buf++;
+		writel(regs->wr, regs->set);
 	}
 
 	return 0;
 }
-EXPORT_SYMBOL(fbtft_write_gpio8_wr);
 
-int fbtft_write_gpio16_wr(struct fbtft_par *par, void *buf, size_t len)
+int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len)
 {
-	u16 data;
-	int i;
-#ifndef DO_NOT_OPTIMIZE_FBTFT_WRITE_GPIO
-	static u16 prev_data;
-#endif
-
 	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
 		"%s(len=%d): ", __func__, len);
 
-	while (len) {
-		data = *(u16 *) buf;
-
-		/* Start writing by pulling down /WR */
-		gpio_set_value(par->gpio.wr, 0);
+	if (!par->gpio_bus.width) {
+		dev_err(par->info->device, "%s: parallel bus not set up\n",
+			__func__);
+		return -EINVAL;
+	}
+	if (par->gpio_regs)
+		return fbtft_regs_write_wr(par, buf, len, 8);
 
-		/* Set data */
-#ifndef DO_NOT_OPTIMIZE_FBTFT_WRITE_GPIO
-		if (data == prev_data) {
-			gpio_set_value(par->gpio.wr, 0); /* used as delay */
-		} else {
-			for (i = 0; i < 16; i++) {
-				if ((data & 1) != (prev_data & 1))
-					gpio_set_value(par->gpio.db[i],
-								(data & 1));
-				data >>= 1;
-				prev_data >>= 1;
-			}
-		}
-#else
-		for (i = 0; i < 16; i++) {
-			gpio_set_value(par->gpio.db[i], (data & 1));
-			data >>= 1;
-		}
-#endif
+	return fbtft_gpiod_write_wr(par, buf, len, 8);
+}
+EXPORT_SYMBOL(fbtft_write_gpio8_wr);
 
-		/* Pullup /WR */
-		gpio_set_value(par->gpio.wr, 1);
+int fbtft_write_gpio16_wr(struct fbtft_par *par, void *buf, size_t len)
+{
+	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
+		"%s(len=%d): ", __func__, len);
 
-#ifndef DO_NOT_OPTIMIZE_FBTFT_WRITE_GPIO
-		prev_data = *(u16 *) buf;
-#endif
-		buf += 2;
-		len -= 2;
+	if (par->gpio_bus.width != 16) {
+		dev_err(par->info->device, "%s: 16-bit bus not set up\n",
+			__func__);
+		return -EINVAL;
 	}
+	if (par->gpio_regs)
+		return fbtft_regs_write_wr(par, buf, len, 16);
 
-	return 0;
+	return fbtft_gpiod_write_wr(par, buf, len, 16);
 }
 EXPORT_SYMBOL(fbtft_write_gpio16_wr);
 
-int fbtft_write_gpio16_wr_latched(struct fbtft_par *par, void *buf, size_t len)
+/* 16-bit data over db0-db7, the low byte held by a latch */
+int fbtft_write_gpio16_wr_latched(struct fbtft_par *par, void *buf,
+				size_t len)
 {
-	dev_err(par->info->device, "%s: function not implemented\n", __func__);
-	return -1;
+	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
+		"%s(len=%d): ", __func__, len);
+
+	if (!par->gpio_bus.width || par->gpio.latch < 0) {
+		dev_err(par->info->device, "%s: latched bus not set up\n",
+			__func__);
+		return -EINVAL;
+	}
+	if (par->gpio_regs)
+		return fbtft_regs_write_wr_latched(par, buf, len);
+
+	return fbtft_gpiod_write_wr_latched(par, buf, len);
 }
 EXPORT_SYMBOL(fbtft_write_gpio16_wr_latched);
-
-#endif /* CONFIG_ARCH_BCM2708 */
@@ -0,0 +1,294 @@
+/*
+ * FBTFT specific framebuffer ioctls
+ *
+ * Lets mmap clients say what they changed and find out when it has been
+ * written to the panel, much like DRM's dirtyfb and a page flip event:
+ *
+ *   FBTFT_IOCTL_DAMAGE   mark rectangles as changed, optionally stop
+ *                        tracking mmap writes through page faults
+ *   FBTFT_IOCTL_FLUSH    start the pending update now and/or wait for it,
+ *                        returns update sequence numbers
+ *   FBTFT_IOCTL_EVENTFD  signal an eventfd each time an update completes
+ *   FBIO_WAITFORVSYNC    wait until the pending update has been written
+ *
+ * Every display update gets a sequence number when it starts. Damage
+ * given before FBTFT_IOCTL_FLUSH returned 'seq' is on the panel once
+ * 'done' (from a later FBTFT_IOCTL_FLUSH) has reached it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fb.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/eventfd.h>
+
+#include "fbtft.h"
+
+/* upper bound for one FBTFT_IOCTL_DAMAGE call */
+#define FBTFT_DAMAGE_MAX_RECTS	64
+
+/**
+ * fbtft_flush_begin() - Number a display update
+ * @par: Driver data
+ *
+ * Called by fbtft_update_display() with the update lock held.
+ *
+ * Return: sequence number to pass to fbtft_flush_end()
+ */
+u64 fbtft_flush_begin(struct fbtft_par *par)
+{
+	u64 seq;
+
+	spin_lock(&par->dirty_lock);
+	seq = ++par->flush.started;
+	spin_unlock(&par->dirty_lock);
+
+	return seq;
+}
+
+/**
+ * fbtft_flush_end() - Mark a display update as written
+ * @par: Driver data
+ * @seq: Sequence number from fbtft_flush_begin()
+ *
+ * Called with the update lock held.
+ */
+void fbtft_flush_end(struct fbtft_par *par, u64 seq)
+{
+	spin_lock(&par->dirty_lock);
+	par->flush.done = seq;
+	spin_unlock(&par->dirty_lock);
+
+	wake_up_all(&par->flush.wait);
+	if (par->flush.eventfd)
+		eventfd_signal(par->flush.eventfd, 1);
+}
+
+static u64 fbtft_flush_done(struct fbtft_par *par)
+{
+	u64 done;
+
+	spin_lock(&par->dirty_lock);
+	done = par->flush.done;
+	spin_unlock(&par->dirty_lock);
+
+	return done;
+}
+
+/* sequence number the damage given so far goes out in */
+static u64 fbtft_flush_target(struct fb_info *info, u64 *done)
+{
+	struct fbtft_par *par = info->par;
+	u64 seq;
+
+	spin_lock(&par->dirty_lock);
+	seq = par->flush.started;
+	if (delayed_work_pending(&info->deferred_work))
+		seq++;
+	*done = par->flush.done;
+	spin_unlock(&par->dirty_lock);
+
+	return seq;
+}
+
+/**
+ * fbtft_flush() - Write pending damage to the display now
+ * @info: Frame buffer info
+ * @wait: Wait until it has been written
+ *
+ * For in-kernel users of the framebuffer.
+ *
+ * Return: sequence number of the update the damage goes out in
+ */
+u64 fbtft_flush(struct fb_info *info, bool wait)
+{
+	u64 seq, done;
+
+	seq = fbtft_flush_target(info, &done);
+	if (wait)
+		flush_delayed_work(&info->deferred_work);
+	else
+		mod_delayed_work(system_wq, &info->deferred_work, 0);
+
+	return seq;
+}
+EXPORT_SYMBOL(fbtft_flush);
+
+/**
+ * fbtft_flush_wait() - Wait for a display update to be written
+ * @info: Frame buffer info
+ * @seq: Sequence number from fbtft_flush()
+ * @timeout: In jiffies
+ *
+ * Return: 0 once update @seq is on the display, -ETIMEDOUT if it isn't
+ * by @timeout
+ */
+int fbtft_flush_wait(struct fb_info *info, u64 seq, long timeout)
+{
+	struct fbtft_par *par = info->par;
+
+	if (!wait_event_timeout(par->flush.wait,
+				fbtft_flush_done(par) >= seq, timeout))
+		return -ETIMEDOUT;
+
+	return 0;
+}
+EXPORT_SYMBOL(fbtft_flush_wait);
+
+static int fbtft_ioctl_damage(struct fb_info *info, void __user *argp)
+{
+	struct fbtft_par *par = info->par;
+	struct fbtft_damage damage;
+	struct fbtft_rect *rects;
+	unsigned i, y, h;
+	int ret = 0;
+
+	if (copy_from_user(&damage, argp, sizeof(damage)))
+		return -EFAULT;
+	if (damage.flags & ~FBTFT_DAMAGE_NO_FAULTS ||
+			damage.num_rects > FBTFT_DAMAGE_MAX_RECTS)
+		return -EINVAL;
+
+	par->flush.no_faults = !!(damage.flags & FBTFT_DAMAGE_NO_FAULTS);
+	if (!damage.num_rects)
+		return 0;
+
+	rects = kmalloc_array(damage.num_rects, sizeof(*rects), GFP_KERNEL);
+	if (!rects)
+		return -ENOMEM;
+	if (copy_from_user(rects, (void __user *)(uintptr_t)damage.rects,
+				damage.num_rects * sizeof(*rects))) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	/* damage is tracked in whole lines */
+	for (i = 0; i < damage.num_rects; i++) {
+		y = rects[i].y;
+		h = rects[i].height;
+		if (!rects[i].width || !h || y >= info->var.yres_virtual ||
+				rects[i].x >= info->var.xres) {
+			ret = -EINVAL;
+			goto out;
+		}
+		h = min(h, info->var.yres_virtual - y);
+		par->fbtftops.mkdirty(info, y, h);
+	}
+
+out:
+	kfree(rects);
+
+	return ret;
+}
+
+static int fbtft_ioctl_flush(struct fb_info *info, void __user *argp)
+{
+	struct fbtft_par *par = info->par;
+	struct fbtft_flush flush;
+
+	if (copy_from_user(&flush, argp, sizeof(flush)))
+		return -EFAULT;
+	if (flush.flags & ~(FBTFT_FLUSH_NOW | FBTFT_FLUSH_WAIT))
+		return -EINVAL;
+
+	if (flush.flags)
+		flush.seq = fbtft_flush(info, flush.flags & FBTFT_FLUSH_WAIT);
+	else
+		flush.seq = fbtft_flush_target(info, &flush.done);
+	flush.done = fbtft_flush_done(par);
+
+	if (copy_to_user(argp, &flush, sizeof(flush)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int fbtft_ioctl_eventfd(struct fb_info *info, void __user *argp)
+{
+	struct fbtft_par *par = info->par;
+	struct eventfd_ctx *ctx = NULL, *old;
+	s32 fd;
+
+	if (get_user(fd, (s32 __user *)argp))
+		return -EFAULT;
+	if (fd >= 0) {
+		ctx = eventfd_ctx_fdget(fd);
+		if (IS_ERR(ctx))
+			return PTR_ERR(ctx);
+	}
+
+	mutex_lock(&par->update_lock);
+	old = par->flush.eventfd;
+	par->flush.eventfd = ctx;
+	mutex_unlock(&par->update_lock);
+
+	if (old)
+		eventfd_ctx_put(old);
+
+	return 0;
+}
+
+/* there's no vblank to wait for, wait for the pending update instead */
+static int fbtft_ioctl_waitforvsync(struct fb_info *info)
+{
+	struct fbtft_par *par = info->par;
+	u64 seq, done;
+	long ret;
+
+	seq = fbtft_flush_target(info, &done);
+	if (done >= seq)
+		return 0;
+
+	ret = wait_event_interruptible_timeout(par->flush.wait,
+				fbtft_flush_done(par) >= seq, HZ);
+	if (ret < 0)
+		return ret;
+
+	return ret ? 0 : -ETIMEDOUT;
+}
+
+int fbtft_fb_ioctl(struct fb_info *info, unsigned int cmd, unsigned long arg)
+{
+	void __user *argp = (void __user *)arg;
+
+	switch (cmd) {
+	case FBTFT_IOCTL_DAMAGE:
+		return fbtft_ioctl_damage(info, argp);
+	case FBTFT_IOCTL_FLUSH:
+		return fbtft_ioctl_flush(info, argp);
+	case FBTFT_IOCTL_EVENTFD:
+		return fbtft_ioctl_eventfd(info, argp);
+	case FBIO_WAITFORVSYNC:
+		return fbtft_ioctl_waitforvsync(info);
+	}
+
+	return -ENOTTY;
+}
+
+/* without fault tracking, new mappings are plain vmalloc mappings */
+int fbtft_fb_mmap(struct fb_info *info, struct vm_area_struct *vma)
+{
+	struct fbtft_par *par = info->par;
+
+	if (par->flush.no_faults)
+		return remap_vmalloc_range(vma, (void __force *)info->screen_base,
+					vma->vm_pgoff);
+
+	return par->flush.mmap(info, vma);
+}
+
+void fbtft_flush_exit(struct fbtft_par *par)
+{
+	if (par->flush.eventfd)
+		eventfd_ctx_put(par->flush.eventfd);
+	par->flush.eventfd = NULL;
+}
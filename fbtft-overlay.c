@@ -0,0 +1,448 @@
+/*
+ * Overlay plane
+ *
+ * With the 'overlay' parameter, each RGB565 display that uses one of the
+ * generic write_vmem() functions gets a second framebuffer, registered
+ * right after its own. It's an RGB565 plane shown over the display at a
+ * position, with a color key and/or a global alpha, for a cursor, a status
+ * bar or touch feedback over a mostly static background.
+ *
+ * The display's video memory keeps the background. The overlay is
+ * composed over it only for the lines being written, while they are
+ * converted into txbuf (see fbtft_write_vmem_rgb()). Drawing on the
+ * overlay or moving it only rewrites the lines it covered and covers,
+ * and the background never has to be repainted.
+ *
+ * The overlay starts out blanked and as large as the display:
+ *   FBIOBLANK                    FB_BLANK_UNBLANK shows it, any other
+ *                                value hides it
+ *   FBIOPUT_VSCREENINFO          xres/yres resize it, up to the display
+ *   /sys/class/graphics/fbN/position   "x,y" on the display
+ *   /sys/class/graphics/fbN/colorkey   RGB565 value that isn't drawn,
+ *                                      e.g. 0xf81f, or -1 for none
+ *   /sys/class/graphics/fbN/alpha      0-255, 255 is opaque
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fb.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#include "fbtft.h"
+
+/*
+ * Overlay lines @y..@y+@height-1 have changed, or were or are covered
+ * by it. The display lines under them are written with the next update.
+ */
+static void fbtft_overlay_damage(struct fbtft_par *par, unsigned y,
+				unsigned height)
+{
+	struct fb_info *info = par->info;
+
+	par->fbtftops.mkdirty(info, info->var.yoffset + y, height);
+}
+
+/* the part of the display the overlay covers, if it's shown */
+static void fbtft_overlay_damage_all(struct fbtft_par *par)
+{
+	struct fbtft_overlay *ov = par->overlay;
+
+	if (ov->visible)
+		fbtft_overlay_damage(par, ov->y, ov->height);
+}
+
+/* lines drawn on the overlay itself */
+static void fbtft_overlay_drawn(struct fb_info *info, unsigned y,
+				unsigned height)
+{
+	struct fbtft_par *par = info->par;
+	struct fbtft_overlay *ov = par->overlay;
+
+	if (!ov || !ov->visible || y >= ov->height)
+		return;
+	fbtft_overlay_damage(par, ov->y + y, min(height, ov->height - y));
+}
+
+static void fbtft_overlay_deferred_io(struct fb_info *info,
+				struct list_head *pagelist)
+{
+	struct fbtft_par *par = info->par;
+	size_t line_length = info->fix.line_length;
+	unsigned first = ~0, last = 0;
+	struct page *page;
+	size_t index;
+
+	list_for_each_entry(page, pagelist, lru) {
+		index = page->index << PAGE_SHIFT;
+		first = min_t(unsigned, first, index / line_length);
+		last = max_t(unsigned, last,
+				(index + PAGE_SIZE - 1) / line_length);
+	}
+	if (first > last)
+		return;
+
+	fbtft_overlay_drawn(info, first, last - first + 1);
+	/* the overlay's own delay has passed already */
+	fbtft_flush(par->info, false);
+}
+
+static ssize_t fbtft_overlay_fb_write(struct fb_info *info,
+			const char __user *buf, size_t count, loff_t *ppos)
+{
+	size_t line_length = info->fix.line_length;
+	unsigned long p = *ppos;
+	ssize_t res;
+
+	res = fb_sys_write(info, buf, count, ppos);
+	if (res > 0)
+		fbtft_overlay_drawn(info, p / line_length,
+			(p + res - 1) / line_length - p / line_length + 1);
+
+	return res;
+}
+
+static void fbtft_overlay_fb_fillrect(struct fb_info *info,
+				const struct fb_fillrect *rect)
+{
+	sys_fillrect(info, rect);
+	fbtft_overlay_drawn(info, rect->dy, rect->height);
+}
+
+static void fbtft_overlay_fb_copyarea(struct fb_info *info,
+				const struct fb_copyarea *area)
+{
+	sys_copyarea(info, area);
+	fbtft_overlay_drawn(info, area->dy, area->height);
+}
+
+static void fbtft_overlay_fb_imageblit(struct fb_info *info,
+				const struct fb_image *image)
+{
+	sys_imageblit(info, image);
+	fbtft_overlay_drawn(info, image->dy, image->height);
+}
+
+/* only the size can be changed, it's always RGB565 */
+static int fbtft_overlay_fb_check_var(struct fb_var_screeninfo *var,
+				struct fb_info *info)
+{
+	struct fbtft_par *par = info->par;
+
+	if (!var->xres || !var->yres || var->xres > par->info->var.xres ||
+			var->yres > par->info->var.yres)
+		return -EINVAL;
+
+	var->xres_virtual = var->xres;
+	var->yres_virtual = var->yres;
+	var->xoffset = 0;
+	var->yoffset = 0;
+	var->bits_per_pixel = 16;
+	var->grayscale = 0;
+	var->nonstd = 0;
+	var->red = info->var.red;
+	var->green = info->var.green;
+	var->blue = info->var.blue;
+	var->transp = info->var.transp;
+
+	return 0;
+}
+
+static int fbtft_overlay_fb_set_par(struct fb_info *info)
+{
+	struct fbtft_par *par = info->par;
+	struct fbtft_overlay *ov = par->overlay;
+
+	mutex_lock(&par->update_lock);
+	fbtft_overlay_damage_all(par);
+	info->fix.line_length = info->var.xres * 2;
+	ov->width = info->var.xres;
+	ov->height = info->var.yres;
+	fbtft_overlay_damage_all(par);
+	mutex_unlock(&par->update_lock);
+
+	return 0;
+}
+
+static int fbtft_overlay_fb_blank(int blank, struct fb_info *info)
+{
+	struct fbtft_par *par = info->par;
+	struct fbtft_overlay *ov = par->overlay;
+
+	mutex_lock(&par->update_lock);
+	fbtft_overlay_damage_all(par);
+	ov->visible = blank == FB_BLANK_UNBLANK;
+	fbtft_overlay_damage_all(par);
+	mutex_unlock(&par->update_lock);
+
+	return 0;
+}
+
+static ssize_t show_position(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(device);
+	struct fbtft_par *par = info->par;
+
+	return snprintf(buf, PAGE_SIZE, "%u,%u\n", par->overlay->x,
+			par->overlay->y);
+}
+
+/* only the lines it leaves and the lines it moves to are rewritten */
+static ssize_t store_position(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *info = dev_get_drvdata(device);
+	struct fbtft_par *par = info->par;
+	struct fbtft_overlay *ov = par->overlay;
+	unsigned x, y;
+
+	if (sscanf(buf, "%u,%u", &x, &y) != 2)
+		return -EINVAL;
+	if (x >= par->info->var.xres || y >= par->info->var.yres)
+		return -EINVAL;
+
+	mutex_lock(&par->update_lock);
+	fbtft_overlay_damage_all(par);
+	ov->x = x;
+	ov->y = y;
+	fbtft_overlay_damage_all(par);
+	mutex_unlock(&par->update_lock);
+
+	return count;
+}
+
+static ssize_t show_colorkey(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(device);
+	struct fbtft_par *par = info->par;
+
+	if (par->overlay->colorkey < 0)
+		return snprintf(buf, PAGE_SIZE, "-1\n");
+
+	return snprintf(buf, PAGE_SIZE, "0x%04x\n", par->overlay->colorkey);
+}
+
+static ssize_t store_colorkey(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *info = dev_get_drvdata(device);
+	struct fbtft_par *par = info->par;
+	int colorkey;
+	int ret;
+
+	ret = kstrtoint(buf, 0, &colorkey);
+	if (ret)
+		return ret;
+	if (colorkey < -1 || colorkey > 0xffff)
+		return -EINVAL;
+
+	mutex_lock(&par->update_lock);
+	par->overlay->colorkey = colorkey;
+	fbtft_overlay_damage_all(par);
+	mutex_unlock(&par->update_lock);
+
+	return count;
+}
+
+static ssize_t show_alpha(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(device);
+	struct fbtft_par *par = info->par;
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", par->overlay->alpha);
+}
+
+static ssize_t store_alpha(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *info = dev_get_drvdata(device);
+	struct fbtft_par *par = info->par;
+	u8 alpha;
+	int ret;
+
+	ret = kstrtou8(buf, 0, &alpha);
+	if (ret)
+		return ret;
+
+	mutex_lock(&par->update_lock);
+	par->overlay->alpha = alpha;
+	fbtft_overlay_damage_all(par);
+	mutex_unlock(&par->update_lock);
+
+	return count;
+}
+
+static struct device_attribute overlay_device_attrs[] = {
+	__ATTR(position, S_IRUGO | S_IWUSR, show_position, store_position),
+	__ATTR(colorkey, S_IRUGO | S_IWUSR, show_colorkey, store_colorkey),
+	__ATTR(alpha, S_IRUGO | S_IWUSR, show_alpha, store_alpha),
+};
+
+/**
+ * fbtft_overlay_init() - Register the overlay plane of a display
+ * @par: Driver data of the registered display
+ *
+ * Displays that don't take an overlay are left as they are.
+ */
+void fbtft_overlay_init(struct fbtft_par *par)
+{
+	struct fb_info *display = par->info;
+	struct fbtft_overlay *ov;
+	struct fb_deferred_io *fbdefio = NULL;
+	struct fb_ops *fbops = NULL;
+	struct fb_info *info = NULL;
+	size_t vmem_size;
+	u8 *vmem = NULL;
+	int ret = -ENOMEM;
+	int i;
+
+	/* composed during the RGB conversion, in frame coordinates */
+	if (!fbtft_rgb_capable(par) || par->panel.buf ||
+			display->var.bits_per_pixel < 16) {
+		dev_info(display->dev, "no overlay on this display\n");
+		return;
+	}
+
+	ov = kzalloc(sizeof(*ov), GFP_KERNEL);
+	if (!ov)
+		goto err;
+	/* one transmit buffer of 2-byte pixels, from up to 32 bpp */
+	ov->buflen = par->txbuf.len * 2;
+	ov->buf = kmalloc(ov->buflen, GFP_KERNEL);
+	if (!ov->buf)
+		goto err;
+
+	vmem_size = PAGE_ALIGN(display->var.xres * display->var.yres * 2);
+	vmem = vzalloc(vmem_size);
+	fbops = kzalloc(sizeof(*fbops), GFP_KERNEL);
+	fbdefio = kzalloc(sizeof(*fbdefio), GFP_KERNEL);
+	info = framebuffer_alloc(0, display->device);
+	if (!vmem || !fbops || !fbdefio || !info)
+		goto err;
+
+	/* the ops find the display and the overlay through par */
+	info->par = par;
+	info->screen_base = (u8 __force __iomem *)vmem;
+	info->fbops = fbops;
+	info->fbdefio = fbdefio;
+	info->pseudo_palette = ov->pseudo_palette;
+
+	fbops->owner        =      display->fbops->owner;
+	fbops->fb_read      =      fb_sys_read;
+	fbops->fb_write     =      fbtft_overlay_fb_write;
+	fbops->fb_fillrect  =      fbtft_overlay_fb_fillrect;
+	fbops->fb_copyarea  =      fbtft_overlay_fb_copyarea;
+	fbops->fb_imageblit =      fbtft_overlay_fb_imageblit;
+	fbops->fb_setcolreg =      fbtft_fb_setcolreg;
+	fbops->fb_blank     =      fbtft_overlay_fb_blank;
+	fbops->fb_check_var =      fbtft_overlay_fb_check_var;
+	fbops->fb_set_par   =      fbtft_overlay_fb_set_par;
+
+	fbdefio->delay =           display->fbdefio->delay;
+	fbdefio->deferred_io =     fbtft_overlay_deferred_io;
+	fb_deferred_io_init(info);
+
+	snprintf(info->fix.id, sizeof(info->fix.id), "%s ovl", display->fix.id);
+	info->fix.type =           FB_TYPE_PACKED_PIXELS;
+	info->fix.visual =         FB_VISUAL_TRUECOLOR;
+	info->fix.line_length =    display->var.xres * 2;
+	info->fix.accel =          FB_ACCEL_NONE;
+	info->fix.smem_len =       vmem_size;
+
+	info->var.xres =           display->var.xres;
+	info->var.yres =           display->var.yres;
+	info->var.xres_virtual =   info->var.xres;
+	info->var.yres_virtual =   info->var.yres;
+	info->var.bits_per_pixel = 16;
+	info->var.red.offset =     11;
+	info->var.red.length =     5;
+	info->var.green.offset =   5;
+	info->var.green.length =   6;
+	info->var.blue.offset =    0;
+	info->var.blue.length =    5;
+
+	info->flags =              FBINFO_FLAG_DEFAULT | FBINFO_VIRTFB;
+
+	ov->info = info;
+	ov->width = info->var.xres;
+	ov->height = info->var.yres;
+	ov->colorkey = -1;
+	ov->alpha = 255;
+
+	mutex_lock(&par->update_lock);
+	par->overlay = ov;
+	mutex_unlock(&par->update_lock);
+
+	ret = register_framebuffer(info);
+	if (ret < 0)
+		goto err_detach;
+
+	for (i = 0; i < ARRAY_SIZE(overlay_device_attrs); i++)
+		device_create_file(info->dev, &overlay_device_attrs[i]);
+
+	dev_info(info->dev, "overlay on %s, %ux%u\n", dev_name(display->dev),
+		info->var.xres, info->var.yres);
+
+	return;
+
+err_detach:
+	mutex_lock(&par->update_lock);
+	par->overlay = NULL;
+	mutex_unlock(&par->update_lock);
+	fb_deferred_io_cleanup(info);
+err:
+	dev_err(display->dev, "%s: failed with %d\n", __func__, ret);
+	if (info)
+		framebuffer_release(info);
+	kfree(fbdefio);
+	kfree(fbops);
+	vfree(vmem);
+	if (ov)
+		kfree(ov->buf);
+	kfree(ov);
+}
+
+/**
+ * fbtft_overlay_exit() - Remove the overlay plane of a display
+ * @par: Driver data
+ */
+void fbtft_overlay_exit(struct fbtft_par *par)
+{
+	struct fbtft_overlay *ov = par->overlay;
+	struct fb_info *info;
+	int i;
+
+	if (!ov)
+		return;
+	info = ov->info;
+
+	for (i = 0; i < ARRAY_SIZE(overlay_device_attrs); i++)
+		device_remove_file(info->dev, &overlay_device_attrs[i]);
+	unregister_framebuffer(info);
+
+	mutex_lock(&par->update_lock);
+	fbtft_overlay_damage_all(par);
+	par->overlay = NULL;
+	mutex_unlock(&par->update_lock);
+
+	/* pending overlay damage finds no overlay */
+	fb_deferred_io_cleanup(info);
+	vfree((void __force *)info->screen_base);
+	kfree(info->fbdefio);
+	kfree(info->fbops);
+	framebuffer_release(info);
+	kfree(ov->buf);
+	kfree(ov);
+}
@@ -0,0 +1,446 @@
+/*
+ * Software rotation for FBTFT, for controllers that can't remap their
+ * memory
+ *
+ * Drivers rotate with fbtftops.set_var(), which programs the controller's
+ * scan direction. Drivers without it get the frame turned here: video
+ * memory stays in the orientation userspace draws in, and each display
+ * update first copies the damaged lines into @panel.buf, a frame in the
+ * controller's orientation. fbtft_vmem(), fbtft_line_offset() and the
+ * @panel geometry point write_vmem() and set_addr_win() at that frame, so
+ * drivers don't have to know about the rotation.
+ *
+ * 180 degrees is a reversed copy of each line, and a band of damaged
+ * lines stays a band of panel lines. For 90 and 270 each line becomes a
+ * column of the panel, so every panel line changes. The lines are turned
+ * in tiles of 8x8 pixels: the 8 lines read and the 8 panel lines written
+ * for a tile stay in the cache until it's done, instead of each pixel
+ * missing on a panel line of its own. 1 bpp tiles are transposed in a
+ * register, see fbtft_transpose8(), and 4 bpp ones have the nibbles of
+ * two lines paired up a byte at a time.
+ *
+ * Video memory has the pixel order the fbdev drawing functions use, the
+ * first pixel of a byte in the low bits on little endian hosts and in the
+ * high bits on big endian. @panel.buf uses the same order.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/export.h>
+#include <linux/errno.h>
+#include <linux/bitrev.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "fbtft.h"
+
+#define ROT_TILE	8
+
+#ifdef __LITTLE_ENDIAN
+/* shift of the pixel at bit @bit of a line */
+#define ROT_SHIFT(bit, bpp)	((bit) % 8)
+/* 1 bpp byte with the first pixel in bit 7, and back */
+#define ROT_MSB(byte)		bitrev8(byte)
+/* 4 bpp: first and second pixel of a byte, and a byte of two pixels */
+#define ROT_P0(byte)		((byte) & 0x0F)
+#define ROT_P1(byte)		((byte) >> 4)
+#define ROT_PACK(p0, p1)	((p0) | (p1) << 4)
+#else
+#define ROT_SHIFT(bit, bpp)	(8 - (bpp) - (bit) % 8)
+#define ROT_MSB(byte)		(byte)
+#define ROT_P0(byte)		((byte) >> 4)
+#define ROT_P1(byte)		((byte) & 0x0F)
+#define ROT_PACK(p0, p1)	((p0) << 4 | (p1))
+#endif
+
+struct fbtft_rot {
+	const u8 *src;		/* displayed frame */
+	size_t pitch;
+	unsigned width;
+	unsigned height;
+	u8 *dst;		/* @panel.buf */
+	size_t dpitch;
+	unsigned pw;
+	unsigned ph;
+	unsigned bpp;
+	unsigned rotate;
+};
+
+/* panel pixel of frame pixel @x, @y */
+static inline void rot_map(const struct fbtft_rot *r, unsigned x, unsigned y,
+					unsigned *px, unsigned *py)
+{
+	switch (r->rotate) {
+	case 90:
+		*px = r->pw - 1 - y;
+		*py = x;
+		break;
+	case 180:
+		*px = r->pw - 1 - x;
+		*py = r->ph - 1 - y;
+		break;
+	default:
+		*px = y;
+		*py = r->ph - 1 - x;
+		break;
+	}
+}
+
+static inline unsigned rot_get(const u8 *line, unsigned x, unsigned bpp)
+{
+	unsigned bit = x * bpp;
+
+	return line[bit / 8] >> ROT_SHIFT(bit, bpp) & ((1 << bpp) - 1);
+}
+
+static inline void rot_put(u8 *line, unsigned x, unsigned bpp, unsigned val)
+{
+	unsigned bit = x * bpp, shift = ROT_SHIFT(bit, bpp);
+	u8 *p = line + bit / 8;
+
+	*p = (*p & ~(((1 << bpp) - 1) << shift)) | val << shift;
+}
+
+/* any rotation and depth, a pixel at a time but still in tiles */
+static void rot_pixels(const struct fbtft_rot *r, unsigned ys, unsigned ye)
+{
+	unsigned tx, ty, x, y, xe, te, px, py;
+
+	for (ty = ys; ty <= ye; ty += ROT_TILE) {
+		te = min(ty + ROT_TILE - 1, ye);
+		for (tx = 0; tx < r->width; tx += ROT_TILE) {
+			xe = min(tx + ROT_TILE, r->width);
+			for (y = ty; y <= te; y++) {
+				for (x = tx; x < xe; x++) {
+					rot_map(r, x, y, &px, &py);
+					rot_put(r->dst + py * r->dpitch, px,
+						r->bpp, rot_get(r->src +
+						y * r->pitch, x, r->bpp));
+				}
+			}
+		}
+	}
+}
+
+/* 8 bpp and up, @cpp bytes per pixel: inlined with a constant */
+static inline void rot_180_bytes(const struct fbtft_rot *r, unsigned ys,
+					unsigned ye, unsigned cpp)
+{
+	const u8 *s;
+	unsigned x, y;
+	u8 *d;
+
+	for (y = ys; y <= ye; y++) {
+		s = r->src + y * r->pitch;
+		d = r->dst + (r->ph - 1 - y) * r->dpitch + (r->pw - 1) * cpp;
+		for (x = 0; x < r->width; x++, s += cpp, d -= cpp)
+			memcpy(d, s, cpp);
+	}
+}
+
+/* 1 and 4 bpp lines without padding: reverse the bytes and their pixels */
+static void rot_180_packed(const struct fbtft_rot *r, unsigned ys,
+								unsigned ye)
+{
+	size_t len = r->width * r->bpp / 8, i;
+	const u8 *s;
+	unsigned y;
+	u8 *d;
+
+	for (y = ys; y <= ye; y++) {
+		s = r->src + y * r->pitch;
+		d = r->dst + (r->ph - 1 - y) * r->dpitch + len - 1;
+		if (r->bpp == 1)
+			for (i = 0; i < len; i++)
+				*d-- = bitrev8(s[i]);
+		else
+			for (i = 0; i < len; i++)
+				*d-- = s[i] << 4 | s[i] >> 4;
+	}
+}
+
+/* 90 and 270 degrees, 8 bpp and up */
+static inline void rot_90_bytes(const struct fbtft_rot *r, unsigned ys,
+					unsigned ye, unsigned cpp)
+{
+	ptrdiff_t dx, dy;
+	unsigned tx, ty, x, y, te, xe;
+	const u8 *s;
+	u8 *base, *d;
+
+	/* panel pixel of frame pixel 0,0 and the steps for x and y */
+	if (r->rotate == 90) {
+		base = r->dst + (r->pw - 1) * cpp;
+		dx = r->dpitch;
+		dy = -(ptrdiff_t)cpp;
+	} else {
+		base = r->dst + (r->ph - 1) * r->dpitch;
+		dx = -(ptrdiff_t)r->dpitch;
+		dy = cpp;
+	}
+
+	for (ty = ys; ty <= ye; ty += ROT_TILE) {
+		te = min(ty + ROT_TILE - 1, ye);
+		for (tx = 0; tx < r->width; tx += ROT_TILE) {
+			xe = min(tx + ROT_TILE, r->width);
+			for (y = ty; y <= te; y++) {
+				s = r->src + y * r->pitch + tx * cpp;
+				d = base + tx * dx + y * dy;
+				for (x = tx; x < xe; x++, s += cpp, d += dx)
+					memcpy(d, s, cpp);
+			}
+		}
+	}
+}
+
+/*
+ * 90 and 270 degrees, 1 bpp. The 8 lines that become the pixels of one
+ * panel byte are a tile row: each byte of it is an 8x8 tile, transposed
+ * to one byte for each of 8 panel lines. The tile rows are aligned to the
+ * panel bytes, so the lines around the damage can be turned too. Tile
+ * rows cut off by the edge of the frame go a pixel at a time.
+ */
+static void rot_90_mono(const struct fbtft_rot *r, unsigned ys, unsigned ye)
+{
+	bool cw = r->rotate == 90;
+	unsigned phase = cw ? r->pw % 8 : 0;
+	unsigned bytes = DIV_ROUND_UP(r->width, 8);
+	unsigned bx, i, n, x, py;
+	int g = (int)ys - (int)((ys + 8 - phase) % 8);
+	size_t col;
+	u64 tile;
+
+	for (; g <= (int)ye; g += 8) {
+		if (g < 0 || g + 8 > r->height) {
+			rot_pixels(r, max_t(int, g, ys),
+					min_t(unsigned, g + 7, ye));
+			continue;
+		}
+
+		/* panel byte the tile row goes to */
+		col = (cw ? r->pw - 8 - g : g) / 8;
+		for (bx = 0; bx < bytes; bx++) {
+			/* the line that goes to the first pixel of the byte */
+			tile = 0;
+			for (i = 0; i < 8; i++)
+				tile = tile << 8 | ROT_MSB(r->src[(g +
+					(cw ? 7 - i : i)) * r->pitch + bx]);
+
+			tile = fbtft_transpose8(tile);
+
+			n = min(8U, r->width - bx * 8);
+			for (i = 0; i < n; i++) {
+				x = bx * 8 + i;
+				py = cw ? x : r->ph - 1 - x;
+				r->dst[py * r->dpitch + col] =
+						ROT_MSB((u8)(tile >> (56 - 8 * i)));
+			}
+		}
+	}
+}
+
+/*
+ * 90 and 270 degrees, 4 bpp. Two lines make the pixels of a panel byte,
+ * and a byte of each holds the pixels of two panel lines. The pairs are
+ * aligned to the panel bytes like the tile rows in rot_90_mono(), and
+ * turned in tiles of 8 lines and 8 pixels.
+ */
+static void rot_90_gray(const struct fbtft_rot *r, unsigned ys, unsigned ye)
+{
+	bool cw = r->rotate == 90;
+	unsigned phase = cw ? r->pw % 2 : 0;
+	unsigned bytes = r->width / 2;
+	unsigned bx, be, tb, x, y, px, py, py0, py1;
+	int g = (int)ys - (int)((ys + 2 - phase) % 2);
+	int tg, ge;
+	const u8 *s0, *s1;
+	size_t col;
+	u8 a, b;
+
+	for (; g <= (int)ye; g += ROT_TILE) {
+		ge = min_t(int, g + ROT_TILE - 2, ye);
+		for (tb = 0; tb < bytes; tb += ROT_TILE / 2) {
+			be = min(tb + ROT_TILE / 2, bytes);
+			for (tg = g; tg <= ge; tg += 2) {
+				if (tg < 0 || tg + 2 > r->height)
+					continue;
+				/* the line with the first pixel of the byte */
+				s0 = r->src + (cw ? tg + 1 : tg) * r->pitch;
+				s1 = r->src + (cw ? tg : tg + 1) * r->pitch;
+				col = (cw ? r->pw - 2 - tg : tg) / 2;
+				for (bx = tb; bx < be; bx++) {
+					a = s0[bx];
+					b = s1[bx];
+					x = bx * 2;
+					py0 = cw ? x : r->ph - 1 - x;
+					py1 = cw ? x + 1 : r->ph - 2 - x;
+					r->dst[py0 * r->dpitch + col] =
+						ROT_PACK(ROT_P0(a), ROT_P0(b));
+					r->dst[py1 * r->dpitch + col] =
+						ROT_PACK(ROT_P1(a), ROT_P1(b));
+				}
+			}
+		}
+	}
+
+	/* lines without a partner at the edges, the last pixel of odd lines */
+	if (phase && ys == 0)
+		rot_pixels(r, 0, 0);
+	if ((r->height - 1) % 2 == phase && ye == r->height - 1)
+		rot_pixels(r, ye, ye);
+	if (r->width % 2) {
+		for (y = ys; y <= ye; y++) {
+			rot_map(r, r->width - 1, y, &px, &py);
+			rot_put(r->dst + py * r->dpitch, px, 4, rot_get(r->src +
+					y * r->pitch, r->width - 1, 4));
+		}
+	}
+}
+
+/**
+ * fbtft_rotate() - Turn lines of the displayed frame to panel orientation
+ * @par: Driver data
+ * @start_line: First line of the frame
+ * @end_line: Last line of the frame
+ * @panel_start: Returns the first panel line that changed
+ * @panel_end: Returns the last panel line that changed
+ *
+ * Updates @panel.buf from video memory at @pan.scanout.
+ */
+void fbtft_rotate(struct fbtft_par *par, unsigned start_line,
+		unsigned end_line, unsigned *panel_start, unsigned *panel_end)
+{
+	struct fb_info *info = par->info;
+	struct fbtft_rot r = {
+		.src = (u8 __force *)info->screen_base +
+				par->pan.scanout * info->fix.line_length,
+		.pitch = info->fix.line_length,
+		.width = info->var.xres,
+		.height = info->var.yres,
+		.dst = par->panel.buf,
+		.dpitch = par->panel.line_length,
+		.pw = par->panel.width,
+		.ph = par->panel.height,
+		.bpp = info->var.bits_per_pixel,
+		.rotate = info->var.rotate,
+	};
+
+	if (r.rotate == 180) {
+		*panel_start = r.ph - 1 - end_line;
+		*panel_end = r.ph - 1 - start_line;
+		switch (r.bpp) {
+		case 8:
+			rot_180_bytes(&r, start_line, end_line, 1);
+			break;
+		case 16:
+			rot_180_bytes(&r, start_line, end_line, 2);
+			break;
+		case 24:
+			rot_180_bytes(&r, start_line, end_line, 3);
+			break;
+		case 32:
+			rot_180_bytes(&r, start_line, end_line, 4);
+			break;
+		default:
+			if (r.width * r.bpp % 8)
+				rot_pixels(&r, start_line, end_line);
+			else
+				rot_180_packed(&r, start_line, end_line);
+			break;
+		}
+		return;
+	}
+
+	*panel_start = 0;
+	*panel_end = r.ph - 1;
+	switch (r.bpp) {
+	case 1:
+		rot_90_mono(&r, start_line, end_line);
+		break;
+	case 4:
+		rot_90_gray(&r, start_line, end_line);
+		break;
+	case 8:
+		rot_90_bytes(&r, start_line, end_line, 1);
+		break;
+	case 16:
+		rot_90_bytes(&r, start_line, end_line, 2);
+		break;
+	case 24:
+		rot_90_bytes(&r, start_line, end_line, 3);
+		break;
+	case 32:
+		rot_90_bytes(&r, start_line, end_line, 4);
+		break;
+	default:
+		rot_pixels(&r, start_line, end_line);
+		break;
+	}
+}
+EXPORT_SYMBOL(fbtft_rotate);
+
+/**
+ * fbtft_rotate_update() - Write lines of the frame through @panel.buf
+ * @par: Driver data
+ * @start_line: First line of the frame
+ * @end_line: Last line of the frame
+ *
+ * Return: the number of panel lines written, or negative if write_vmem()
+ * failed
+ */
+int fbtft_rotate_update(struct fbtft_par *par, unsigned start_line,
+							unsigned end_line)
+{
+	unsigned ps, pe;
+	int ret;
+
+	fbtft_rotate(par, start_line, end_line, &ps, &pe);
+
+	if (par->fbtftops.set_addr_win)
+		par->fbtftops.set_addr_win(par, 0, ps, par->panel.width - 1,
+									pe);
+	ret = par->fbtftops.write_vmem(par, fbtft_line_offset(par, ps),
+					(pe - ps + 1) * par->panel.line_length);
+
+	return ret < 0 ? ret : pe - ps + 1;
+}
+EXPORT_SYMBOL(fbtft_rotate_update);
+
+/**
+ * fbtft_rotate_init() - Rotate in software
+ * @par: Driver data
+ *
+ * Called for a rotated display whose driver has no set_var(). Switches
+ * the @panel geometry to the controller's orientation.
+ *
+ * Return: 0, or -ENOMEM
+ */
+int fbtft_rotate_init(struct fbtft_par *par)
+{
+	struct fb_info *info = par->info;
+	unsigned frames = info->var.yres_virtual / info->var.yres;
+	unsigned bpp = info->var.bits_per_pixel;
+	size_t size;
+
+	if (info->var.rotate == 90 || info->var.rotate == 270) {
+		par->panel.width = info->var.yres;
+		par->panel.height = info->var.xres;
+	}
+	par->panel.line_length = DIV_ROUND_UP(par->panel.width * bpp, 8);
+
+	/* room for a frame of any depth set_par() can switch to */
+	size = max_t(size_t, info->fix.smem_len / frames,
+			par->panel.line_length * par->panel.height);
+	par->panel.buf = vzalloc(size);
+	if (!par->panel.buf)
+		return -ENOMEM;
+
+	dev_info(info->device, "rotating %u degrees in software\n",
+							info->var.rotate);
+
+	return 0;
+}
+EXPORT_SYMBOL(fbtft_rotate_init);
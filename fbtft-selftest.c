@@ -0,0 +1,409 @@
+/*
+ * Bus throughput self-test for FBTFT
+ *
+ * Pushes frames through the driver's own set_addr_win()/write_vmem() to
+ * find the achievable full frame and partial update rates, then sends
+ * blocks of blank pixel data of growing size through write() to split
+ * the bus cost into bytes/s and a fixed per-message overhead. The display
+ * is redrawn from video memory afterwards.
+ *
+ * Runs at probe with the 'selftest' module parameter, or when 1 is
+ * written to /sys/class/graphics/fbN/selftest, which also shows the
+ * results.
+ *
+ * fbtft_calibrate_speed() raises the pixel data clock step by step,
+ * writing test patterns to GRAM and reading them back with RAMRD at the
+ * (slow) read clock, and keeps the highest clock that passes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/gpio.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/log2.h>
+
+#include "fbtft.h"
+
+#define SELFTEST_MIN_CHUNK	64
+#define SELFTEST_MAX_CHUNK	65536
+
+/* recommend the smallest txbuflen that keeps overhead below 1/20 */
+#define SELFTEST_OVERHEAD_RATIO	20
+
+/* returns the average time in ns to update lines start..end, 0 on error */
+static u64 selftest_update(struct fbtft_par *par, unsigned start_line,
+					unsigned end_line, unsigned count)
+{
+	size_t len = (end_line - start_line + 1) * par->panel.line_length;
+	u64 start;
+	unsigned i;
+
+	start = ktime_to_ns(ktime_get());
+	for (i = 0; i < count; i++) {
+		if (par->fbtftops.set_addr_win)
+			par->fbtftops.set_addr_win(par, 0, start_line,
+						par->panel.width - 1, end_line);
+		if (par->fbtftops.write_vmem(par,
+				fbtft_line_offset(par, start_line), len) < 0)
+			return 0;
+	}
+
+	return div_u64(ktime_to_ns(ktime_get()) - start, count);
+}
+
+/*
+ * Times write() for chunk sizes from SELFTEST_MIN_CHUNK up, and fits
+ * time = overhead + len * slope. Only done where pixel data can't be
+ * mistaken for commands: with a dc gpio or on a 9-bit bus.
+ */
+static int selftest_chunks(struct fbtft_par *par, s64 *slope_ps,
+							s64 *overhead_ns)
+{
+	bool bus9 = par->pdata && par->pdata->display.buswidth == 9;
+	size_t frame = par->panel.line_length * par->panel.height;
+	size_t max_chunk = SELFTEST_MAX_CHUNK;
+	s64 sx = 0, sy = 0, sxx = 0, sxy = 0, n = 0, den;
+	size_t chunk, i, count;
+	u16 *words;
+	void *buf;
+	u64 start, ns;
+	int ret = 0;
+
+	if ((par->gpio.dc == -1 && !bus9) || par->startbyte)
+		return -EOPNOTSUPP;
+
+	/* fbtft_write_spi_emulate_9() converts through par->extra */
+	if (fbtft_emulate_9(par))
+		max_chunk = min_t(size_t, max_chunk, par->txbuf.len & ~7);
+
+	do {
+		buf = kmalloc(max_chunk, GFP_KERNEL | __GFP_NOWARN);
+	} while (!buf && (max_chunk /= 2) >= PAGE_SIZE);
+	if (!buf)
+		return -ENOMEM;
+
+	if (bus9) {
+		for (words = buf, i = 0; i < max_chunk / 2; i++)
+			words[i] = 0x0100;
+	} else {
+		memset(buf, 0, max_chunk);
+	}
+
+	if (par->fbtftops.set_addr_win)
+		par->fbtftops.set_addr_win(par, 0, 0, par->panel.width - 1,
+							par->panel.height - 1);
+	if (par->gpio.dc != -1)
+		gpio_set_value(par->gpio.dc, 1);
+
+	for (chunk = SELFTEST_MIN_CHUNK; chunk <= max_chunk; chunk *= 4) {
+		count = max_t(size_t, 4, frame / chunk);
+		start = ktime_to_ns(ktime_get());
+		for (i = 0; i < count; i++) {
+			ret = par->fbtftops.write(par, buf, chunk);
+			if (ret < 0)
+				goto out;
+		}
+		ns = div_u64(ktime_to_ns(ktime_get()) - start, count);
+		fbtft_par_dbg(DEBUG_UPDATE_DISPLAY, par,
+			"%s: %zu bytes in %llu ns\n", __func__, chunk, ns);
+
+		sx += chunk;
+		sy += ns;
+		sxx += (s64)chunk * chunk;
+		sxy += (s64)chunk * ns;
+		n++;
+	}
+
+	den = n * sxx - sx * sx;
+	if (n < 2 || !den) {
+		ret = -EINVAL;
+		goto out;
+	}
+	*slope_ps = div64_s64((n * sxy - sx * sy) * 1000, den);
+	if (*slope_ps <= 0) {
+		ret = -EINVAL;
+		goto out;
+	}
+	*overhead_ns = div64_s64(sy * 1000 - *slope_ps * sx, n * 1000);
+	if (*overhead_ns < 0)
+		*overhead_ns = 0;
+	ret = 0;
+
+out:
+	kfree(buf);
+	return ret;
+}
+
+/**
+ * fbtft_selftest() - Measure what the display connection sustains
+ * @par: Driver data
+ *
+ * Results are stored in par->selftest. Serialized against display
+ * updates with par->update_lock.
+ *
+ * Return: 0 if successful, negative if error
+ */
+int fbtft_selftest(struct fbtft_par *par)
+{
+	struct fb_info *info = par->info;
+	unsigned lines = max_t(unsigned, 1, par->panel.height / 8);
+	size_t frame = par->panel.line_length * par->panel.height;
+	s64 slope_ps, overhead_ns;
+	u64 full_ns, partial_ns;
+	size_t txbuflen = 0;
+	int ret;
+
+	mutex_lock(&par->update_lock);
+
+	full_ns = selftest_update(par, 0, par->panel.height - 1, 4);
+	partial_ns = selftest_update(par, 0, lines - 1, 16);
+	if (!full_ns || !partial_ns) {
+		ret = -EIO;
+		goto out;
+	}
+
+	par->selftest.full_fps = div64_u64(NSEC_PER_SEC, full_ns);
+	par->selftest.partial_fps = div64_u64(NSEC_PER_SEC, partial_ns);
+
+	ret = selftest_chunks(par, &slope_ps, &overhead_ns);
+	if (ret == 0) {
+		par->selftest.bytes_per_sec = div64_s64(1000LL * NSEC_PER_SEC,
+								slope_ps);
+		par->selftest.msg_overhead_ns = overhead_ns;
+		txbuflen = div64_s64(SELFTEST_OVERHEAD_RATIO * overhead_ns *
+							1000, slope_ps);
+		txbuflen = clamp_t(size_t, roundup_pow_of_two(txbuflen + 1),
+					PAGE_SIZE, SELFTEST_MAX_CHUNK);
+	} else {
+		/* conversion included, so a lower bound */
+		par->selftest.bytes_per_sec = div64_u64((u64)frame *
+							NSEC_PER_SEC, full_ns);
+		par->selftest.msg_overhead_ns = 0;
+		ret = 0;
+	}
+	par->selftest.txbuflen = txbuflen;
+	par->selftest.done = true;
+
+	/* put back what the test overwrote */
+	selftest_update(par, 0, par->panel.height - 1, 1);
+
+out:
+	mutex_unlock(&par->update_lock);
+
+	if (ret)
+		dev_err(info->device, "%s: failed: %d\n", __func__, ret);
+	else
+		dev_info(info->device,
+			"selftest: %u KiB/s, %u us/message, fps %u full, %u at %u lines, recommended txbuflen %u\n",
+			par->selftest.bytes_per_sec >> 10,
+			par->selftest.msg_overhead_ns / 1000,
+			par->selftest.full_fps, par->selftest.partial_fps,
+			lines, par->selftest.txbuflen);
+
+	return ret;
+}
+EXPORT_SYMBOL(fbtft_selftest);
+
+#define CALIBRATE_PIXELS	64
+#define CALIBRATE_PASSES	4
+#define CALIBRATE_RAMRD		0x2E
+
+/* fills pattern number pass, with bit patterns that stress the bus */
+static void calibrate_pattern(u16 *pix, unsigned n, unsigned pass)
+{
+	u32 lfsr = 0xACE1u + pass;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		switch (pass % CALIBRATE_PASSES) {
+		case 0:
+			pix[i] = (i & 1) ? 0xAAAA : 0x5555;
+			break;
+		case 1:
+			pix[i] = (i & 1) ? 0xFFFF : 0x0000;
+			break;
+		case 2:
+			pix[i] = i * 0x0421;
+			break;
+		default:
+			lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);
+			pix[i] = lfsr;
+		}
+	}
+}
+
+/*
+ * Writes n pixels to the top left of GRAM at the current pixel clock and
+ * reads them back as RGB666. 0 if they match.
+ */
+static int calibrate_readback(struct fbtft_par *par, u16 *pix, unsigned n,
+					bool bus9, void *tx, void *rx)
+{
+	bool rx16 = par->spi->bits_per_word > 8;
+	size_t rxlen = (1 + 3 * n) * (rx16 ? 2 : 1);
+	u16 *tx16 = tx, *rxw = rx;
+	u8 *tx8 = tx, *rxb = rx;
+	unsigned i, c;
+	u8 got, expect[3];
+	static const u8 mask[3] = { 0xF8, 0xFC, 0xF8 };
+	int ret;
+
+	for (i = 0; i < n; i++) {
+		if (bus9) {
+			tx16[2 * i] = 0x0100 | (pix[i] >> 8);
+			tx16[2 * i + 1] = 0x0100 | (pix[i] & 0xFF);
+		} else {
+			tx8[2 * i] = pix[i] >> 8;
+			tx8[2 * i + 1] = pix[i] & 0xFF;
+		}
+	}
+
+	par->fbtftops.set_addr_win(par, 0, 0, n - 1, 0);
+	if (par->gpio.dc != -1)
+		gpio_set_value(par->gpio.dc, 1);
+	ret = par->fbtftops.write(par, tx, n * (bus9 ? 4 : 2));
+	if (ret < 0)
+		return ret;
+
+	write_reg(par, CALIBRATE_RAMRD);
+	if (par->gpio.dc != -1)
+		gpio_set_value(par->gpio.dc, 1);
+	memset(rx, 0, rxlen);
+	ret = par->fbtftops.read(par, rx, rxlen);
+	if (ret < 0)
+		return ret;
+
+	/* the first byte clocked out is a dummy */
+	for (i = 0; i < n; i++) {
+		expect[0] = (pix[i] >> 8) & 0xF8;
+		expect[1] = (pix[i] >> 3) & 0xFC;
+		expect[2] = (pix[i] << 3) & 0xF8;
+		for (c = 0; c < 3; c++) {
+			got = rx16 ? rxw[1 + 3 * i + c] : rxb[1 + 3 * i + c];
+			if ((got & mask[c]) != expect[c])
+				return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+static bool calibrate_test(struct fbtft_par *par, u32 hz, unsigned passes,
+				u16 *pix, unsigned n, bool bus9, void *tx,
+				void *rx)
+{
+	unsigned pass;
+
+	par->speed.data = hz;
+	for (pass = 0; pass < passes; pass++) {
+		calibrate_pattern(pix, n, pass);
+		if (calibrate_readback(par, pix, n, bus9, tx, rx))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * fbtft_calibrate_speed() - Find the highest reliable pixel data clock
+ * @par: Driver data
+ * @max_hz: Highest clock to try
+ *
+ * Needs a MIPI DCS style controller that supports RAMRD (0x2E) with
+ * 16-bit writes and 18-bit reads, and a bus where data can be told from
+ * commands (dc gpio or 9-bit). Reads stay at par->speed.read, so only the
+ * write path is tested. The highest clock that passes, less 1/8 for margin
+ * but not below the starting clock, is stored in par->speed.data. That is
+ * left unchanged if readback doesn't work at the starting clock.
+ *
+ * Return: 0 if successful, negative if error
+ */
+int fbtft_calibrate_speed(struct fbtft_par *par, u32 max_hz)
+{
+	struct fb_info *info = par->info;
+	bool bus9 = par->pdata && par->pdata->display.buswidth == 9;
+	u32 orig = par->speed.data, base, good, bad = 0, mid;
+	unsigned n = min_t(unsigned, CALIBRATE_PIXELS, par->panel.width);
+	void *tx = NULL, *rx = NULL;
+	u16 *pix = NULL;
+	int ret = 0;
+
+	if (!par->spi || !par->fbtftops.read || !par->fbtftops.set_addr_win ||
+			par->startbyte || (par->gpio.dc == -1 && !bus9))
+		return -EOPNOTSUPP;
+
+	/* fbtft_write_spi_emulate_9() converts through par->extra */
+	if (fbtft_emulate_9(par))
+		n = min_t(unsigned, n, (par->txbuf.len / 4) & ~1);
+	if (n < 2)
+		return -EOPNOTSUPP;
+
+	pix = kmalloc(n * sizeof(u16), GFP_KERNEL);
+	tx = kmalloc(n * 4, GFP_KERNEL);
+	rx = kmalloc((1 + 3 * n) * 2, GFP_KERNEL);
+	if (!pix || !tx || !rx) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	mutex_lock(&par->update_lock);
+
+	base = orig ? orig : par->spi->max_speed_hz;
+	if (!calibrate_test(par, base, CALIBRATE_PASSES, pix, n, bus9,
+								tx, rx)) {
+		par->speed.data = orig;
+		mutex_unlock(&par->update_lock);
+		dev_warn(info->device,
+			"%s: readback fails at %u Hz, keeping the default\n",
+			__func__, base);
+		ret = -EIO;
+		goto out;
+	}
+
+	/* double until it fails, then bisect down to 1/16 */
+	good = base;
+	while (good < max_hz) {
+		mid = min_t(u64, (u64)good * 2, max_hz);
+		if (!calibrate_test(par, mid, CALIBRATE_PASSES, pix, n, bus9,
+								tx, rx)) {
+			bad = mid;
+			break;
+		}
+		good = mid;
+	}
+	while (bad && bad - good > good / 16) {
+		mid = good + (bad - good) / 2;
+		if (calibrate_test(par, mid, CALIBRATE_PASSES, pix, n, bus9,
+								tx, rx))
+			good = mid;
+		else
+			bad = mid;
+	}
+
+	/* confirm with more passes, backing off by 1/8 on failure */
+	while (good > base && !calibrate_test(par, good,
+				4 * CALIBRATE_PASSES, pix, n, bus9, tx, rx))
+		good = max(base, good - good / 8);
+	/* and keep 1/8 below the clock that passed, for margin */
+	good = max(base, good - good / 8);
+
+	par->speed.data = good;
+	mutex_unlock(&par->update_lock);
+
+	dev_info(info->device, "pixel clock calibrated to %u Hz (from %u Hz)\n",
+								good, base);
+
+out:
+	kfree(pix);
+	kfree(tx);
+	kfree(rx);
+
+	return ret;
+}
+EXPORT_SYMBOL(fbtft_calibrate_speed);
@@ -1,3 +1,6 @@
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
 #include "fbtft.h"
 
 
@@ -206,17 +209,360 @@ static ssize_t show_debug(struct device *device,
 static struct device_attribute debug_device_attr = \
 	__ATTR(debug, S_IRUGO | S_IWUGO, show_debug, store_debug);
 
+/*
+ * Display update counters, read by Scripts/fbbench.py.
+ * last_done is CLOCK_MONOTONIC in ns. Write 0 to reset.
+ */
+static ssize_t store_stats(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+	unsigned long val;
+	int ret;
+
+	ret = kstrtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+	if (val)
+		return -EINVAL;
+
+	spin_lock(&par->dirty_lock);
+	memset(&par->stats, 0, sizeof(par->stats));
+	spin_unlock(&par->dirty_lock);
+
+	return count;
+}
+
+static ssize_t show_stats(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+	typeof(par->stats) stats;
+	int len;
+
+	spin_lock(&par->dirty_lock);
+	stats = par->stats;
+	spin_unlock(&par->dirty_lock);
+
+	len = snprintf(buf, PAGE_SIZE,
+		"frames %llu\nlines %llu\nbytes %llu\nbusy_ns %llu\n"
+		"last_ns %llu\nlast_done %llu\nurgent_lines %llu\n"
+		"stream_frames %llu\nflips %llu\n",
+		stats.frames, stats.lines, stats.bytes, stats.busy_ns,
+		stats.last_ns, stats.last_done, stats.urgent_lines,
+		stats.stream_frames, stats.flips);
+	if (par->gpio.te >= 0)
+		len += snprintf(buf + len, PAGE_SIZE - len,
+			"te_period_ns %u\nte_synced %llu\nte_late %llu\n"
+			"te_unsynced %llu\n",
+			fbtft_te_period_ns(par), stats.te_synced,
+			stats.te_late, stats.te_unsynced);
+	else if (fbtft_te_chasing(par))
+		len += snprintf(buf + len, PAGE_SIZE - len,
+			"te_period_ns %u\nscan_bands %llu\nscan_waits %llu\n"
+			"scan_missed %llu\n",
+			fbtft_te_period_ns(par), stats.scan_bands,
+			stats.scan_waits, stats.scan_missed);
+
+	return len;
+}
+
+static struct device_attribute stats_device_attr = \
+	__ATTR(stats, S_IRUGO | S_IWUSR, show_stats, store_stats);
+
+/* write 1 to run fbtft_selftest(), read for the results */
+static ssize_t store_selftest(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+	unsigned long val;
+	int ret;
+
+	ret = kstrtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+	if (val != 1)
+		return -EINVAL;
+
+	ret = fbtft_selftest(par);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static ssize_t show_selftest(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+
+	if (!par->selftest.done)
+		return snprintf(buf, PAGE_SIZE, "not run\n");
+
+	return snprintf(buf, PAGE_SIZE,
+		"bytes_per_sec %u\nmsg_overhead_ns %u\nfull_fps %u\n"
+		"partial_fps %u\ntxbuflen %u\n",
+		par->selftest.bytes_per_sec, par->selftest.msg_overhead_ns,
+		par->selftest.full_fps, par->selftest.partial_fps,
+		par->selftest.txbuflen);
+}
+
+static struct device_attribute selftest_device_attr = \
+	__ATTR(selftest, S_IRUGO | S_IWUSR, show_selftest, store_selftest);
+
+
+/*
+ * Runtime tuning: fps, txbuflen, speed and mode have the same meaning as
+ * the fbtft_device parameters, stream turns on fbtft_fb_write_stream().
+ * Changes are made with par->update_lock held, so they take effect
+ * between two display updates.
+ */
+static ssize_t store_fps(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	unsigned long fps;
+	int ret;
+
+	ret = kstrtoul(buf, 10, &fps);
+	if (ret)
+		return ret;
+	if (fps < 1 || fps > HZ)
+		return -EINVAL;
+
+	/* picked up when the next deferred io work is scheduled */
+	fb_info->fbdefio->delay = HZ / fps;
+
+	return count;
+}
+
+static ssize_t show_fps(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+
+	return snprintf(buf, PAGE_SIZE, "%lu\n", HZ / fb_info->fbdefio->delay);
+}
+
+/* only the generic write_vmem() functions cope with any txbuf size */
+static bool txbuflen_tunable(struct fbtft_par *par)
+{
+	return par->txbuf.buf && fbtft_write_vmem_generic(par);
+}
+
+static ssize_t store_txbuflen(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+	bool emulate_9 = fbtft_emulate_9(par);
+	void *txbuf, *extra = NULL;
+	unsigned long len;
+	int ret;
+
+	ret = kstrtoul(buf, 10, &len);
+	if (ret)
+		return ret;
+
+	/* fbtft_write_spi_emulate_9() needs multiples of 8 */
+	len &= ~7UL;
+	if (len < 64 || len > fb_info->fix.smem_len)
+		return -EINVAL;
+	if (!txbuflen_tunable(par))
+		return -EPERM;
+
+	txbuf = kzalloc(len, GFP_KERNEL);
+	if (!txbuf)
+		return -ENOMEM;
+	if (emulate_9) {
+		extra = vzalloc(len + (len / 8) + 8);
+		if (!extra) {
+			kfree(txbuf);
+			return -ENOMEM;
+		}
+	}
+
+	mutex_lock(&par->update_lock);
+	swap(par->txbuf.buf, txbuf);
+	par->txbuf.len = len;
+	if (emulate_9)
+		swap(par->extra, extra);
+	mutex_unlock(&par->update_lock);
+
+	kfree(txbuf);
+	vfree(extra);
+
+	return count;
+}
+
+static ssize_t show_txbuflen(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+
+	return snprintf(buf, PAGE_SIZE, "%zu\n", par->txbuf.len);
+}
+
+/* see fbtft_fb_write() */
+static ssize_t store_stream(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+	unsigned long val;
+	int ret;
+
+	ret = kstrtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+	if (val > 1)
+		return -EINVAL;
+	if (val && !fbtft_stream_capable(par))
+		return -EPERM;
+
+	mutex_lock(&par->update_lock);
+	par->stream = val;
+	mutex_unlock(&par->update_lock);
+
+	return count;
+}
+
+static ssize_t show_stream(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+
+	return snprintf(buf, PAGE_SIZE, "%d\n", par->stream);
+}
+
+static ssize_t store_speed(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+	unsigned long speed;
+	u32 old;
+	int ret;
+
+	ret = kstrtoul(buf, 10, &speed);
+	if (ret)
+		return ret;
+	if (!speed || speed > UINT_MAX)
+		return -EINVAL;
+
+	mutex_lock(&par->update_lock);
+	old = par->spi->max_speed_hz;
+	par->spi->max_speed_hz = speed;
+	ret = spi_setup(par->spi);
+	if (ret) {
+		par->spi->max_speed_hz = old;
+		spi_setup(par->spi);
+	} else {
+		/* overrides a calibrated pixel clock */
+		par->speed.data = 0;
+	}
+	mutex_unlock(&par->update_lock);
+
+	return ret ? ret : count;
+}
+
+static ssize_t show_speed(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", par->speed.data ?
+					par->speed.data : par->spi->max_speed_hz);
+}
+
+static ssize_t store_mode(struct device *device,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+	unsigned long mode;
+	u16 old;
+	int ret;
+
+	ret = kstrtoul(buf, 0, &mode);
+	if (ret)
+		return ret;
+	if (mode > 0xFFFF)
+		return -EINVAL;
+
+	mutex_lock(&par->update_lock);
+	old = par->spi->mode;
+	par->spi->mode = mode;
+	ret = spi_setup(par->spi);
+	if (ret) {
+		par->spi->mode = old;
+		spi_setup(par->spi);
+	}
+	mutex_unlock(&par->update_lock);
+
+	return ret ? ret : count;
+}
+
+static ssize_t show_mode(struct device *device,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *fb_info = dev_get_drvdata(device);
+	struct fbtft_par *par = fb_info->par;
+
+	return snprintf(buf, PAGE_SIZE, "0x%02x\n", par->spi->mode);
+}
+
+static struct device_attribute tuning_device_attrs[] = {
+	__ATTR(fps, S_IRUGO | S_IWUSR, show_fps, store_fps),
+	__ATTR(txbuflen, S_IRUGO | S_IWUSR, show_txbuflen, store_txbuflen),
+	__ATTR(stream, S_IRUGO | S_IWUSR, show_stream, store_stream),
+	__ATTR(speed, S_IRUGO | S_IWUSR, show_speed, store_speed),
+	__ATTR(mode, S_IRUGO | S_IWUSR, show_mode, store_mode),
+};
+
+/* speed and mode only apply to SPI devices */
+static int tuning_device_attrs_num(struct fbtft_par *par)
+{
+	return par->spi ? ARRAY_SIZE(tuning_device_attrs) : 3;
+}
+
 
 void fbtft_sysfs_init(struct fbtft_par *par)
 {
+	int i;
+
 	device_create_file(par->info->dev, &debug_device_attr);
+	device_create_file(par->info->dev, &stats_device_attr);
+	device_create_file(par->info->dev, &selftest_device_attr);
+	for (i = 0; i < tuning_device_attrs_num(par); i++)
+		device_create_file(par->info->dev, &tuning_device_attrs[i]);
 	if (par->gamma.curves && par->fbtftops.set_gamma)
 		device_create_file(par->info->dev, &gamma_device_attrs[0]);
 }
 
 void fbtft_sysfs_exit(struct fbtft_par *par)
 {
+	int i;
+
 	device_remove_file(par->info->dev, &debug_device_attr);
+	device_remove_file(par->info->dev, &stats_device_attr);
+	device_remove_file(par->info->dev, &selftest_device_attr);
+	for (i = 0; i < tuning_device_attrs_num(par); i++)
+		device_remove_file(par->info->dev, &tuning_device_attrs[i]);
 	if (par->gamma.curves && par->fbtftops.set_gamma)
 		device_remove_file(par->info->dev, &gamma_device_attrs[0]);
 }
@@ -0,0 +1,513 @@
+/*
+ * Tearing effect (TE) synchronized display updates for FBTFT
+ *
+ * When a 'te' gpio is given and the driver provides fbtftops.set_tear()
+ * (fbtft_set_tear() for MIPI DCS controllers), the controller's TE output
+ * is enabled with it and its rising edges (start of vertical blank) are
+ * timestamped from the gpio interrupt. fbtft_update_display() then starts
+ * each pixel transfer on an edge:
+ *
+ *  - if the write is fast enough to stay ahead of the scan over the whole
+ *    band, it starts right away and the band shows up in the next frame
+ *  - otherwise it waits until the scan has passed the band and trails it,
+ *    so the band shows up in the frame after that
+ *
+ * A band that can't be written within one refresh period on either side
+ * of the scan tears anyway, and is counted as late in the stats.
+ * Once the refresh period has been measured it also becomes the deferred
+ * io delay, so updates are paced by the panel and not by the fps setting.
+ *
+ * Without recent TE edges (pin not connected, display off) updates are
+ * not held back, they are only counted as unsynced.
+ *
+ * Panels without the TE pin wired can use the 'scanline' platform data
+ * flag instead. The refresh is then followed by reading the controller's
+ * scanline (Get Scanline, 0x45) and the dirty lines are sent in bands,
+ * each one once the scan has passed it. The window is only set for the
+ * first band, the rest go out with Memory Write Continue (0x3C). A band
+ * the scan catches up with while it is being written is counted as
+ * missed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/gpio.h>
+#include <linux/interrupt.h>
+#include <linux/wait.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/jiffies.h>
+#include <linux/sort.h>
+
+#include "fbtft.h"
+
+/* accepted TE intervals, 10-250 Hz refresh */
+#define TE_MIN_PERIOD_NS	4000000
+#define TE_MAX_PERIOD_NS	100000000
+
+#define DCS_RAMWRC		0x3C
+#define DCS_GETSCAN		0x45
+
+/* scanline samples taken to measure the scan rate */
+#define SCAN_PROBES		16
+#define SCAN_MIN_BAND		8
+/* lines to stay behind the scan, covers errors in the measured rate */
+#define SCAN_MARGIN		4
+
+struct fbtft_te {
+	struct fbtft_par *par;
+	int irq;
+	wait_queue_head_t wait;
+	spinlock_t lock;
+
+	/* protected by lock, updated from the interrupt handler */
+	unsigned long edges;
+	u64 last;
+	u32 period_ns;
+
+	/* measured write time per display line */
+	u32 line_ns;
+	bool paced;
+
+	/* scanline chasing, instead of the TE gpio */
+	bool chase;
+	u32 scan_ns;
+	unsigned scan_lines;
+};
+
+static irqreturn_t fbtft_te_irq(int irq, void *data)
+{
+	struct fbtft_te *te = data;
+	u64 now = ktime_to_ns(ktime_get());
+	u64 delta;
+
+	spin_lock(&te->lock);
+	delta = now - te->last;
+	if (te->last && delta >= TE_MIN_PERIOD_NS && delta <= TE_MAX_PERIOD_NS) {
+		/* smooth out interrupt latency */
+		if (te->period_ns)
+			te->period_ns = (7 * (u64)te->period_ns + delta) >> 3;
+		else
+			te->period_ns = delta;
+	}
+	te->last = now;
+	te->edges++;
+	spin_unlock(&te->lock);
+
+	wake_up(&te->wait);
+
+	return IRQ_HANDLED;
+}
+
+static void fbtft_te_snapshot(struct fbtft_te *te, unsigned long *edges,
+						u64 *last, u32 *period_ns)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&te->lock, flags);
+	*edges = te->edges;
+	*last = te->last;
+	*period_ns = te->period_ns;
+	spin_unlock_irqrestore(&te->lock, flags);
+}
+
+static void fbtft_te_delay(u64 ns)
+{
+	u32 us;
+
+	if (ns < 10 * NSEC_PER_USEC) {
+		ndelay((unsigned long)ns);
+	} else {
+		us = div_u64(ns, NSEC_PER_USEC);
+		usleep_range(us, us + 20);
+	}
+}
+
+/**
+ * fbtft_te_sync() - Wait for the right moment to write a band of lines
+ * @par: Driver data
+ * @start_line: First line of the band
+ * @end_line: Last line of the band
+ *
+ * Called by fbtft_update_display() right before set_addr_win().
+ *
+ * Return: 0 when synchronized, 1 when synchronized but the band is too
+ * large to avoid tearing, -ETIMEDOUT when there are no TE edges
+ */
+int fbtft_te_sync(struct fbtft_par *par, unsigned start_line,
+						unsigned end_line)
+{
+	struct fbtft_te *te = par->te;
+	unsigned long edges, seen;
+	u64 last, now;
+	u32 period_ns;
+	s64 scan, write, offset, delay;
+	s64 s = start_line, e = end_line;
+	bool late;
+
+	fbtft_te_snapshot(te, &seen, &last, &period_ns);
+	now = ktime_to_ns(ktime_get());
+	if (!period_ns || now - last > 2 * TE_MAX_PERIOD_NS)
+		return -ETIMEDOUT;
+
+	if (!te->paced) {
+		par->info->fbdefio->delay =
+			max_t(unsigned long, 1, nsecs_to_jiffies(period_ns));
+		te->paced = true;
+		dev_info(par->info->device,
+			"TE at %u mHz, pacing updates to it\n",
+			(u32)div_u64(1000ULL * NSEC_PER_SEC, period_ns));
+	}
+
+	if (!wait_event_timeout(te->wait, READ_ONCE(te->edges) != seen,
+				nsecs_to_jiffies(2 * period_ns) + 1))
+		return -ETIMEDOUT;
+
+	fbtft_te_snapshot(te, &edges, &last, &period_ns);
+	now = ktime_to_ns(ktime_get());
+	offset = now - last;
+	scan = period_ns / par->info->var.yres;
+	write = te->line_ns;
+
+	/* line y is written at offset + (y - s + 1) * write, scanned at y * scan */
+	if (offset + write <= s * scan &&
+	    offset + (e - s + 1) * write <= e * scan)
+		return 0;
+
+	/* trail the scan: start once it has passed both ends of the band */
+	delay = max_t(s64, s * scan, e * scan - (e - s) * write);
+	late = delay + write > period_ns + s * scan ||
+	       delay + (e - s + 1) * write > period_ns + e * scan;
+	if (delay > offset)
+		fbtft_te_delay(delay - offset);
+
+	return late;
+}
+
+/**
+ * fbtft_te_account() - Record how long a band took to write
+ * @par: Driver data
+ * @lines: Number of lines written
+ * @ns: Time it took
+ */
+void fbtft_te_account(struct fbtft_par *par, unsigned lines, u64 ns)
+{
+	struct fbtft_te *te = par->te;
+	u32 line_ns = div_u64(ns, lines);
+
+	/* small bands are dominated by per-message overhead */
+	if (lines < par->info->var.yres / 8 && te->line_ns)
+		line_ns = min(line_ns, te->line_ns);
+	te->line_ns = line_ns;
+}
+
+/**
+ * fbtft_te_period_ns() - Measured refresh period
+ * @par: Driver data
+ *
+ * Return: period in ns, 0 if unknown or there's no TE gpio
+ */
+u32 fbtft_te_period_ns(struct fbtft_par *par)
+{
+	unsigned long edges;
+	u64 last;
+	u32 period_ns;
+
+	if (!par->te)
+		return 0;
+	fbtft_te_snapshot(par->te, &edges, &last, &period_ns);
+
+	return period_ns;
+}
+
+static int fbtft_te_scanline(struct fbtft_par *par, unsigned *line)
+{
+	bool rx16 = par->spi->bits_per_word > 8;
+	u16 rxw[3] = { 0, };
+	u8 *rxb = (u8 *)rxw;
+	int ret;
+
+	write_reg(par, DCS_GETSCAN);
+	if (par->gpio.dc != -1)
+		gpio_set_value(par->gpio.dc, 1);
+	ret = par->fbtftops.read(par, rxw, rx16 ? 6 : 3);
+	if (ret < 0)
+		return ret;
+
+	/* dummy clock, then GTS[9:8] and GTS[7:0] */
+	if (rx16)
+		*line = (rxw[1] & 0x03) << 8 | (rxw[2] & 0xFF);
+	else
+		*line = (rxb[1] & 0x03) << 8 | rxb[2];
+
+	return 0;
+}
+
+static int fbtft_te_cmp_u32(const void *a, const void *b)
+{
+	return *(const u32 *)a < *(const u32 *)b ? -1 :
+	       *(const u32 *)a > *(const u32 *)b;
+}
+
+/* measure how fast the scanline advances, fails if it doesn't */
+static int fbtft_te_scan_probe(struct fbtft_par *par, struct fbtft_te *te)
+{
+	u32 samples[SCAN_PROBES];
+	unsigned i, n = 0, line0, line1, top = 0;
+	u64 t0, t1;
+
+	if (!par->spi || !par->fbtftops.read || par->startbyte ||
+			(par->gpio.dc == -1 &&
+			 par->pdata->display.buswidth != 9)) {
+		dev_err(par->info->device,
+			"%s: scanline needs reads over SPI with a dc gpio or 9-bit bus\n",
+			__func__);
+		return -EOPNOTSUPP;
+	}
+
+	mutex_lock(&par->update_lock);
+	for (i = 0; i < SCAN_PROBES; i++) {
+		if (fbtft_te_scanline(par, &line0))
+			break;
+		t0 = ktime_to_ns(ktime_get());
+		usleep_range(1000, 1100);
+		if (fbtft_te_scanline(par, &line1))
+			break;
+		t1 = ktime_to_ns(ktime_get());
+		top = max(top, max(line0, line1));
+		if (line1 > line0)
+			samples[n++] = div_u64(t1 - t0, line1 - line0);
+	}
+	mutex_unlock(&par->update_lock);
+
+	if (n < SCAN_PROBES / 4) {
+		dev_err(par->info->device,
+			"%s: the scanline doesn't advance, Get Scanline not supported?\n",
+			__func__);
+		return -ENODEV;
+	}
+
+	sort(samples, n, sizeof(u32), fbtft_te_cmp_u32, NULL);
+	te->scan_ns = samples[n / 2];
+	te->scan_lines = max(par->info->var.yres, top + 1);
+	te->period_ns = te->scan_ns * te->scan_lines;
+	te->chase = true;
+	dev_info(par->info->device,
+		"following the scanline, %u lines of %u ns\n",
+		te->scan_lines, te->scan_ns);
+
+	return 0;
+}
+
+/* true if the scan moving from 'from' to 'to' went through lines bs..be */
+static bool fbtft_te_crossed(unsigned from, unsigned to, unsigned bs,
+						unsigned be)
+{
+	if (to >= from)
+		return from <= be && to >= bs;
+
+	/* wrapped around */
+	return from <= be || to >= bs;
+}
+
+/**
+ * fbtft_te_chasing() - Is the display updated behind the scanline
+ * @par: Driver data
+ *
+ * Return: true if fbtft_te_chase() should do the display updates
+ */
+bool fbtft_te_chasing(struct fbtft_par *par)
+{
+	return par->te && par->te->chase;
+}
+
+/**
+ * fbtft_te_chase() - Write lines in bands behind the scanline
+ * @par: Driver data
+ * @start_line: First line to write
+ * @end_line: Last line to write
+ *
+ * Replaces set_addr_win() and write_vmem() in fbtft_update_display().
+ *
+ * Return: 0 if successful, negative if error
+ */
+int fbtft_te_chase(struct fbtft_par *par, unsigned start_line,
+						unsigned end_line)
+{
+	struct fbtft_te *te = par->te;
+	struct fb_info *info = par->info;
+	unsigned band = max_t(unsigned, SCAN_MIN_BAND, info->var.yres / 8);
+	unsigned bs, be, lines, line, prev_line = 0, prev_bs = 0, prev_be = 0;
+	unsigned waits = 0, missed = 0, bands = 0, i, pos;
+	unsigned n = te->scan_lines;
+	u64 start, wait;
+	int ret = 0;
+
+	for (bs = start_line; bs <= end_line; bs = be + 1) {
+		be = min(bs + band - 1, end_line);
+		lines = be - bs + 1;
+
+		ret = fbtft_te_scanline(par, &line);
+		if (ret < 0)
+			goto out;
+		if (bands && fbtft_te_crossed(prev_line, line, prev_bs, prev_be))
+			missed++;
+
+		/*
+		 * Wait until the scan has passed the band, unless it has gone
+		 * so far that it would be back before the band is written.
+		 */
+		for (i = 0; i < 2; i++) {
+			pos = (line + n - bs % n) % n;
+			if (pos < lines + SCAN_MARGIN)
+				wait = lines + SCAN_MARGIN - pos;
+			else if ((n - pos) * te->scan_ns < lines * te->line_ns)
+				wait = n - pos + lines + SCAN_MARGIN;
+			else
+				break;
+			fbtft_te_delay(wait * te->scan_ns);
+			ret = fbtft_te_scanline(par, &line);
+			if (ret < 0)
+				goto out;
+		}
+		waits += !!i;
+
+		start = ktime_to_ns(ktime_get());
+		if (bs == start_line)
+			par->fbtftops.set_addr_win(par, 0, bs,
+						info->var.xres - 1, end_line);
+		else
+			write_reg(par, DCS_RAMWRC);
+		ret = par->fbtftops.write_vmem(par,
+				fbtft_line_offset(par, bs),
+				lines * info->fix.line_length);
+		if (ret < 0)
+			goto out;
+		fbtft_te_account(par, lines, ktime_to_ns(ktime_get()) - start);
+
+		prev_line = line;
+		prev_bs = bs;
+		prev_be = be;
+		bands++;
+	}
+
+	if (!fbtft_te_scanline(par, &line) &&
+			fbtft_te_crossed(prev_line, line, prev_bs, prev_be))
+		missed++;
+
+out:
+	spin_lock(&par->dirty_lock);
+	par->stats.scan_bands += bands;
+	par->stats.scan_waits += waits;
+	par->stats.scan_missed += missed;
+	spin_unlock(&par->dirty_lock);
+
+	return ret;
+}
+
+/**
+ * fbtft_set_tear() - Generic set_tear() function for MIPI DCS controllers
+ * @par: Driver data
+ * @on: Enable or disable the TE output
+ *
+ * TEON (0x35) with the V-Blank only output mode, or TEOFF (0x34).
+ *
+ * Return: 0
+ */
+int fbtft_set_tear(struct fbtft_par *par, bool on)
+{
+	if (on)
+		write_reg(par, 0x35, 0x00);
+	else
+		write_reg(par, 0x34);
+
+	return 0;
+}
+EXPORT_SYMBOL(fbtft_set_tear);
+
+void fbtft_te_init(struct fbtft_par *par)
+{
+	struct fbtft_te *te;
+	int ret;
+
+	if (par->gpio.te < 0 && !(par->pdata && par->pdata->scanline))
+		return;
+
+	/* turning the TE output on is controller specific */
+	if (par->gpio.te >= 0 && !par->fbtftops.set_tear) {
+		dev_warn(par->info->device,
+			"%s: the driver can't enable the TE output, ignoring the TE gpio\n",
+			__func__);
+		return;
+	}
+
+	te = kzalloc(sizeof(*te), GFP_KERNEL);
+	if (!te)
+		return;
+	te->par = par;
+	init_waitqueue_head(&te->wait);
+	spin_lock_init(&te->lock);
+
+	if (par->gpio.te < 0) {
+		if (fbtft_te_scan_probe(par, te))
+			goto err_free;
+		par->te = te;
+		return;
+	}
+
+	te->irq = gpio_to_irq(par->gpio.te);
+	if (te->irq < 0) {
+		dev_err(par->info->device,
+			"%s: no interrupt for TE gpio %d\n",
+			__func__, par->gpio.te);
+		goto err_free;
+	}
+	ret = request_irq(te->irq, fbtft_te_irq, IRQF_TRIGGER_RISING,
+				par->info->device->driver->name, te);
+	if (ret) {
+		dev_err(par->info->device,
+			"%s: request_irq(%d) failed with %d\n",
+			__func__, te->irq, ret);
+		goto err_free;
+	}
+
+	ret = par->fbtftops.set_tear(par, true);
+	if (ret) {
+		dev_err(par->info->device,
+			"%s: can't enable the TE output (%d)\n", __func__, ret);
+		free_irq(te->irq, te);
+		goto err_free;
+	}
+
+	par->te = te;
+	fbtft_par_dbg(DEBUG_UPDATE_DISPLAY, par,
+		"%s: TE on GPIO%d, irq %d\n", __func__, par->gpio.te, te->irq);
+	return;
+
+err_free:
+	kfree(te);
+}
+
+void fbtft_te_exit(struct fbtft_par *par)
+{
+	struct fbtft_te *te = par->te;
+
+	if (!te)
+		return;
+
+	mutex_lock(&par->update_lock);
+	par->te = NULL;
+	mutex_unlock(&par->update_lock);
+
+	if (!te->chase) {
+		par->fbtftops.set_tear(par, false);
+		free_irq(te->irq, te);
+	}
+	kfree(te);
+}
@@ -0,0 +1,207 @@
+/*
+ * Bus trace capture for FBTFT
+ *
+ * Wraps fbtftops.write() and logs one compact record per bus message into
+ * a per-device ring buffer. The ring is exposed through debugfs and can be
+ * mmapped by userspace (see Scripts/fbtft_trace.py):
+ *
+ *   /sys/kernel/debug/fbtft/<device>/trace         ring buffer (read/mmap)
+ *   /sys/kernel/debug/fbtft/<device>/trace_enable  start/stop capture
+ *
+ * Layout: one page holding struct fbtft_trace_hdr followed by
+ * hdr->num_records records of hdr->record_size bytes each.
+ * Record number n lives in slot (n % num_records).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/gpio.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+
+#include "fbtft.h"
+
+struct fbtft_trace {
+	struct fbtft_trace_hdr *hdr;
+	struct fbtft_trace_rec *recs;
+	size_t size;
+	spinlock_t lock;
+	bool enable;
+	int (*write)(struct fbtft_par *par, void *buf, size_t len);
+	struct dentry *dir;
+};
+
+static struct dentry *fbtft_debugfs_root;
+static unsigned fbtft_debugfs_users;
+static DEFINE_MUTEX(fbtft_debugfs_lock);
+
+static int fbtft_trace_write(struct fbtft_par *par, void *buf, size_t len)
+{
+	struct fbtft_trace *trace = par->trace;
+	struct fbtft_trace_hdr *hdr = trace->hdr;
+	struct fbtft_trace_rec *rec;
+	unsigned long flags;
+	u64 start;
+	u8 dc;
+	int ret;
+
+	if (!trace->enable)
+		return trace->write(par, buf, len);
+
+	dc = (par->gpio.dc != -1) ? !!gpio_get_value(par->gpio.dc) : 0xFF;
+
+	spin_lock_irqsave(&trace->lock, flags);
+	rec = &trace->recs[hdr->head % hdr->num_records];
+	hdr->head++;
+	/* a slot being refilled still holds the timestamp of its last record */
+	rec->ts = 0;
+	spin_unlock_irqrestore(&trace->lock, flags);
+	smp_wmb();
+
+	rec->len = len;
+	rec->dc = dc;
+	rec->flags = 0;
+	rec->caplen = min_t(size_t, len, hdr->payload);
+	if (rec->caplen) {
+		memcpy(rec->data, buf, rec->caplen);
+		rec->flags |= FBTFT_TRACE_PAYLOAD;
+	}
+
+	start = ktime_to_ns(ktime_get());
+	ret = trace->write(par, buf, len);
+	rec->dur = ktime_to_ns(ktime_get()) - start;
+	if (ret < 0)
+		rec->flags |= FBTFT_TRACE_ERROR;
+	/* written last, a zero timestamp marks a record still in flight */
+	smp_wmb();
+	rec->ts = start;
+
+	return ret;
+}
+
+static ssize_t fbtft_trace_read(struct file *file, char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	struct fbtft_trace *trace = file->private_data;
+
+	return simple_read_from_buffer(ubuf, count, ppos, trace->hdr,
+								trace->size);
+}
+
+static int fbtft_trace_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fbtft_trace *trace = file->private_data;
+
+	if (vma->vm_end - vma->vm_start > PAGE_ALIGN(trace->size))
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, trace->hdr, vma->vm_pgoff);
+}
+
+static const struct file_operations fbtft_trace_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = fbtft_trace_read,
+	.mmap = fbtft_trace_mmap,
+	.llseek = default_llseek,
+};
+
+/**
+ * fbtft_trace_init() - Set up bus trace capture
+ * @par: Driver data
+ * @num_records: Ring buffer size in records, 0 disables tracing
+ * @payload: Number of payload bytes to keep per record
+ *
+ * Must be called after the fbtftops are final, since it takes over
+ * fbtftops.write().
+ */
+void fbtft_trace_init(struct fbtft_par *par, unsigned num_records,
+							unsigned payload)
+{
+	struct fbtft_trace *trace;
+	struct fbtft_trace_hdr *hdr;
+	size_t size;
+
+	if (!num_records || !par->fbtftops.write)
+		return;
+
+	trace = kzalloc(sizeof(*trace), GFP_KERNEL);
+	if (!trace)
+		return;
+
+	payload = min_t(unsigned, payload, FBTFT_TRACE_DATA_LEN);
+	size = PAGE_SIZE + num_records * sizeof(struct fbtft_trace_rec);
+	hdr = vmalloc_user(size);
+	if (!hdr) {
+		dev_err(par->info->device,
+			"%s: could not allocate %zu bytes trace buffer\n",
+			__func__, size);
+		kfree(trace);
+		return;
+	}
+	hdr->magic = FBTFT_TRACE_MAGIC;
+	hdr->version = 1;
+	hdr->hdr_size = PAGE_SIZE;
+	hdr->record_size = sizeof(struct fbtft_trace_rec);
+	hdr->num_records = num_records;
+	hdr->payload = payload;
+	hdr->buswidth = par->pdata ? par->pdata->display.buswidth : 0;
+
+	trace->hdr = hdr;
+	trace->recs = (void *)hdr + PAGE_SIZE;
+	trace->size = size;
+	trace->enable = true;
+	spin_lock_init(&trace->lock);
+
+	mutex_lock(&fbtft_debugfs_lock);
+	if (!fbtft_debugfs_root)
+		fbtft_debugfs_root = debugfs_create_dir("fbtft", NULL);
+	fbtft_debugfs_users++;
+	mutex_unlock(&fbtft_debugfs_lock);
+
+	trace->dir = debugfs_create_dir(dev_name(par->info->device),
+							fbtft_debugfs_root);
+	debugfs_create_file("trace", S_IRUSR, trace->dir, trace,
+							&fbtft_trace_fops);
+	debugfs_create_bool("trace_enable", S_IRUSR | S_IWUSR, trace->dir,
+							&trace->enable);
+
+	trace->write = par->fbtftops.write;
+	par->trace = trace;
+	par->fbtftops.write = fbtft_trace_write;
+
+	dev_info(par->info->device,
+		"bus trace: %u records, %u bytes payload\n",
+		num_records, payload);
+}
+
+void fbtft_trace_exit(struct fbtft_par *par)
+{
+	struct fbtft_trace *trace = par->trace;
+
+	if (!trace)
+		return;
+
+	par->fbtftops.write = trace->write;
+	par->trace = NULL;
+	debugfs_remove_recursive(trace->dir);
+
+	mutex_lock(&fbtft_debugfs_lock);
+	if (!--fbtft_debugfs_users) {
+		debugfs_remove(fbtft_debugfs_root);
+		fbtft_debugfs_root = NULL;
+	}
+	mutex_unlock(&fbtft_debugfs_lock);
+
+	vfree(trace->hdr);
+	kfree(trace);
+}
@@ -51,6 +51,113 @@ struct fbtft_gpio {
 };
 
 struct fbtft_par;
+struct fbtft_trace;
+struct fbtft_te;
+struct eventfd_ctx;
+
+/*
+ * fbtft specific ioctls, see fbtft-ioctl.c
+ */
+
+/**
+ * struct fbtft_rect - Damaged rectangle
+ * @x: Left column
+ * @y: Top line
+ * @width: Width in pixels
+ * @height: Height in lines
+ */
+struct fbtft_rect {
+	__u32 x;
+	__u32 y;
+	__u32 width;
+	__u32 height;
+};
+
+/* stop tracking mmap writes, rely on FBTFT_IOCTL_DAMAGE alone */
+#define FBTFT_DAMAGE_NO_FAULTS	(1 << 0)
+
+/**
+ * struct fbtft_damage - Argument to FBTFT_IOCTL_DAMAGE
+ * @flags: FBTFT_DAMAGE_*
+ * @num_rects: Number of rectangles, at most 64
+ * @rects: Userspace pointer to an array of struct fbtft_rect
+ */
+struct fbtft_damage {
+	__u32 flags;
+	__u32 num_rects;
+	__u64 rects;
+};
+
+#define FBTFT_FLUSH_NOW		(1 << 0)	/* don't wait for the fps delay */
+#define FBTFT_FLUSH_WAIT	(1 << 1)	/* return when written, implies NOW */
+
+/**
+ * struct fbtft_flush - Argument to FBTFT_IOCTL_FLUSH
+ * @flags: FBTFT_FLUSH_*, 0 just reads the sequence numbers
+ * @reserved: Must be zero
+ * @seq: Returns the update the damage given so far goes out in
+ * @done: Returns the last update that has been written
+ */
+struct fbtft_flush {
+	__u32 flags;
+	__u32 reserved;
+	__u64 seq;
+	__u64 done;
+};
+
+#define FBTFT_IOCTL_DAMAGE	_IOW('F', 0xF0, struct fbtft_damage)
+#define FBTFT_IOCTL_FLUSH	_IOWR('F', 0xF1, struct fbtft_flush)
+#define FBTFT_IOCTL_EVENTFD	_IOW('F', 0xF2, __s32)
+
+#define FBTFT_TRACE_MAGIC	0x46425452	/* "FBTR" */
+#define FBTFT_TRACE_DATA_LEN	12
+
+/* fbtft_trace_rec.flags */
+#define FBTFT_TRACE_PAYLOAD	(1 << 0)
+#define FBTFT_TRACE_ERROR	(1 << 1)
+
+/**
+ * struct fbtft_trace_hdr - Bus trace ring buffer header (first page)
+ * @magic: FBTFT_TRACE_MAGIC
+ * @version: Layout version
+ * @hdr_size: Offset of the first record
+ * @record_size: Size of one record
+ * @num_records: Number of records in the ring
+ * @payload: Max payload bytes captured per record
+ * @buswidth: Display bus width (9: dc is bit 8 of each 16-bit word)
+ * @head: Total number of records written
+ */
+struct fbtft_trace_hdr {
+	u32 magic;
+	u32 version;
+	u32 hdr_size;
+	u32 record_size;
+	u32 num_records;
+	u32 payload;
+	u32 buswidth;
+	u32 reserved;
+	u64 head;
+};
+
+/**
+ * struct fbtft_trace_rec - One bus message
+ * @ts: Start of write() in ns (CLOCK_MONOTONIC), 0 while in flight
+ * @dur: Duration of write() in ns
+ * @len: Number of bytes written
+ * @dc: State of the dc gpio, 0xFF if there is none
+ * @flags: FBTFT_TRACE_*
+ * @caplen: Number of bytes in @data
+ * @data: First bytes of the message
+ */
+struct fbtft_trace_rec {
+	u64 ts;
+	u32 dur;
+	u32 len;
+	u8 dc;
+	u8 flags;
+	u16 caplen;
+	u8 data[FBTFT_TRACE_DATA_LEN];
+};
 
 /**
  * struct fbtft_ops - FBTFT operations structure
@@ -73,6 +180,8 @@ struct fbtft_par;
  * @set_var: Configure LCD with values from variables like @rotate and @bgr
  *           (optional)
  * @set_gamma: Set Gamma curve (optional)
+ * @set_tear: Enable/disable the tearing effect output (optional), without it
+ *            the TE gpio isn't used. fbtft_set_tear() for MIPI DCS controllers
  *
  * Most of these operations have default functions assigned to them in
  *     fbtft_framebuffer_alloc()
@@ -103,6 +212,7 @@ struct fbtft_ops {
 
 	int (*set_var)(struct fbtft_par *par);
 	int (*set_gamma)(struct fbtft_par *par, unsigned long *curves);
+	int (*set_tear)(struct fbtft_par *par, bool on);
 };
 
 /**
@@ -151,6 +261,14 @@ struct fbtft_display {
  * @txbuflen: Size of transmit buffer
  * @startbyte: When set, enables use of Startbyte in transfers
  * @gamma: String representation of Gamma curve(s)
+ * @speed_cmd: SPI clock for init and commands, 0: max_speed_hz
+ * @speed_read: SPI clock for reads, 0: 2 MHz
+ * @calibrate: Search for the highest reliable pixel clock up to this
+ *             many Hz at probe, needs a controller that supports reads
+ * @scanline: Without a te gpio, follow the controller's scanline
+ *            (Get Scanline, 0x45) to write behind the refresh
+ * @rgb666: The init sequence sets the controller to 18-bit pixels
+ *          (COLMOD 0x66), 8/9-bit buses only
  * @extra: A way to pass extra info
  */
 struct fbtft_platform_data {
@@ -162,9 +280,109 @@ struct fbtft_platform_data {
 	int txbuflen;
 	u8 startbyte;
 	char *gamma;
+	u32 speed_cmd;
+	u32 speed_read;
+	u32 calibrate;
+	bool scanline;
+	bool rgb666;
 	void *extra;
 };
 
+/**
+ * struct fbtft_wall_platform_data - Displays shown as one framebuffer
+ * @panels: Device names of the member displays row by row, e.g. "spi32.0"
+ * @num_panels: Number of entries in @panels
+ * @cols: Displays in a row, 0 puts them all in one row
+ *
+ * Passed to the fbtft_wall platform device in fbtft_platform_data.extra,
+ * see fbtft_wall.c. The members must have the same size and depth.
+ */
+struct fbtft_wall_platform_data {
+	const char * const *panels;
+	unsigned num_panels;
+	unsigned cols;
+};
+
+/**
+ * struct fbtft_gpio_bus - Parallel bus driven through gpiolib
+ * @desc: Data lines db0 and up, followed by /WR
+ * @wr: /WR
+ * @latch: Latch of the low byte on 16-bit buses with 8 data lines
+ * @width: Number of data lines, 0 if there's no parallel bus
+ * @prev: What the data lines are set to
+ * @valid: @prev is known
+ */
+struct fbtft_gpio_bus {
+	struct gpio_desc *desc[17];
+	struct gpio_desc *wr;
+	struct gpio_desc *latch;
+	unsigned width;
+	unsigned long prev;
+	bool valid;
+};
+
+/**
+ * struct fbtft_gpio_regs - Parallel bus through set/clear registers
+ * @set: Register that drives the lines of the bits written to it high
+ * @clr: Register that drives them low
+ * @set_mask: @set value for each byte on db0-db7 and on db8-db15
+ * @clr_mask: @clr value for each byte on db0-db7 and on db8-db15
+ * @wr: /WR bit
+ * @latch: Latch bit
+ */
+struct fbtft_gpio_regs {
+	void __iomem *set;
+	void __iomem *clr;
+	u32 set_mask[2][256];
+	u32 clr_mask[2][256];
+	u32 wr;
+	u32 latch;
+};
+
+/**
+ * struct fbtft_conv - RGB565 to gray and mono conversion tables
+ * @hi: Luma of the high byte of a pixel, red and the top of green
+ * @lo: Luma of the low byte, the bottom of green and blue
+ * @level: Gray level of the top 8 bits of luma
+ * @threshold: Luma above which a mono pixel is set
+ */
+struct fbtft_conv {
+	u16 hi[256];
+	u16 lo[256];
+	u8 level[256];
+	u16 threshold;
+};
+
+/**
+ * struct fbtft_overlay - Overlay plane, see fbtft-overlay.c
+ * @info: Its frame buffer, RGB565
+ * @x: Left edge on the display
+ * @y: Top edge
+ * @width: Its size, info->var.xres
+ * @height: info->var.yres
+ * @visible: Unblanked
+ * @colorkey: RGB565 value that leaves the display visible, -1 for none
+ * @alpha: Opacity of the other pixels, 255 is opaque
+ * @buf: Pixels composed for one transmit buffer
+ * @buflen: Size of @buf
+ * @pseudo_palette: For fbcon
+ *
+ * Changed with the display's update_lock held.
+ */
+struct fbtft_overlay {
+	struct fb_info *info;
+	unsigned x;
+	unsigned y;
+	unsigned width;
+	unsigned height;
+	bool visible;
+	int colorkey;
+	u8 alpha;
+	u8 *buf;
+	size_t buflen;
+	u32 pseudo_palette[16];
+};
+
 /**
  * struct fbtft_par - Main FBTFT data structure
  *
@@ -189,12 +407,16 @@ struct fbtft_platform_data {
  * @dirty_lock: Protects dirty_lines_start and dirty_lines_end
  * @dirty_lines_start: Where to begin updating display
  * @dirty_lines_end: Where to end updating display
+ * @inflight.next: First line the update in progress has yet to send,
+ *                 protected by dirty_lock
+ * @inflight.end: Last line of the update in progress, below .next if idle
  * @gpio.reset: GPIO used to reset display
  * @gpio.dc: Data/Command signal, also known as RS
  * @gpio.rd: Read latching signal
  * @gpio.wr: Write latching signal
  * @gpio.latch: Bus latch signal, eg. 16->8 bit bus latch
  * @gpio.cs: LCD Chip Select with parallel interface bus
+ * @gpio.te: Tearing effect output from the controller
  * @gpio.db[16]: Parallel databus
  * @gpio.led[16]: Led control signals
  * @gpio.aux[16]: Auxillary signals, not used by core
@@ -207,6 +429,59 @@ struct fbtft_platform_data {
  * @current_debug:
  * @first_update_done: Used to only time the first display update
  * @bgr: BGR mode/\n
+ * @trace: Bus trace capture, NULL if not enabled
+ * @stats.frames: Number of display updates, protected by dirty_lock
+ * @stats.lines: Display lines written
+ * @stats.bytes: Video memory bytes written
+ * @stats.busy_ns: Total time spent in display updates
+ * @stats.last_ns: Duration of the last display update
+ * @stats.last_done: ktime_get() in ns when the last update finished
+ * @stats.urgent_lines: Lines written between the bands of another update
+ * @stats.te_synced: Updates started in step with the TE output
+ * @stats.te_late: Synchronized updates too large to avoid tearing
+ * @stats.te_unsynced: Updates done without TE edges to follow
+ * @stats.scan_bands: Bands written behind the scanline
+ * @stats.scan_waits: Bands that had to wait for the scan to pass
+ * @stats.scan_missed: Bands the scan caught up with while being written
+ * @stats.stream_frames: Frames written straight from write(), see @stream
+ * @stats.flips: Frames switched to with FBIOPAN_DISPLAY
+ * @speed.cmd: SPI clock for commands, 0: spi->max_speed_hz
+ * @speed.data: SPI clock for pixel data, 0: spi->max_speed_hz
+ * @speed.read: SPI clock for reads, 0: 2 MHz
+ * @update_lock: Serializes display updates with the self-test
+ * @selftest.done: Set when the results below are valid
+ * @selftest.bytes_per_sec: Sustained bus throughput
+ * @selftest.msg_overhead_ns: Fixed cost of each bus message
+ * @selftest.full_fps: Achievable full display updates per second
+ * @selftest.partial_fps: Same for updates of 1/8 of the lines
+ * @selftest.txbuflen: Recommended txbuflen, 0 if it couldn't be measured
+ * @te: TE synchronization state, NULL without a te gpio
+ * @flush.started: Sequence number of the last update started,
+ *                 protected by dirty_lock
+ * @flush.done: Sequence number of the last update written
+ * @flush.wait: Woken up when an update has been written
+ * @flush.eventfd: Signalled when an update has been written, protected
+ *                 by update_lock
+ * @flush.no_faults: Don't track mmap writes, see FBTFT_DAMAGE_NO_FAULTS
+ * @flush.mmap: fb_mmap() set up by fb_deferred_io_init()
+ * @stream: Write whole frames given to write() without a deferred update
+ * @rgb666: Send pixels as RGB666, see fbtft_platform_data
+ * @pan.yoffset: First video memory line of the frame to display,
+ *               protected by dirty_lock
+ * @pan.scanout: First video memory line of the frame being displayed,
+ *               only changed by fbtft_deferred_io()
+ * @pan.pending: @pan.yoffset still has to be switched to
+ * @gpio_bus: State of the parallel bus, per device
+ * @gpio_regs: Tables to write the parallel bus through registers, NULL
+ *             for gpiolib
+ * @panel.width: Pixels per line as the controller is addressed, see
+ *               fbtft-rotate.c
+ * @panel.height: Lines as the controller is addressed
+ * @panel.line_length: Bytes per line of the frame write_vmem() reads
+ * @panel.buf: The displayed frame turned to the controller's orientation,
+ *             NULL if the controller does the rotation
+ * @conv: Gray and mono conversion, set up by fbtft_conv_init()
+ * @overlay: Overlay plane, NULL if there's none
  * @extra: Extra info needed by driver
  */
 struct fbtft_par {
@@ -226,6 +501,10 @@ struct fbtft_par {
 	spinlock_t dirty_lock;
 	unsigned dirty_lines_start;
 	unsigned dirty_lines_end;
+	struct {
+		unsigned next;
+		unsigned end;
+	} inflight;
 	struct {
 		int reset;
 		int dc;
@@ -233,6 +512,7 @@ struct fbtft_par {
 		int wr;
 		int latch;
 		int cs;
+		int te;
 		int db[16];
 		int led[16];
 		int aux[16];
@@ -247,9 +527,116 @@ struct fbtft_par {
 	unsigned long debug;
 	bool first_update_done;
 	bool bgr;
+	struct fbtft_trace *trace;
+	struct {
+		u64 frames;
+		u64 lines;
+		u64 bytes;
+		u64 busy_ns;
+		u64 last_ns;
+		u64 last_done;
+		u64 urgent_lines;
+		u64 te_synced;
+		u64 te_late;
+		u64 te_unsynced;
+		u64 scan_bands;
+		u64 scan_waits;
+		u64 scan_missed;
+		u64 stream_frames;
+		u64 flips;
+	} stats;
+	struct {
+		u32 cmd;
+		u32 data;
+		u32 read;
+	} speed;
+	struct mutex update_lock;
+	struct {
+		bool done;
+		u32 bytes_per_sec;
+		u32 msg_overhead_ns;
+		u32 full_fps;
+		u32 partial_fps;
+		u32 txbuflen;
+	} selftest;
+	struct fbtft_te *te;
+	struct {
+		u64 started;
+		u64 done;
+		wait_queue_head_t wait;
+		struct eventfd_ctx *eventfd;
+		bool no_faults;
+		int (*mmap)(struct fb_info *info, struct vm_area_struct *vma);
+	} flush;
+	bool stream;
+	bool rgb666;
+	struct {
+		u32 yoffset;
+		u32 scanout;
+		bool pending;
+	} pan;
+	struct {
+		unsigned width;
+		unsigned height;
+		size_t line_length;
+		u8 *buf;
+	} panel;
+	struct fbtft_gpio_bus gpio_bus;
+	struct fbtft_gpio_regs *gpio_regs;
+	struct fbtft_conv *conv;
+	struct fbtft_overlay *overlay;
 	void *extra;
 };
 
+/* the frame write_vmem() reads from */
+static inline u8 *fbtft_vmem(struct fbtft_par *par)
+{
+	return par->panel.buf ?: (u8 __force *)par->info->screen_base;
+}
+
+/* write_vmem() offset of panel line @line, see fbtft_fb_pan_display() */
+static inline size_t fbtft_line_offset(struct fbtft_par *par, unsigned line)
+{
+	unsigned first = par->panel.buf ? 0 : par->pan.scanout;
+
+	return (first + line) * par->panel.line_length;
+}
+
+/* panel line at write_vmem() offset @offset */
+static inline unsigned fbtft_offset_line(struct fbtft_par *par, size_t offset)
+{
+	return (offset - fbtft_line_offset(par, 0)) / par->panel.line_length;
+}
+
+/*
+ * 9-bit bus on an 8-bit SPI master, written with fbtft_write_spi_emulate_9()
+ * through the buffer in par->extra (see fbtft_probe_common())
+ */
+static inline bool fbtft_emulate_9(struct fbtft_par *par)
+{
+	return par->pdata && par->pdata->display.buswidth == 9 &&
+		par->spi && par->spi->bits_per_word == 8;
+}
+
+/*
+ * Transpose an 8x8 bit matrix, row r in byte r from the top. Column c
+ * (bit 7 - c of each row) ends up in byte c from the top, with row r in
+ * bit 7 - r. Hacker's Delight 7-3.
+ */
+static inline u64 fbtft_transpose8(u64 x)
+{
+	u64 t;
+
+	t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+	x ^= t ^ (t << 28);
+
+	return x;
+}
+
 #define NUMARGS(...)  (sizeof((int[]){__VA_ARGS__})/sizeof(int))
 
 #define write_reg(par, ...)                                              \
@@ -268,9 +655,13 @@ extern int fbtft_unregister_framebuffer(struct fb_info *fb_info);
 extern void fbtft_register_backlight(struct fbtft_par *par);
 extern void fbtft_unregister_backlight(struct fbtft_par *par);
 extern int fbtft_init_display(struct fbtft_par *par);
+extern bool fbtft_stream_capable(struct fbtft_par *par);
 extern int fbtft_probe_common(struct fbtft_display *display,
 	struct spi_device *sdev, struct platform_device *pdev);
 extern int fbtft_remove_common(struct device *dev, struct fb_info *info);
+extern void fbtft_update_stats(struct fbtft_par *par, unsigned lines,
+	unsigned urgent, u64 start, int te);
+extern struct fb_info *fbtft_find_framebuffer(const char *name);
 
 /* fbtft-io.c */
 extern int fbtft_write_spi(struct fbtft_par *par, void *buf, size_t len);
@@ -281,17 +672,79 @@ extern int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len);
 extern int fbtft_write_gpio16_wr(struct fbtft_par *par, void *buf, size_t len);
 extern int fbtft_write_gpio16_wr_latched(struct fbtft_par *par,
 	void *buf, size_t len);
+extern int fbtft_gpio_bus_init(struct fbtft_par *par);
+extern void fbtft_gpio_bus_exit(struct fbtft_par *par);
+extern int fbtft_gpio_regs_init(struct fbtft_par *par, void __iomem *set,
+	void __iomem *clr, unsigned base);
+
+/* fbtft-trace.c */
+extern void fbtft_trace_init(struct fbtft_par *par, unsigned num_records,
+	unsigned payload);
+extern void fbtft_trace_exit(struct fbtft_par *par);
+
+/* fbtft-selftest.c */
+extern int fbtft_selftest(struct fbtft_par *par);
+extern int fbtft_calibrate_speed(struct fbtft_par *par, u32 max_hz);
+
+/* fbtft-te.c */
+extern void fbtft_te_init(struct fbtft_par *par);
+extern void fbtft_te_exit(struct fbtft_par *par);
+extern int fbtft_te_sync(struct fbtft_par *par, unsigned start_line,
+						unsigned end_line);
+extern void fbtft_te_account(struct fbtft_par *par, unsigned lines, u64 ns);
+extern u32 fbtft_te_period_ns(struct fbtft_par *par);
+extern bool fbtft_te_chasing(struct fbtft_par *par);
+extern int fbtft_te_chase(struct fbtft_par *par, unsigned start_line,
+						unsigned end_line);
+extern int fbtft_set_tear(struct fbtft_par *par, bool on);
+
+/* fbtft-ioctl.c */
+extern u64 fbtft_flush_begin(struct fbtft_par *par);
+extern void fbtft_flush_end(struct fbtft_par *par, u64 seq);
+extern u64 fbtft_flush(struct fb_info *info, bool wait);
+extern int fbtft_flush_wait(struct fb_info *info, u64 seq, long timeout);
+extern int fbtft_fb_ioctl(struct fb_info *info, unsigned int cmd,
+						unsigned long arg);
+extern int fbtft_fb_mmap(struct fb_info *info, struct vm_area_struct *vma);
+extern void fbtft_flush_exit(struct fbtft_par *par);
 
 /* fbtft-bus.c */
 extern int fbtft_write_vmem8_bus8(struct fbtft_par *par, size_t offset, size_t len);
 extern int fbtft_write_vmem16_bus16(struct fbtft_par *par, size_t offset, size_t len);
 extern int fbtft_write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len);
 extern int fbtft_write_vmem16_bus9(struct fbtft_par *par, size_t offset, size_t len);
+extern bool fbtft_write_vmem_generic(struct fbtft_par *par);
+extern bool fbtft_rgb_capable(struct fbtft_par *par);
 extern void fbtft_write_reg8_bus8(struct fbtft_par *par, int len, ...);
 extern void fbtft_write_reg8_bus9(struct fbtft_par *par, int len, ...);
 extern void fbtft_write_reg16_bus8(struct fbtft_par *par, int len, ...);
 extern void fbtft_write_reg16_bus16(struct fbtft_par *par, int len, ...);
 
+/* fbtft-conv.c */
+extern int fbtft_conv_init(struct fbtft_par *par, unsigned levels,
+	u16 threshold, const u16 *steps);
+extern void fbtft_conv_gray4(const struct fbtft_conv *conv, const u16 *src,
+	u8 *dst, size_t len);
+extern void fbtft_conv_mono(const struct fbtft_conv *conv, const u16 *src,
+	u8 *dst, size_t len);
+extern void fbtft_conv_mono_col(const struct fbtft_conv *conv,
+	const u16 *src, size_t stride, u8 *dst, size_t step, size_t len,
+	bool top_msb);
+extern void fbtft_conv_col1(const u8 *src, size_t pitch, u8 *dst,
+	size_t step, size_t len, bool top_msb);
+extern void fbtft_conv_gray4_native(const u8 *src, u8 *dst, size_t len);
+
+/* fbtft-overlay.c */
+extern void fbtft_overlay_init(struct fbtft_par *par);
+extern void fbtft_overlay_exit(struct fbtft_par *par);
+
+/* fbtft-rotate.c */
+extern int fbtft_rotate_init(struct fbtft_par *par);
+extern void fbtft_rotate(struct fbtft_par *par, unsigned start_line,
+	unsigned end_line, unsigned *panel_start, unsigned *panel_end);
+extern int fbtft_rotate_update(struct fbtft_par *par, unsigned start_line,
+	unsigned end_line);
+
 
 #define FBTFT_REGISTER_DRIVER(_name, _display)                             \
 									   \
@@ -0,0 +1,745 @@
+/*
+ * Virtual MIPI-DCS panel for testing and benchmarking FBTFT drivers
+ *
+ * Registers a fake SPI master with one chip select. Everything written to
+ * it is decoded as ILI9341/ST7735R style DCS commands (CASET, RASET, RAMWR,
+ * RAMWRC, MADCTL, COLMOD, VSCRDEF, VSCRSADD) into an emulated GRAM.
+ * The bus is 9-bit (dc is bit 8 of each word), or 8-bit with dc taken from
+ * the 'dc' gpio when one is given.
+ *
+ * Usage:
+ *   modprobe fbtft_dcs_emul busnum=32 speed=32000000
+ *   modprobe fbtft_device name=dcs_emul_ili9341 busnum=32
+ *   (or name=dcs_emul_st7735r, or name=dcs_emul_flexfb with
+ *    'modprobe flexfb chip=ili9341 buswidth=9')
+ *
+ * With max_hz set, pixel data sent faster than that arrives with bit 0 of
+ * every byte flipped, e.g. to check clock calibration:
+ *   modprobe fbtft_dcs_emul max_hz=24000000
+ *   modprobe fbtft_device name=dcs_emul_ili9341 busnum=32 speed=4000000 \
+ *     calibrate=64000000
+ *
+ * The scan runs at 'refresh' Hz from module load, Get Scanline reports
+ * it and transfers that write GRAM lines while the scan goes through
+ * them are counted as tears, e.g. to check scanline chasing:
+ *   modprobe fbtft_device name=dcs_emul_ili9341 busnum=32 scanline=1
+ *
+ * With panels set, there is one master and panel per bus from busnum on,
+ * each with its own bus thread, e.g. for fbtft_wall:
+ *   modprobe fbtft_dcs_emul panels=2 speed=32000000
+ *   modprobe fbtft_device name=dcs_emul_ili9341 wall=32.0,33.0
+ *
+ * Vertical scrolling (VSCRDEF, VSCRSADD) changes which GRAM line is shown
+ * on each panel line, as on the real controller: 'screen' and the scan
+ * follow it, 'gram' and RAMRD don't. A scroll area that doesn't add up to
+ * the panel height or a start outside of it is logged and not applied.
+ *
+ * debugfs (/sys/kernel/debug/fbtft_dcs_emul/, fbtft_dcs_emul.N/ with panels):
+ *   gram    Emulated GRAM, width x height RGB565 in cpu endianness
+ *   screen  What the panel shows, as gram with the vertical scroll applied
+ *   stats   Command, frame and byte counters
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/gpio.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/fs.h>
+#include <linux/platform_device.h>
+#include <linux/spi/spi.h>
+
+#define DRVNAME "fbtft_dcs_emul"
+
+#define DCS_EMUL_MAX_PANELS	16
+
+static unsigned busnum = 32;
+module_param(busnum, uint, 0);
+MODULE_PARM_DESC(busnum, "SPI bus number of the virtual master (default=32)");
+
+static unsigned panels = 1;
+module_param(panels, uint, 0);
+MODULE_PARM_DESC(panels,
+"Number of virtual masters, on busnum and up (default=1, max=16)");
+
+static unsigned width = 240;
+module_param(width, uint, 0);
+MODULE_PARM_DESC(width, "Panel width (default=240)");
+
+static unsigned height = 320;
+module_param(height, uint, 0);
+MODULE_PARM_DESC(height, "Panel height (default=320)");
+
+static unsigned speed;
+module_param(speed, uint, 0);
+MODULE_PARM_DESC(speed,
+"Virtual bus clock in Hz, transfers are throttled to it (default: 0=unthrottled)");
+
+static unsigned refresh = 60;
+module_param(refresh, uint, 0);
+MODULE_PARM_DESC(refresh, "Panel refresh rate in Hz, used by Get Scanline (default=60)");
+
+static int dc = -1;
+module_param(dc, int, 0);
+MODULE_PARM_DESC(dc, "gpio to read dc from on an 8-bit bus (default: -1=9-bit only)");
+
+static unsigned max_hz;
+module_param(max_hz, uint, 0);
+MODULE_PARM_DESC(max_hz,
+"Pixel data written faster than this gets corrupted, to test clock calibration (default: 0=off)");
+
+#define DCS_NOP			0x00
+#define DCS_SWRESET		0x01
+#define DCS_RDDID		0x04
+#define DCS_CASET		0x2A
+#define DCS_RASET		0x2B
+#define DCS_RAMWR		0x2C
+#define DCS_RAMRD		0x2E
+#define DCS_VSCRDEF		0x33
+#define DCS_MADCTL		0x36
+#define DCS_VSCRSADD		0x37
+#define DCS_COLMOD		0x3A
+#define DCS_RAMWRC		0x3C
+#define DCS_GETSCAN		0x45
+
+#define MADCTL_MY		(1 << 7)
+#define MADCTL_MX		(1 << 6)
+#define MADCTL_MV		(1 << 5)
+
+struct dcs_emul {
+	struct spi_master *master;
+	u16 *gram;
+	struct debugfs_blob_wrapper gram_blob;
+	struct dentry *dir;
+
+	/* decoder */
+	u8 cmd;
+	unsigned nparam;
+	u8 param[8];
+	u8 pix[3];
+	unsigned npix;
+
+	/* controller registers */
+	unsigned xs, xe, ys, ye;
+	unsigned col, row;
+	u8 madctl;
+	u8 colmod;
+	unsigned vscr[3];
+	unsigned vscrsadd;
+	bool scroll;
+	ktime_t epoch;
+	bool corrupt;
+	unsigned wy0, wy1;
+	bool wrote;
+
+	/* statistics */
+	u64 bytes;
+	u64 pixels;
+	u64 cmds;
+	u64 frames;
+	u64 overflows;
+	u64 corrupted;
+	u64 tears;
+	u64 bus_ns;
+};
+
+static void dcs_emul_reset(struct dcs_emul *emul)
+{
+	emul->xs = 0;
+	emul->ys = 0;
+	emul->xe = width - 1;
+	emul->ye = height - 1;
+	emul->madctl = 0;
+	emul->colmod = 0x66;
+	emul->vscr[0] = 0;
+	emul->vscr[1] = height;
+	emul->vscr[2] = 0;
+	emul->vscrsadd = 0;
+	emul->scroll = false;
+}
+
+/* apply VSCRDEF and VSCRSADD if they describe a scroll the panel can do */
+static void dcs_emul_set_scroll(struct dcs_emul *emul)
+{
+	unsigned tfa = emul->vscr[0], vsa = emul->vscr[1], bfa = emul->vscr[2];
+
+	emul->scroll = false;
+	if (tfa + vsa + bfa != height || !vsa) {
+		dev_warn(&emul->master->dev,
+			"unsupported scroll area %u+%u+%u on %u lines, not scrolling\n",
+			tfa, vsa, bfa, height);
+		return;
+	}
+	if (emul->vscrsadd < tfa || emul->vscrsadd >= tfa + vsa) {
+		dev_warn(&emul->master->dev,
+			"unsupported scroll start %u outside of lines %u-%u, not scrolling\n",
+			emul->vscrsadd, tfa, tfa + vsa - 1);
+		return;
+	}
+	emul->scroll = emul->vscrsadd != tfa;
+}
+
+/* GRAM line shown on panel line @line */
+static unsigned dcs_emul_gram_line(struct dcs_emul *emul, unsigned line)
+{
+	unsigned tfa = emul->vscr[0], vsa = emul->vscr[1];
+
+	if (!emul->scroll || line < tfa || line >= tfa + vsa)
+		return line;
+
+	return tfa + (line - tfa + emul->vscrsadd - tfa) % vsa;
+}
+
+/* panel line that shows GRAM line @y */
+static unsigned dcs_emul_panel_line(struct dcs_emul *emul, unsigned y)
+{
+	unsigned tfa = emul->vscr[0], vsa = emul->vscr[1];
+
+	if (!emul->scroll || y < tfa || y >= tfa + vsa)
+		return y;
+
+	return tfa + (y - emul->vscrsadd + vsa) % vsa;
+}
+
+/* address counter -> GRAM index, honouring MADCTL exchange/mirroring */
+static u16 *dcs_emul_pixel(struct dcs_emul *emul, unsigned col, unsigned row)
+{
+	unsigned x = col, y = row;
+
+	if (emul->madctl & MADCTL_MV)
+		swap(x, y);
+	if (emul->madctl & MADCTL_MX)
+		x = width - 1 - x;
+	if (emul->madctl & MADCTL_MY)
+		y = height - 1 - y;
+	if (x >= width || y >= height)
+		return NULL;
+
+	return &emul->gram[y * width + x];
+}
+
+/* GRAM lines written by the current transfer */
+static void dcs_emul_wrote_line(struct dcs_emul *emul, unsigned y)
+{
+	if (!emul->wrote) {
+		emul->wy0 = y;
+		emul->wy1 = y;
+		emul->wrote = true;
+	} else if (y < emul->wy0) {
+		emul->wy0 = y;
+	} else if (y > emul->wy1) {
+		emul->wy1 = y;
+	}
+}
+
+static void dcs_emul_write_pixel(struct dcs_emul *emul, u16 val)
+{
+	u16 *p;
+
+	if (emul->row > emul->ye) {
+		emul->overflows++;
+		return;
+	}
+	p = dcs_emul_pixel(emul, emul->col, emul->row);
+	if (p) {
+		*p = val;
+		dcs_emul_wrote_line(emul, (p - emul->gram) / width);
+	}
+	emul->pixels++;
+	if (++emul->col > emul->xe) {
+		emul->col = emul->xs;
+		emul->row++;
+	}
+}
+
+static void dcs_emul_command(struct dcs_emul *emul, u8 cmd)
+{
+	emul->cmd = cmd;
+	emul->nparam = 0;
+	emul->npix = 0;
+	emul->cmds++;
+
+	switch (cmd) {
+	case DCS_SWRESET:
+		dcs_emul_reset(emul);
+		break;
+	case DCS_RAMWR:
+	case DCS_RAMRD:
+		emul->col = emul->xs;
+		emul->row = emul->ys;
+		emul->frames += (cmd == DCS_RAMWR);
+		break;
+	}
+}
+
+static void dcs_emul_data(struct dcs_emul *emul, u8 val)
+{
+	u8 *p = emul->param;
+	unsigned bpp = ((emul->colmod & 0x7) == 5) ? 2 : 3;
+
+	switch (emul->cmd) {
+	case DCS_RAMWR:
+	case DCS_RAMWRC:
+		if (emul->corrupt) {
+			val ^= 0x01;
+			emul->corrupted++;
+		}
+		emul->pix[emul->npix++] = val;
+		if (emul->npix < bpp)
+			return;
+		emul->npix = 0;
+		if (bpp == 2)
+			dcs_emul_write_pixel(emul, emul->pix[0] << 8 | emul->pix[1]);
+		else
+			dcs_emul_write_pixel(emul, (emul->pix[0] & 0xF8) << 8 |
+						   (emul->pix[1] & 0xFC) << 3 |
+						   emul->pix[2] >> 3);
+		return;
+	}
+
+	if (emul->nparam < ARRAY_SIZE(emul->param))
+		p[emul->nparam] = val;
+	emul->nparam++;
+
+	switch (emul->cmd) {
+	case DCS_CASET:
+		if (emul->nparam == 4) {
+			emul->xs = p[0] << 8 | p[1];
+			emul->xe = p[2] << 8 | p[3];
+		}
+		break;
+	case DCS_RASET:
+		if (emul->nparam == 4) {
+			emul->ys = p[0] << 8 | p[1];
+			emul->ye = p[2] << 8 | p[3];
+		}
+		break;
+	case DCS_MADCTL:
+		emul->madctl = val;
+		break;
+	case DCS_COLMOD:
+		emul->colmod = val;
+		break;
+	case DCS_VSCRDEF:
+		if (emul->nparam == 6) {
+			emul->vscr[0] = p[0] << 8 | p[1];
+			emul->vscr[1] = p[2] << 8 | p[3];
+			emul->vscr[2] = p[4] << 8 | p[5];
+			dcs_emul_set_scroll(emul);
+		}
+		break;
+	case DCS_VSCRSADD:
+		if (emul->nparam == 2) {
+			emul->vscrsadd = p[0] << 8 | p[1];
+			dcs_emul_set_scroll(emul);
+		}
+		break;
+	}
+}
+
+static unsigned dcs_emul_scanline(struct dcs_emul *emul)
+{
+	u32 period = NSEC_PER_SEC / (refresh ? refresh : 60);
+	u64 now = ktime_to_ns(ktime_sub(ktime_get(), emul->epoch));
+	u32 rem = do_div(now, period);
+
+	return div_u64((u64)rem * height, period);
+}
+
+/* true if the scan moving from 'from' to 'to' went through lines y0..y1 */
+static bool dcs_emul_crossed(unsigned from, unsigned to, unsigned y0,
+						unsigned y1)
+{
+	if (to >= from)
+		return from <= y1 && to >= y0;
+
+	return from <= y1 || to >= y0;
+}
+
+/* true if the scan went through a panel line showing GRAM lines y0..y1 */
+static bool dcs_emul_torn(struct dcs_emul *emul, unsigned from, unsigned to,
+						unsigned y0, unsigned y1)
+{
+	unsigned y, line;
+
+	if (!emul->scroll)
+		return dcs_emul_crossed(from, to, y0, y1);
+
+	for (y = y0; y <= y1; y++) {
+		line = dcs_emul_panel_line(emul, y);
+		if (dcs_emul_crossed(from, to, line, line))
+			return true;
+	}
+
+	return false;
+}
+
+/* returns the value of the n'th byte clocked out after a read command */
+static u8 dcs_emul_read(struct dcs_emul *emul, unsigned n)
+{
+	u16 *p, val;
+
+	if (n == 0)
+		return 0x00; /* dummy clock */
+	n--;
+
+	switch (emul->cmd) {
+	case DCS_RDDID:
+		return (const u8 []){ 0x00, 0x93, 0x41 }[n % 3];
+	case DCS_GETSCAN:
+		val = dcs_emul_scanline(emul);
+		return n ? val & 0xFF : val >> 8;
+	case DCS_RAMRD:
+		if (n % 3 == 0 && n) {
+			if (++emul->col > emul->xe) {
+				emul->col = emul->xs;
+				emul->row++;
+			}
+		}
+		p = dcs_emul_pixel(emul, emul->col, emul->row);
+		val = p ? *p : 0;
+		switch (n % 3) {
+		case 0:
+			return (val >> 8) & 0xF8;
+		case 1:
+			return (val >> 3) & 0xFC;
+		default:
+			return (val << 3) & 0xF8;
+		}
+	}
+
+	return 0;
+}
+
+static void dcs_emul_throttle(struct dcs_emul *emul, unsigned bits,
+							unsigned hz, u64 elapsed)
+{
+	u64 ns;
+	u32 us;
+
+	if (speed && (!hz || speed < hz))
+		hz = speed;
+	if (!hz)
+		return;
+
+	ns = (u64)bits * NSEC_PER_SEC;
+	do_div(ns, hz);
+	emul->bus_ns += ns;
+	if (ns <= elapsed)
+		return;
+	ns -= elapsed;
+	if (ns < 10 * NSEC_PER_USEC) {
+		ndelay((unsigned long)ns);
+	} else {
+		us = div_u64(ns, NSEC_PER_USEC);
+		usleep_range(us, us + 10);
+	}
+}
+
+static int dcs_emul_transfer(struct dcs_emul *emul, struct spi_device *spi,
+						struct spi_transfer *t)
+{
+	unsigned bpw = t->bits_per_word ? t->bits_per_word : spi->bits_per_word;
+	unsigned words = (bpw > 8) ? t->len / 2 : t->len;
+	unsigned hz = t->speed_hz ? t->speed_hz : spi->max_speed_hz;
+	const u8 *tx8 = t->tx_buf;
+	const u16 *tx16 = t->tx_buf;
+	u8 *rx8 = t->rx_buf;
+	u16 *rx16 = t->rx_buf;
+	ktime_t start = ktime_get();
+	unsigned beam = dcs_emul_scanline(emul);
+	unsigned i;
+	u16 word;
+	bool data;
+
+	emul->corrupt = max_hz && hz > max_hz;
+	emul->wrote = false;
+	for (i = 0; i < words; i++) {
+		if (rx8) {
+			word = dcs_emul_read(emul, i);
+			if (bpw > 8)
+				rx16[i] = word;
+			else
+				rx8[i] = word;
+		}
+		if (!tx8 || rx8)
+			continue;
+
+		if (bpw > 8) {
+			word = tx16[i];
+			data = word & 0x100;
+		} else {
+			word = tx8[i];
+			data = (dc >= 0) ? gpio_get_value(dc) : true;
+		}
+		if (data)
+			dcs_emul_data(emul, word & 0xFF);
+		else
+			dcs_emul_command(emul, word & 0xFF);
+	}
+	emul->bytes += t->len;
+
+	dcs_emul_throttle(emul, words * (bpw > 8 ? 9 : 8), hz,
+		ktime_to_ns(ktime_sub(ktime_get(), start)));
+
+	if (emul->wrote && dcs_emul_torn(emul, beam, dcs_emul_scanline(emul),
+						emul->wy0, emul->wy1))
+		emul->tears++;
+
+	return 0;
+}
+
+static int dcs_emul_transfer_one_message(struct spi_master *master,
+						struct spi_message *m)
+{
+	struct dcs_emul *emul = spi_master_get_devdata(master);
+	struct spi_transfer *t;
+	int ret = 0;
+
+	list_for_each_entry(t, &m->transfers, transfer_list) {
+		ret = dcs_emul_transfer(emul, m->spi, t);
+		if (ret)
+			break;
+		m->actual_length += t->len;
+		if (t->delay_usecs)
+			udelay(t->delay_usecs);
+	}
+
+	m->status = ret;
+	spi_finalize_current_message(master);
+
+	return ret;
+}
+
+static int dcs_emul_setup(struct spi_device *spi)
+{
+	if (spi->bits_per_word != 8 && spi->bits_per_word != 9)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int dcs_emul_stats_show(struct seq_file *s, void *unused)
+{
+	struct dcs_emul *emul = s->private;
+
+	seq_printf(s, "width: %u\nheight: %u\n", width, height);
+	seq_printf(s, "madctl: 0x%02X\ncolmod: 0x%02X\n",
+					emul->madctl, emul->colmod);
+	seq_printf(s, "window: %u,%u-%u,%u\n",
+				emul->xs, emul->ys, emul->xe, emul->ye);
+	seq_printf(s, "scroll: %u %u %u start=%u%s\n", emul->vscr[0],
+				emul->vscr[1], emul->vscr[2], emul->vscrsadd,
+				emul->scroll ? " (scrolled)" : "");
+	seq_printf(s, "commands: %llu\n", emul->cmds);
+	seq_printf(s, "frames: %llu\n", emul->frames);
+	seq_printf(s, "pixels: %llu\n", emul->pixels);
+	seq_printf(s, "overflows: %llu\n", emul->overflows);
+	seq_printf(s, "corrupted: %llu\n", emul->corrupted);
+	seq_printf(s, "tears: %llu\n", emul->tears);
+	seq_printf(s, "bytes: %llu\n", emul->bytes);
+	seq_printf(s, "bus_ns: %llu\n", emul->bus_ns);
+
+	return 0;
+}
+
+static int dcs_emul_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dcs_emul_stats_show, inode->i_private);
+}
+
+static const struct file_operations dcs_emul_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = dcs_emul_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* the GRAM in panel line order, see dcs_emul_gram_line() */
+static ssize_t dcs_emul_screen_read(struct file *file, char __user *ubuf,
+					size_t count, loff_t *ppos)
+{
+	struct dcs_emul *emul = file->private_data;
+	size_t line_length = width * sizeof(u16);
+	size_t size = line_length * height;
+	size_t pos, off, n, done = 0;
+	u8 *line;
+
+	if (*ppos >= size)
+		return 0;
+	pos = *ppos;
+
+	while (done < count && pos < size) {
+		off = pos % line_length;
+		n = min(count - done, line_length - off);
+		line = (u8 *)&emul->gram[dcs_emul_gram_line(emul,
+						pos / line_length) * width];
+		if (copy_to_user(ubuf + done, line + off, n)) {
+			if (!done)
+				return -EFAULT;
+			break;
+		}
+		done += n;
+		pos += n;
+	}
+	*ppos = pos;
+
+	return done;
+}
+
+static const struct file_operations dcs_emul_screen_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = dcs_emul_screen_read,
+	.llseek = default_llseek,
+};
+
+static int dcs_emul_probe(struct platform_device *pdev)
+{
+	struct spi_master *master;
+	struct dcs_emul *emul;
+	int ret;
+
+	master = spi_alloc_master(&pdev->dev, sizeof(*emul));
+	if (!master)
+		return -ENOMEM;
+
+	emul = spi_master_get_devdata(master);
+	emul->master = master;
+	emul->epoch = ktime_get();
+	dcs_emul_reset(emul);
+
+	emul->gram = vzalloc(width * height * sizeof(u16));
+	if (!emul->gram) {
+		ret = -ENOMEM;
+		goto out_put;
+	}
+
+	master->bus_num = busnum + max(pdev->id, 0);
+	master->num_chipselect = 1;
+	master->mode_bits = SPI_CPOL | SPI_CPHA | SPI_CS_HIGH;
+	master->setup = dcs_emul_setup;
+	master->transfer_one_message = dcs_emul_transfer_one_message;
+	platform_set_drvdata(pdev, master);
+
+	ret = spi_register_master(master);
+	if (ret)
+		goto out_free;
+
+	emul->gram_blob.data = emul->gram;
+	emul->gram_blob.size = width * height * sizeof(u16);
+	emul->dir = debugfs_create_dir(dev_name(&pdev->dev), NULL);
+	debugfs_create_blob("gram", S_IRUSR, emul->dir, &emul->gram_blob);
+	debugfs_create_file("screen", S_IRUSR, emul->dir, emul,
+							&dcs_emul_screen_fops);
+	debugfs_create_file("stats", S_IRUSR, emul->dir, emul,
+							&dcs_emul_stats_fops);
+
+	dev_info(&pdev->dev, "%ux%u panel on spi%u, %u Hz bus, %s\n",
+		width, height, master->bus_num, speed,
+		dc >= 0 ? "dc gpio" : "9-bit");
+
+	return 0;
+
+out_free:
+	vfree(emul->gram);
+out_put:
+	spi_master_put(master);
+
+	return ret;
+}
+
+static int dcs_emul_remove(struct platform_device *pdev)
+{
+	struct spi_master *master = platform_get_drvdata(pdev);
+	struct dcs_emul *emul = spi_master_get_devdata(master);
+
+	debugfs_remove_recursive(emul->dir);
+	spi_master_get(master);
+	spi_unregister_master(master);
+	vfree(emul->gram);
+	spi_master_put(master);
+
+	return 0;
+}
+
+static struct platform_driver dcs_emul_driver = {
+	.driver = {
+		.name   = DRVNAME,
+		.owner  = THIS_MODULE,
+	},
+	.probe  = dcs_emul_probe,
+	.remove = dcs_emul_remove,
+};
+
+static struct platform_device *dcs_emul_pdevs[DCS_EMUL_MAX_PANELS];
+
+static void dcs_emul_unregister(void)
+{
+	unsigned i;
+
+	for (i = 0; i < panels; i++)
+		if (!IS_ERR_OR_NULL(dcs_emul_pdevs[i]))
+			platform_device_unregister(dcs_emul_pdevs[i]);
+}
+
+static int __init dcs_emul_init(void)
+{
+	unsigned i;
+	int ret;
+
+	if (!panels || panels > DCS_EMUL_MAX_PANELS)
+		return -EINVAL;
+
+	ret = platform_driver_register(&dcs_emul_driver);
+	if (ret)
+		return ret;
+
+	/* a single panel keeps the unnumbered name */
+	for (i = 0; i < panels; i++) {
+		dcs_emul_pdevs[i] = platform_device_register_simple(DRVNAME,
+					panels > 1 ? i : -1, NULL, 0);
+		if (IS_ERR(dcs_emul_pdevs[i])) {
+			ret = PTR_ERR(dcs_emul_pdevs[i]);
+			dcs_emul_unregister();
+			platform_driver_unregister(&dcs_emul_driver);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void __exit dcs_emul_exit(void)
+{
+	dcs_emul_unregister();
+	platform_driver_unregister(&dcs_emul_driver);
+}
+
+module_init(dcs_emul_init);
+module_exit(dcs_emul_exit);
+
+MODULE_DESCRIPTION("Virtual MIPI-DCS panel on a loopback SPI master");
+MODULE_LICENSE("GPL");
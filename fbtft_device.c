@@ -28,6 +28,7 @@
 #define DRVNAME "fbtft_device"
 
 #define MAX_GPIOS 32
+#define MAX_WALL 16
 
 struct spi_device *spi_device;
 struct platform_device *p_device;
@@ -58,6 +59,44 @@ static int mode = -1;
 module_param(mode, int, 0);
 MODULE_PARM_DESC(mode, "SPI mode (override device default)");
 
+static unsigned speed_cmd;
+module_param(speed_cmd, uint, 0);
+MODULE_PARM_DESC(speed_cmd,
+"SPI speed for init and commands (default: same as speed)");
+
+static unsigned speed_read;
+module_param(speed_read, uint, 0);
+MODULE_PARM_DESC(speed_read, "SPI speed for reads (default: 2 MHz)");
+
+static unsigned calibrate;
+module_param(calibrate, uint, 0);
+MODULE_PARM_DESC(calibrate,
+"Find the highest reliable pixel data SPI speed up to this value using " \
+"readback (default: 0=off)");
+
+static bool scanline;
+module_param(scanline, bool, 0);
+MODULE_PARM_DESC(scanline,
+"Without a te gpio, read the scanline to write behind the refresh " \
+"(default: off)");
+
+static bool rgb666;
+module_param(rgb666, bool, 0);
+MODULE_PARM_DESC(rgb666,
+"The init sequence sets 18-bit pixels, send RGB666 (default: off)");
+
+static char *wall[MAX_WALL] = { NULL, };
+static int wall_num;
+module_param_array(wall, charp, &wall_num, 0);
+MODULE_PARM_DESC(wall,
+"Add the display on each of these busnum.cs and show them all as one " \
+"framebuffer through fbtft_wall, e.g. wall=0.0,0.1 (SPI displays only)");
+
+static unsigned wall_cols;
+module_param(wall_cols, uint, 0);
+MODULE_PARM_DESC(wall_cols,
+"Displays in a row of the wall (default: 0=all in one row)");
+
 static char *gpios[MAX_GPIOS] = { NULL, };
 static int gpios_num;
 module_param_array(gpios, charp, &gpios_num, 0);
@@ -126,6 +165,13 @@ struct fbtft_device_display {
 	struct platform_device *pdev;
 };
 
+static struct spi_device *wall_devices[MAX_WALL];
+static const char *wall_names[MAX_WALL];
+static struct fbtft_wall_platform_data wall_info = {
+	.panels = wall_names,
+};
+static struct platform_device *wall_device;
+
 static void fbtft_device_pdev_release(struct device *dev);
 
 static int write_gpio16_wr_slow(struct fbtft_par *par, void *buf, size_t len);
@@ -200,6 +246,51 @@ static struct fbtft_device_display displays[] = {
 				},
 			}
 		}
+	}, {
+		.name = "dcs_emul_flexfb",
+		.spi = &(struct spi_board_info) {
+			.modalias = "flexfb",
+			.max_speed_hz = 32000000,
+			.mode = SPI_MODE_0,
+			.platform_data = &(struct fbtft_platform_data) {
+				.display = {
+					.buswidth = 9,
+				},
+				.gpios = (const struct fbtft_gpio []) {
+					{},
+				},
+			}
+		}
+	}, {
+		.name = "dcs_emul_ili9341",
+		.spi = &(struct spi_board_info) {
+			.modalias = "fb_ili9341",
+			.max_speed_hz = 32000000,
+			.mode = SPI_MODE_0,
+			.platform_data = &(struct fbtft_platform_data) {
+				.display = {
+					.buswidth = 9,
+				},
+				.gpios = (const struct fbtft_gpio []) {
+					{},
+				},
+			}
+		}
+	}, {
+		.name = "dcs_emul_st7735r",
+		.spi = &(struct spi_board_info) {
+			.modalias = "fb_st7735r",
+			.max_speed_hz = 32000000,
+			.mode = SPI_MODE_0,
+			.platform_data = &(struct fbtft_platform_data) {
+				.display = {
+					.buswidth = 9,
+				},
+				.gpios = (const struct fbtft_gpio []) {
+					{},
+				},
+			}
+		}
 	}, {
 		.name = "flexfb",
 		.spi = &(struct spi_board_info) {
@@ -732,6 +823,84 @@ static void fbtft_device_delete(struct spi_master *master, unsigned cs)
 	}
 }
 
+static void fbtft_device_wall_delete(void)
+{
+	int i;
+
+	if (wall_device)
+		platform_device_unregister(wall_device);
+	wall_device = NULL;
+
+	for (i = 0; i < wall_num; i++) {
+		if (wall_devices[i])
+			spi_unregister_device(wall_devices[i]);
+		wall_devices[i] = NULL;
+	}
+}
+
+/* add the display on every wall= bus and chip select, and the wall on top */
+static int fbtft_device_wall(struct spi_board_info *spi,
+			struct fbtft_platform_data *pdata)
+{
+	struct fbtft_platform_data wall_pdata = {
+		.fps = pdata->fps,
+		.extra = &wall_info,
+	};
+	struct spi_master *master;
+	unsigned bus, chip;
+	int ret;
+	int i;
+
+	for (i = 0; i < wall_num; i++) {
+		if (sscanf(wall[i], "%u.%u", &bus, &chip) != 2) {
+			pr_err(DRVNAME \
+				":  could not parse wall parameter: %s\n",
+				wall[i]);
+			ret = -EINVAL;
+			goto out_delete;
+		}
+		master = spi_busnum_to_master(bus);
+		if (!master) {
+			pr_err(DRVNAME \
+				":  spi_busnum_to_master(%d) returned NULL\n",
+				bus);
+			ret = -EINVAL;
+			goto out_delete;
+		}
+		fbtft_device_delete(master, chip);
+		spi->bus_num = bus;
+		spi->chip_select = chip;
+		wall_devices[i] = spi_new_device(master, spi);
+		put_device(&master->dev);
+		if (!wall_devices[i]) {
+			pr_err(DRVNAME":    spi_new_device() returned NULL\n");
+			ret = -EPERM;
+			goto out_delete;
+		}
+		wall_names[i] = dev_name(&wall_devices[i]->dev);
+	}
+
+	wall_info.num_panels = wall_num;
+	wall_info.cols = wall_cols;
+	wall_device = platform_device_register_data(NULL, "fbtft_wall", -1,
+					&wall_pdata, sizeof(wall_pdata));
+	if (IS_ERR(wall_device)) {
+		ret = PTR_ERR(wall_device);
+		wall_device = NULL;
+		pr_err(DRVNAME \
+			":    platform_device_register_data() returned %d\n",
+			ret);
+		goto out_delete;
+	}
+
+	return 0;
+
+out_delete:
+	fbtft_device_wall_delete();
+
+	return ret;
+}
+
 static int __init fbtft_device_init(void)
 {
 	struct spi_master *master = NULL;
@@ -837,23 +1006,30 @@ static int __init fbtft_device_init(void)
 	for (i = 0; i < ARRAY_SIZE(displays); i++) {
 		if (strncmp(name, displays[i].name, 32) == 0) {
 			if (displays[i].spi) {
-				master = spi_busnum_to_master(busnum);
-				if (!master) {
-					pr_err(DRVNAME \
-						":  spi_busnum_to_master(%d) returned NULL\n",
-						busnum);
-					return -EINVAL;
-				}
-				/* make sure bus:cs is available */
-				fbtft_device_delete(master, cs);
 				spi = displays[i].spi;
-				spi->chip_select = cs;
-				spi->bus_num = busnum;
+				if (!wall_num) {
+					master = spi_busnum_to_master(busnum);
+					if (!master) {
+						pr_err(DRVNAME \
+							":  spi_busnum_to_master(%d) returned NULL\n",
+							busnum);
+						return -EINVAL;
+					}
+					/* make sure bus:cs is available */
+					fbtft_device_delete(master, cs);
+					spi->chip_select = cs;
+					spi->bus_num = busnum;
+				}
 				if (speed)
 					spi->max_speed_hz = speed;
 				if (mode != -1)
 					spi->mode = mode;
 				pdata = (void *)spi->platform_data;
+			} else if (wall_num) {
+				pr_err(DRVNAME \
+					":  wall parameter: '%s' isn't a SPI display\n",
+					name);
+				return -EINVAL;
 			} else if (displays[i].pdev) {
 				p_device = displays[i].pdev;
 				pdata = p_device->dev.platform_data;
@@ -876,6 +1052,16 @@ static int __init fbtft_device_init(void)
 				pdata->fps = fps;
 			if (txbuflen)
 				pdata->txbuflen = txbuflen;
+			if (speed_cmd)
+				pdata->speed_cmd = speed_cmd;
+			if (speed_read)
+				pdata->speed_read = speed_read;
+			if (calibrate)
+				pdata->calibrate = calibrate;
+			if (scanline)
+				pdata->scanline = true;
+			if (rgb666)
+				pdata->rgb666 = true;
 			if (init_num)
 				pdata->display.init_sequence = init;
 			if (gpio)
@@ -886,7 +1072,13 @@ static int __init fbtft_device_init(void)
 				pdata->display.buswidth = buswidth;
 			}
 
-			if (displays[i].spi) {
+			if (displays[i].spi && wall_num) {
+				ret = fbtft_device_wall(spi, pdata);
+				if (ret < 0)
+					return ret;
+				found = true;
+				break;
+			} else if (displays[i].spi) {
 				spi_device = spi_new_device(master, spi);
 				put_device(&master->dev);
 				if (!spi_device) {
@@ -941,6 +1133,9 @@ static void __exit fbtft_device_exit(void)
 {
 	pr_debug(DRVNAME" - exit\n");
 
+	/* the wall goes first, it writes to the displays */
+	fbtft_device_wall_delete();
+
 	if (spi_device) {
 		device_del(&spi_device->dev);
 		kfree(spi_device);
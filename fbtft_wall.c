@@ -0,0 +1,389 @@
+/*
+ * Several FBTFT displays shown as one framebuffer
+ *
+ * The wall is an FBTFT device without a bus. Its frame is cut into tiles,
+ * one per member display, in a grid filled row by row. On each update the
+ * damaged lines of every tile are copied into that display's video memory
+ * and its own deferred io work is started at once, so the members' buses
+ * are written in parallel. The update ends when all of them have been
+ * written: tiles flip together, and FBIO_WAITFORVSYNC, FBTFT_IOCTL_FLUSH
+ * and panning on the wall cover the whole wall.
+ *
+ * The members are normal FBTFT displays registered before the wall. They
+ * must have the same size and depth, and aren't meant to be drawn on
+ * directly while they are part of a wall.
+ *
+ * Usage, four emulated 320x240 panels as a 640x480 wall:
+ *   modprobe fbtft_dcs_emul panels=4 width=240 height=320 speed=32000000
+ *   modprobe fbtft_device name=dcs_emul_ili9341 rotate=90 \
+ *     wall=32.0,33.0,34.0,35.0 wall_cols=2
+ *   Scripts/fbbench.py -d /dev/fbN video   (fbN being the wall)
+ *
+ * Compared to 'wall=32.0,33.0' (one row) or a single panel, the delivered
+ * fps in /sys/class/graphics/fbN/stats show how throughput scales with
+ * the number of buses.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/fb.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/notifier.h>
+#include <linux/platform_device.h>
+
+#include "fbtft.h"
+
+#define DRVNAME "fbtft_wall"
+
+/* how long a member gets to write its tile */
+#define FBTFT_WALL_TIMEOUT	HZ
+
+/**
+ * struct fbtft_wall_panel - Member display
+ * @info: Its frame buffer, NULL once it has gone away
+ * @x: Left edge of its tile in the wall
+ * @y: Top edge of its tile
+ * @seq: Its update that carries the tile, see fbtft_flush()
+ * @busy: @seq hasn't been waited for yet
+ */
+struct fbtft_wall_panel {
+	struct fb_info *info;
+	unsigned x;
+	unsigned y;
+	u64 seq;
+	bool busy;
+};
+
+/**
+ * struct fbtft_wall - Driver data, in fbtft_par.extra
+ * @par: The wall's own driver data, NULL until probe is done with the lookup
+ * @nb: Drops members that unregister
+ * @lock: Serializes @nb with the lookup and with setting @par
+ * @num_panels: Number of entries in @panels
+ * @panels: Members
+ */
+struct fbtft_wall {
+	struct fbtft_par *par;
+	struct notifier_block nb;
+	struct mutex lock;
+	unsigned num_panels;
+	struct fbtft_wall_panel panels[];
+};
+
+/* copy wall lines @start to @end (within the tile) to the member */
+static void fbtft_wall_copy(struct fbtft_par *par, struct fbtft_wall_panel *p,
+			unsigned start, unsigned end)
+{
+	struct fb_info *info = p->info;
+	unsigned bpp = par->info->var.bits_per_pixel;
+	size_t line_length = info->fix.line_length;
+	size_t len = min_t(size_t, line_length,
+				DIV_ROUND_UP(info->var.xres * bpp, 8));
+	u8 *src = fbtft_vmem(par) + p->x * bpp / 8;
+	u8 *dst = (u8 __force *)info->screen_base +
+			(info->var.yoffset + start - p->y) * line_length;
+	unsigned y;
+
+	for (y = start; y <= end; y++, dst += line_length)
+		memcpy(dst, src + fbtft_line_offset(par, y), len);
+}
+
+static void fbtft_wall_update_display(struct fbtft_par *par,
+				unsigned start_line, unsigned end_line)
+{
+	struct fbtft_wall *wall = par->extra;
+	struct fbtft_wall_panel *p;
+	struct fbtft_par *mpar;
+	unsigned start, end;
+	u64 seq, t;
+	unsigned i;
+
+	mutex_lock(&par->update_lock);
+	seq = fbtft_flush_begin(par);
+	t = ktime_to_ns(ktime_get());
+
+	/* start every member that has damage ... */
+	for (i = 0; i < wall->num_panels; i++) {
+		p = &wall->panels[i];
+		if (!p->info || end_line < p->y ||
+				start_line >= p->y + p->info->var.yres)
+			continue;
+		start = max(start_line, p->y);
+		end = min(end_line, p->y + p->info->var.yres - 1);
+
+		fbtft_wall_copy(par, p, start, end);
+		mpar = p->info->par;
+		mpar->fbtftops.mkdirty(p->info,
+			p->info->var.yoffset + start - p->y, end - start + 1);
+		p->seq = fbtft_flush(p->info, false);
+		p->busy = true;
+	}
+
+	/* ... and end the update when they all have written their tile */
+	for (i = 0; i < wall->num_panels; i++) {
+		p = &wall->panels[i];
+		if (!p->busy)
+			continue;
+		p->busy = false;
+		if (fbtft_flush_wait(p->info, p->seq, FBTFT_WALL_TIMEOUT))
+			dev_warn_ratelimited(par->info->device,
+				"%s: timed out waiting for %s\n", __func__,
+				dev_name(p->info->device));
+	}
+
+	fbtft_update_stats(par, end_line - start_line + 1, 0, t, -ENODEV);
+	fbtft_flush_end(par, seq);
+	mutex_unlock(&par->update_lock);
+}
+
+/* the members have been initialized by their own drivers */
+static int fbtft_wall_init_display(struct fbtft_par *par)
+{
+	return 0;
+}
+
+/* there's no bus, the members write their tiles */
+static int fbtft_wall_write(struct fbtft_par *par, void *buf, size_t len)
+{
+	return -EOPNOTSUPP;
+}
+
+static int fbtft_wall_blank(struct fbtft_par *par, bool on)
+{
+	struct fbtft_wall *wall = par->extra;
+	struct fbtft_par *mpar;
+	unsigned i;
+	int ret = 0;
+
+	mutex_lock(&par->update_lock);
+	for (i = 0; i < wall->num_panels; i++) {
+		if (!wall->panels[i].info)
+			continue;
+		mpar = wall->panels[i].info->par;
+		if (mpar->fbtftops.blank && mpar->fbtftops.blank(mpar, on) < 0)
+			ret = -EIO;
+	}
+	mutex_unlock(&par->update_lock);
+
+	return ret;
+}
+
+static int fbtft_wall_notify(struct notifier_block *nb, unsigned long action,
+			void *data)
+{
+	struct fbtft_wall *wall = container_of(nb, struct fbtft_wall, nb);
+	struct fb_event *event = data;
+	unsigned i;
+
+	if (action != FB_EVENT_FB_UNREGISTERED)
+		return NOTIFY_DONE;
+
+	/* holds the unregistration off while probe looks up the members */
+	mutex_lock(&wall->lock);
+	if (wall->par)
+		mutex_lock(&wall->par->update_lock);
+	for (i = 0; i < wall->num_panels; i++) {
+		if (wall->panels[i].info != event->info)
+			continue;
+		if (wall->par)
+			dev_warn(wall->par->info->device, "%s has gone away\n",
+				dev_name(event->info->device));
+		wall->panels[i].info = NULL;
+	}
+	if (wall->par)
+		mutex_unlock(&wall->par->update_lock);
+	mutex_unlock(&wall->lock);
+
+	return NOTIFY_OK;
+}
+
+/*
+ * Look up the members and lay them out, fills in the wall's size. Called
+ * with wall->lock held and the notifier registered, so that none of them
+ * can finish unregistering meanwhile.
+ */
+static int fbtft_wall_get_panels(struct device *dev, struct fbtft_wall *wall,
+			struct fbtft_wall_platform_data *wpdata,
+			struct fbtft_display *display)
+{
+	unsigned cols = wpdata->cols ?: wpdata->num_panels;
+	struct fb_info *first = NULL;
+	struct fb_info *info;
+	unsigned i;
+
+	for (i = 0; i < wpdata->num_panels; i++) {
+		info = fbtft_find_framebuffer(wpdata->panels[i]);
+		if (!info) {
+			dev_dbg(dev, "waiting for %s\n", wpdata->panels[i]);
+			return -EPROBE_DEFER;
+		}
+		if (!first)
+			first = info;
+		if (info->var.xres != first->var.xres ||
+				info->var.yres != first->var.yres ||
+				info->var.bits_per_pixel !=
+					first->var.bits_per_pixel) {
+			dev_err(dev, "%s doesn't match %s\n",
+				wpdata->panels[i], wpdata->panels[0]);
+			return -EINVAL;
+		}
+		wall->panels[i].info = info;
+		wall->panels[i].x = (i % cols) * info->var.xres;
+		wall->panels[i].y = (i / cols) * info->var.yres;
+	}
+
+	/* tiles are copied a byte at a time */
+	if (cols > 1 && first->var.xres * first->var.bits_per_pixel % 8) {
+		dev_err(dev, "%u pixel wide tiles don't start on a byte\n",
+			first->var.xres);
+		return -EINVAL;
+	}
+
+	display->width = cols * first->var.xres;
+	display->height = DIV_ROUND_UP(wpdata->num_panels, cols) *
+				first->var.yres;
+	display->bpp = first->var.bits_per_pixel;
+	display->fps = HZ / first->fbdefio->delay;
+
+	return 0;
+}
+
+static int fbtft_wall_probe(struct platform_device *pdev)
+{
+	struct fbtft_platform_data *pdata = pdev->dev.platform_data;
+	struct fbtft_wall_platform_data *wpdata;
+	struct fbtft_display display = {
+		.fbtftops = {
+			.write = fbtft_wall_write,
+			.init_display = fbtft_wall_init_display,
+			.update_display = fbtft_wall_update_display,
+			.blank = fbtft_wall_blank,
+		},
+	};
+	struct fbtft_wall *wall;
+	struct fbtft_par *par;
+	struct fb_info *info;
+	unsigned i;
+	int ret;
+
+	if (!pdata || !pdata->extra) {
+		dev_err(&pdev->dev, "missing platform data\n");
+		return -EINVAL;
+	}
+	wpdata = pdata->extra;
+	if (!wpdata->num_panels) {
+		dev_err(&pdev->dev, "no panels\n");
+		return -EINVAL;
+	}
+	if (pdata->rotate) {
+		dev_err(&pdev->dev, "rotate the member displays instead\n");
+		return -EINVAL;
+	}
+
+	wall = devm_kzalloc(&pdev->dev, sizeof(*wall) +
+		wpdata->num_panels * sizeof(wall->panels[0]), GFP_KERNEL);
+	if (!wall)
+		return -ENOMEM;
+	wall->num_panels = wpdata->num_panels;
+	mutex_init(&wall->lock);
+
+	/* before the lookup, so no member can go away unnoticed */
+	wall->nb.notifier_call = fbtft_wall_notify;
+	ret = fb_register_client(&wall->nb);
+	if (ret)
+		return ret;
+
+	mutex_lock(&wall->lock);
+	ret = fbtft_wall_get_panels(&pdev->dev, wall, wpdata, &display);
+	mutex_unlock(&wall->lock);
+	if (ret)
+		goto out_unregister_client;
+
+	info = fbtft_framebuffer_alloc(&display, &pdev->dev);
+	if (!info) {
+		ret = -ENOMEM;
+		goto out_unregister_client;
+	}
+
+	par = info->par;
+	par->pdev = pdev;
+	par->extra = wall;
+	/* pixels are copied as they are, keep the format of the members */
+	kfree(par->txbuf.buf);
+	par->txbuf.buf = NULL;
+	par->txbuf.len = 0;
+
+	/* from here on the notifier warns, before that members just go */
+	mutex_lock(&wall->lock);
+	wall->par = par;
+	for (i = 0; i < wall->num_panels; i++)
+		if (!wall->panels[i].info)
+			ret = -EPROBE_DEFER;
+	mutex_unlock(&wall->lock);
+	if (ret) {
+		dev_dbg(&pdev->dev, "a member went away, waiting for it\n");
+		goto out_release;
+	}
+
+	ret = fbtft_register_framebuffer(info);
+	if (ret < 0)
+		goto out_release;
+
+	dev_info(info->dev, "%u displays, %u per row\n", wall->num_panels,
+		wpdata->cols ?: wall->num_panels);
+
+	return 0;
+
+out_release:
+	fbtft_framebuffer_release(info);
+out_unregister_client:
+	fb_unregister_client(&wall->nb);
+
+	return ret;
+}
+
+static int fbtft_wall_remove(struct platform_device *pdev)
+{
+	struct fb_info *info = platform_get_drvdata(pdev);
+	struct fbtft_par *par = info->par;
+	struct fbtft_wall *wall = par->extra;
+
+	fbtft_unregister_framebuffer(info);
+	/* writes what's still pending, the members are needed for that */
+	fbtft_framebuffer_release(info);
+	fb_unregister_client(&wall->nb);
+
+	return 0;
+}
+
+static struct platform_driver fbtft_wall_driver = {
+	.driver = {
+		.name   = DRVNAME,
+		.owner  = THIS_MODULE,
+	},
+	.probe  = fbtft_wall_probe,
+	.remove = fbtft_wall_remove,
+};
+
+module_platform_driver(fbtft_wall_driver);
+
+MODULE_ALIAS("platform:" DRVNAME);
+MODULE_DESCRIPTION("Several FBTFT displays shown as one framebuffer");
+MODULE_LICENSE("GPL");
@@ -67,6 +67,10 @@ static bool latched = false;
 module_param(latched, bool, 0);
 MODULE_PARM_DESC(latched, "Use with latched 16-bit databus");
 
+static bool tear = false;
+module_param(tear, bool, 0);
+MODULE_PARM_DESC(tear, "Enable the TE output with MIPI DCS TEON/TEOFF");
+
 
 static int *initp = NULL;
 static int initp_num = 0;
@@ -199,6 +203,12 @@ static void set_addr_win_3(struct fbtft_par *par, int xs, int ys, int xe, int ye
 	write_reg(par, 0x5C);
 }
 
+/* the init sequence sets the scan direction, set_addr_win follows rotate */
+static int flexfb_set_var(struct fbtft_par *par)
+{
+	return 0;
+}
+
 static int flexfb_verify_gpios_dc(struct fbtft_par *par)
 {
 	fbtft_par_dbg(DEBUG_VERIFY_GPIOS, par, "%s()\n", __func__);
@@ -268,6 +278,7 @@ static int flexfb_probe_common(struct spi_device *sdev, struct platform_device *
 				width = 128;
 			if (!height)
 				height = 160;
+			tear = true;
 			if (init_num == 0) {
 				initp = st7735r_init;
 				initp_num = ARRAY_SIZE(st7735r_init);
@@ -332,6 +343,7 @@ static int flexfb_probe_common(struct spi_device *sdev, struct platform_device *
 				height = 320;
 			setaddrwin = 0;
 			regwidth = 8;
+			tear = true;
 			if (init_num == 0) {
 				initp = ili9341_init;
 				initp_num = ARRAY_SIZE(ili9341_init);
@@ -392,6 +404,7 @@ static int flexfb_probe_common(struct spi_device *sdev, struct platform_device *
 	if (!par->init_sequence)
 		par->init_sequence = initp;
 	par->fbtftops.init_display = fbtft_init_display;
+	par->fbtftops.set_var = flexfb_set_var;
 
 	/* registerwrite functions */
 	switch (regwidth) {
@@ -473,6 +486,9 @@ static int flexfb_probe_common(struct spi_device *sdev, struct platform_device *
 		return -EINVAL;
 	}
 
+	if (tear)
+		par->fbtftops.set_tear = fbtft_set_tear;
+
 	if (!nobacklight)
 		par->fbtftops.register_backlight = fbtft_register_backlight;
 